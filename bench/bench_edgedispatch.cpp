@@ -0,0 +1,129 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// Per-edge dispatch from the backend callback into the handler: through the
+// std::function of edgeFuncRegister against the trampoline instantiated by
+// edgeMethodRegister. The callback registered with the stub backend is
+// called directly, as pigpio's thread would, so that only the dispatch and
+// the pin's edge counting are timed.
+//
+//-----------------------------------------------------------------------------
+
+#include <functional>
+#include <iostream>
+
+#include "check.h"
+#include "stubbackend.h"
+
+#include "pigpiomgr.h"
+#include "gpiopin.h"
+#include "timing.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// pins of the two handlers
+static const unsigned FUNCTION_GPIO = 17;
+static const unsigned METHOD_GPIO   = 18;
+
+/// edges per timed run
+static const unsigned EDGES = 20000000;
+
+/// timed runs of each path
+static const unsigned ROUNDS = 3;
+
+//-----------------------------------------------------------------------------
+
+/// Edge handler doing as little as a flow meter does
+class Counter {
+public:
+    Counter()
+        :_pulses( 0 )
+        ,_lastTick( 0 )
+    {
+    }
+
+    void edge( unsigned pin, bool level, unsigned tick ) {
+        _pulses += level ? 1 : 0;
+        _lastTick = tick;
+    }
+
+    unsigned pulses() const { return _pulses; }
+
+private:
+    unsigned _pulses;
+    unsigned _lastTick;
+};
+
+//-----------------------------------------------------------------------------
+
+/// Time of one edge through the callback registered for pin (ns)
+static double timeDispatch( StubBackend* stub, unsigned pin ) {
+    GPIOBackend::EdgeCallback edgeCallback = nullptr;
+    void* userData = nullptr;
+    if ( !CHECK( stub->registered( pin, edgeCallback, userData ) ) ) {
+        return 0.0;
+    }
+
+    // through volatiles, so that the call is not resolved at compile time
+    GPIOBackend::EdgeCallback volatile callback = edgeCallback;
+    void* volatile data = userData;
+
+    const double start = getClock();
+    for ( unsigned edge = 0; edge < EDGES; ++edge ) {
+        callback( pin, edge & 1, edge, data );
+    }
+    return 1.0E9 * ( getClock() - start ) / EDGES;
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    Singleton<Logger>::initialize( new Logger() );
+    Singleton<Logger>::reference().enableConsoleLog( Log::LS_Warning );
+
+    StubBackend* stub = new StubBackend();
+    Singleton<PIGPIOManager>::initialize( new PIGPIOManager( stub ) );
+
+    {
+        Counter functionCounter;
+        Counter methodCounter;
+
+        GPIOPin functionPin( FUNCTION_GPIO );
+        GPIOPin methodPin( METHOD_GPIO );
+
+        CHECK( functionPin.edgeFuncRegister( std::bind( &Counter::edge, &functionCounter,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3 ) ) );
+        const bool methodRegistered = methodPin.edgeMethodRegister<Counter, &Counter::edge>( &methodCounter );
+        CHECK( methodRegistered );
+
+        for ( unsigned round = 0; round < ROUNDS; ++round ) {
+            const double function = timeDispatch( stub, FUNCTION_GPIO );
+            const double method   = timeDispatch( stub, METHOD_GPIO );
+
+            std::cout << "edgedispatch: std::function " << function << " ns, member template "
+                << method << " ns per edge" << std::endl;
+        }
+
+        // every edge reached its handler
+        CHECK( functionCounter.pulses() == ROUNDS * EDGES / 2 );
+        CHECK( methodCounter.pulses() == ROUNDS * EDGES / 2 );
+
+        functionPin.edgeFuncCancel();
+        methodPin.edgeFuncCancel();
+    }
+
+    Singleton<PIGPIOManager>::deinitialize();
+
+    const int result = Check::result( "edgedispatch" );
+    Singleton<Logger>::deinitialize();
+    return result;
+}
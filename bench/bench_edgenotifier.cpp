@@ -0,0 +1,210 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// Edge capture through the notification pipe of the EdgeNotifier against
+// one backend callback per pin. The stub backend delivers each injected
+// edge to the callbacks on the injecting thread, standing in for pigpio's
+// callback thread, and as a level report to its FIFO, which the notifier's
+// worker reads. Edges are paced like a fast sensor line and, for the pipe,
+// also sent in bursts. Measured are the latency from the injection to the
+// handler and the CPU time per edge above that of injecting alone.
+//
+//-----------------------------------------------------------------------------
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+#include "check.h"
+#include "stubbackend.h"
+
+#include "pigpiomgr.h"
+#include "gpiopin.h"
+#include "edgenotifier.h"
+#include "timing.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// pins of the baseline, the callback and the notifier run
+static const unsigned IDLE_GPIO     = 16;
+static const unsigned CALLBACK_GPIO = 17;
+static const unsigned NOTIFY_GPIO   = 18;
+
+/// paced edges per run and the time between them (us)
+static const unsigned EDGES         = 10000;
+static const unsigned EDGE_INTERVAL = 200;
+
+/// edges per burst and bursts, sent back to back
+static const unsigned BURST_EDGES = 1000;
+static const unsigned BURSTS      = 10;
+
+/// time the notifier is given to drain the pipe after a run (ms)
+static const unsigned DRAIN_MS = 200;
+
+//-----------------------------------------------------------------------------
+
+/// Edge handler recording the latency from the injection
+class Recorder {
+public:
+    Recorder( StubBackend* stub )
+        :_stub( stub )
+        ,_edges( 0 )
+        ,_latency( 0 )
+        ,_maxLatency( 0 )
+    {
+    }
+
+    void edge( unsigned pin, bool level, unsigned tick ) {
+        const unsigned latency = _stub->getTick() - tick;
+        _edges.store( _edges.load() + 1 );
+        _latency.store( _latency.load() + latency );
+        _maxLatency.store( std::max( _maxLatency.load(), latency ) );
+    }
+
+    void reset() {
+        _edges.store( 0 );
+        _latency.store( 0 );
+        _maxLatency.store( 0 );
+    }
+
+    unsigned edges() const { return _edges.load(); }
+
+    /// mean and longest latency (us)
+    double meanLatency() const { return _edges.load() > 0 ? static_cast<double>( _latency.load() ) / _edges.load() : 0.0; }
+    unsigned maxLatency() const { return _maxLatency.load(); }
+
+private:
+    StubBackend* _stub;
+    std::atomic<unsigned> _edges;
+    std::atomic<uint64_t> _latency;
+    std::atomic<unsigned> _maxLatency;
+};
+
+//-----------------------------------------------------------------------------
+
+/// CPU time of the process so far (s)
+static double cpuTime() {
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + 1.0E-6 * ( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Inject paced edges on pin; returns the CPU time per edge (us)
+static double paced( StubBackend* stub, unsigned pin ) {
+    const double start = cpuTime();
+
+    for ( unsigned edge = 0; edge < EDGES; ++edge ) {
+        stub->edge( pin, edge & 1, stub->getTick() );
+        std::this_thread::sleep_for( std::chrono::microseconds( EDGE_INTERVAL ) );
+    }
+    delayms( DRAIN_MS );
+
+    return 1.0E6 * ( cpuTime() - start ) / EDGES;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Inject bursts of edges on pin, a pause after each; returns the CPU time
+/// per edge (us)
+static double bursts( StubBackend* stub, unsigned pin ) {
+    const double start = cpuTime();
+
+    for ( unsigned burst = 0; burst < BURSTS; ++burst ) {
+        for ( unsigned edge = 0; edge < BURST_EDGES; ++edge ) {
+            stub->edge( pin, edge & 1, stub->getTick() );
+        }
+        delayms( DRAIN_MS / 4 );
+    }
+    delayms( DRAIN_MS );
+
+    return 1.0E6 * ( cpuTime() - start ) / ( BURSTS * BURST_EDGES );
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    Singleton<Logger>::initialize( new Logger() );
+    Singleton<Logger>::reference().enableConsoleLog( Log::LS_Warning );
+
+    StubBackend* stub = new StubBackend();
+    Singleton<PIGPIOManager>::initialize( new PIGPIOManager( stub ) );
+
+    {
+        Recorder callbackRecorder( stub );
+        Recorder notifyRecorder( stub );
+
+        // injecting alone, nobody listens on the pin
+        const double idle = paced( stub, IDLE_GPIO );
+
+        // one backend callback, before the notifier exists
+        GPIOPin callbackPin( CALLBACK_GPIO );
+        CHECK( callbackPin.setEdgeTrigger( GPIOPin::Both ) );
+        const bool callbackRegistered = callbackPin.edgeMethodRegister<Recorder, &Recorder::edge>( &callbackRecorder );
+        CHECK( callbackRegistered );
+
+        const double callback = paced( stub, CALLBACK_GPIO ) - idle;
+        CHECK( callbackRecorder.edges() == EDGES );
+
+        std::cout << "edgenotifier: injecting " << idle << " us CPU per edge every " << EDGE_INTERVAL << " us" << std::endl;
+        std::cout << "edgenotifier: callback +" << callback << " us CPU per edge, latency "
+            << callbackRecorder.meanLatency() << " us mean, " << callbackRecorder.maxLatency() << " us max" << std::endl;
+
+        callbackPin.edgeFuncCancel();
+
+        // the notifier takes over the edge functions registered from now on
+        Singleton<EdgeNotifier>::initialize( new EdgeNotifier() );
+        if ( CHECK( Singleton<EdgeNotifier>::pointer()->ready() ) ) {
+            GPIOPin notifyPin( NOTIFY_GPIO );
+            CHECK( notifyPin.setEdgeTrigger( GPIOPin::Both ) );
+            const bool notifyRegistered = notifyPin.edgeMethodRegister<Recorder, &Recorder::edge>( &notifyRecorder );
+            CHECK( notifyRegistered );
+
+            // the first report only sets the levels
+            const double notify = paced( stub, NOTIFY_GPIO ) - idle;
+            CHECK( notifyRecorder.edges() + 1 >= EDGES );
+
+            EdgeNotifier::Statistics statistics;
+            Singleton<EdgeNotifier>::pointer()->getStatistics( statistics );
+
+            std::cout << "edgenotifier: pipe +" << notify << " us CPU per edge, latency "
+                << notifyRecorder.meanLatency() << " us mean, " << notifyRecorder.maxLatency() << " us max, "
+                << static_cast<double>( statistics.reports ) / statistics.reads << " reports per read" << std::endl;
+
+            notifyRecorder.reset();
+            const double burst = bursts( stub, NOTIFY_GPIO );
+            CHECK( notifyRecorder.edges() == BURSTS * BURST_EDGES );
+
+            EdgeNotifier::Statistics burstStatistics;
+            Singleton<EdgeNotifier>::pointer()->getStatistics( burstStatistics );
+
+            std::cout << "edgenotifier: pipe in bursts of " << BURST_EDGES << " " << burst << " us CPU per edge, latency "
+                << notifyRecorder.meanLatency() << " us mean, " << notifyRecorder.maxLatency() << " us max, "
+                << static_cast<double>( burstStatistics.reports - statistics.reports ) / ( burstStatistics.reads - statistics.reads )
+                << " reports per read, " << burstStatistics.gaps << " lost" << std::endl;
+
+            CHECK( burstStatistics.gaps == 0 );
+
+            notifyPin.edgeFuncCancel();
+        }
+
+        Singleton<EdgeNotifier>::deinitialize();
+    }
+
+    Singleton<PIGPIOManager>::deinitialize();
+
+    const int result = Check::result( "edgenotifier" );
+    Singleton<Logger>::deinitialize();
+    return result;
+}
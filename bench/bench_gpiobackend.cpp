@@ -0,0 +1,131 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// Time per call of the GPIO backend built in, as the program uses it: the
+// pigpiod daemon behind the command queue, or the pigpio library in this
+// process (make GPIO_LOCAL=1); run the bench once for each. Only calls that
+// leave the pins alone are timed. Then the same calls on the stub backend,
+// directly and through the command queue, for the cost of the queue itself.
+//
+//-----------------------------------------------------------------------------
+
+#include <iostream>
+
+#include "check.h"
+#include "stubbackend.h"
+
+#include "pigpiomgr.h"
+#include "commandqueue.h"
+#include "timing.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// calls per timed run
+static const unsigned CALLS = 20000;
+
+/// pin read, an input of the machine (flow sensor)
+static const unsigned READ_GPIO = 17;
+
+/// highest cost of the command queue per call over the stub (us)
+static const double MAX_QUEUE_OVERHEAD = 5.0;
+
+//-----------------------------------------------------------------------------
+
+/// A call timed, leaving the pins as they are
+struct Call {
+    const char* name;
+    void (*call)( GPIOBackend* backend );
+};
+
+static void tick( GPIOBackend* backend )         { backend->getTick(); }
+static void read( GPIOBackend* backend )         { backend->read( READ_GPIO ); }
+static void readBank1( GPIOBackend* backend )    { backend->readBank1(); }
+static void pwmFrequency( GPIOBackend* backend ) { backend->getPWMFrequency( READ_GPIO ); }
+
+static const Call CALLS_TIMED[] = {
+    { "getTick",         &tick         },
+    { "read",            &read         },
+    { "readBank1",       &readBank1    },
+    { "getPWMFrequency", &pwmFrequency }
+};
+
+static const unsigned CALL_COUNT = sizeof( CALLS_TIMED ) / sizeof( CALLS_TIMED[0] );
+
+//-----------------------------------------------------------------------------
+
+/// Time of one call on backend (us)
+static double perCall( GPIOBackend* backend, const Call& call ) {
+    const double start = getClock();
+
+    for ( unsigned count = 0; count < CALLS; ++count ) {
+        call.call( backend );
+    }
+
+    return 1.0E6 * ( getClock() - start ) / CALLS;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Time every call on backend and print it; returns the mean (us)
+static double timeCalls( const std::string& label, GPIOBackend* backend ) {
+    double total = 0.0;
+
+    for ( unsigned index = 0; index < CALL_COUNT; ++index ) {
+        const double time = perCall( backend, CALLS_TIMED[index] );
+        total += time;
+
+        std::cout << "gpiobackend: " << label << " " << CALLS_TIMED[index].name << " " << time << " us per call" << std::endl;
+    }
+
+    return total / CALL_COUNT;
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    Singleton<Logger>::initialize( new Logger() );
+    Singleton<Logger>::reference().enableConsoleLog( Log::LS_Warning );
+
+#ifdef GPIO_LOCAL
+    const bool local = true;
+#else
+    const bool local = false;
+#endif
+
+    // the backend built in, needs pigpiod or root on the PI
+    {
+        PIGPIOManager manager( local );
+
+        if ( manager.ready() ) {
+            timeCalls( manager.backend()->name(), manager.backend() );
+        }
+        else {
+            std::cout << "gpiobackend: " << ( local ? "local" : "pigpiod" ) << " not available, not timed" << std::endl;
+        }
+    }
+
+    // the stub, directly and queued
+    StubBackend* direct = new StubBackend();
+    const double directTime = timeCalls( "stub", direct );
+    delete direct;
+
+    CommandQueue queue( new StubBackend() );
+    const double queuedTime = timeCalls( "stub queued", &queue );
+
+    std::cout << "gpiobackend: command queue +" << queuedTime - directTime << " us per call" << std::endl;
+
+    CHECK( queuedTime - directTime <= MAX_QUEUE_OVERHEAD );
+
+    const int result = Check::result( "gpiobackend" );
+    Singleton<Logger>::deinitialize();
+    return result;
+}
@@ -0,0 +1,287 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// Edge callback latency while readers hammer getDegrees. A synthetic ZACwire
+// edge stream is replayed on one thread while reader threads poll the
+// temperature, and the time spent in each callback is recorded, for:
+//
+// - mutex:   decoding in the callback, publishing under the mutex the
+//            readers take (TSIC before the sequence lock)
+// - seqlock: decoding in the callback, publishing through the SeqLock
+// - tsic:    the TSIC class as it is, through the stub backend
+//
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "stubbackend.h"
+#include "zacwire.h"
+
+#include "pigpiomgr.h"
+#include "seqlock.h"
+#include "tsic.h"
+#include "tsicdecoder.h"
+#include "timing.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// data line of the synthetic sensor
+static const unsigned TSIC_GPIO = 4;
+
+/// threads polling getDegrees
+static const unsigned READERS = 4;
+
+/// replay time of each variant (s)
+static const double RUN_SECONDS = 3.0;
+
+/// pause between packets (ms), 20 times the sensor rate
+static const unsigned PACKET_GAP_MS = 5;
+
+/// packets in the replayed stream
+static const unsigned STREAM_PACKETS = 1000;
+
+//-----------------------------------------------------------------------------
+
+/// Temperature as published to the readers
+struct Sample {
+    double temperature;
+    bool   valid;
+};
+
+/// TSIC before the sequence lock: the callback decodes and publishes under
+/// the mutex getDegrees takes
+class MutexSensor {
+public:
+    MutexSensor()
+        :_sample()
+    {
+    }
+
+    void edge( bool level, uint32_t tick ) {
+        TSICDecoder::Packet packet;
+        if ( !_decoder.edge( level, tick, packet ) ) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock( _mutex );
+        if ( packet.valid ) {
+            _sample.temperature = static_cast<double>( packet.temperature ) / TSICDecoder::SCALE_FACTOR;
+        }
+        _sample.valid = packet.valid;
+    }
+
+    bool getDegrees( double& value ) const {
+        std::lock_guard<std::mutex> lock( _mutex );
+        value = _sample.temperature;
+        return _sample.valid;
+    }
+
+private:
+    TSICDecoder _decoder;
+    Sample _sample;
+    mutable std::mutex _mutex;
+};
+
+/// The same, publishing through the sequence lock
+class SeqLockSensor {
+public:
+    void edge( bool level, uint32_t tick ) {
+        TSICDecoder::Packet packet;
+        if ( !_decoder.edge( level, tick, packet ) ) {
+            return;
+        }
+
+        Sample sample = _sample.load();
+        if ( packet.valid ) {
+            sample.temperature = static_cast<double>( packet.temperature ) / TSICDecoder::SCALE_FACTOR;
+        }
+        sample.valid = packet.valid;
+        _sample.store( sample );
+    }
+
+    bool getDegrees( double& value ) const {
+        const Sample sample = _sample.load();
+        value = sample.temperature;
+        return sample.valid;
+    }
+
+private:
+    TSICDecoder _decoder;
+    SeqLock<Sample> _sample;
+};
+
+//-----------------------------------------------------------------------------
+
+/// Callback times of one run
+struct Result {
+    size_t   edges;
+    double   mean;      ///< ns
+    uint64_t p999;      ///< 99.9th percentile (ns)
+    uint64_t worst;     ///< ns
+    double   readRate;  ///< getDegrees calls per second, all readers
+};
+
+/// Replay stream through deliver while READERS threads call read, for
+/// RUN_SECONDS; ticks move on by offset each pass
+static Result run( const std::vector<ZACwire::Edge>& stream, const std::function<void( bool, uint32_t )>& deliver,
+    const std::function<bool( double& )>& read )
+{
+    std::atomic<bool> stop( false );
+    std::atomic<uint64_t> reads( 0 );
+
+    std::vector<std::thread> readers;
+    for ( unsigned reader = 0; reader < READERS; ++reader ) {
+        readers.push_back( std::thread( [&]{
+            uint64_t count = 0;
+            double value = 0.0;
+            while ( !stop.load( std::memory_order_relaxed ) ) {
+                read( value );
+                ++count;
+            }
+            reads += count;
+        } ) );
+    }
+
+    std::vector<uint64_t> times;
+    const double start = getClock();
+    uint32_t offset = 0;
+
+    while ( getClock() - start < RUN_SECONDS ) {
+        for ( size_t index = 0; index < stream.size() && getClock() - start < RUN_SECONDS; ++index ) {
+            const ZACwire::Edge& edge = stream[index];
+
+            const std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+            deliver( edge.level, edge.tick + offset );
+            const std::chrono::steady_clock::time_point after = std::chrono::steady_clock::now();
+
+            times.push_back( std::chrono::duration_cast<std::chrono::nanoseconds>( after - before ).count() );
+
+            // a packet ends on the 40th edge
+            if ( index % 40 == 39 ) {
+                delayms( PACKET_GAP_MS );
+            }
+        }
+        offset += stream.back().tick - stream.front().tick + 100000;
+    }
+
+    const double elapsed = getClock() - start;
+    stop = true;
+    for ( std::thread& reader : readers ) {
+        reader.join();
+    }
+
+    Result result;
+    result.edges = times.size();
+
+    uint64_t total = 0;
+    for ( uint64_t time : times ) {
+        total += time;
+    }
+    result.mean = static_cast<double>( total ) / times.size();
+
+    std::sort( times.begin(), times.end() );
+    result.p999  = times[times.size() * 999 / 1000];
+    result.worst = times.back();
+    result.readRate = reads / elapsed;
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+static void report( const char* name, const Result& result ) {
+    std::cout << "tsiccontention: " << name << ": " << result.edges << " edges, callback " << result.mean
+        << " ns mean, " << result.p999 / 1000.0 << " us 99.9%, " << result.worst / 1000.0 << " us worst; "
+        << result.readRate / 1.0E6 << " M reads/s" << std::endl;
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    Singleton<Logger>::initialize( new Logger() );
+    Singleton<Logger>::reference().enableConsoleLog( Log::LS_Warning );
+
+    // a slow warm-up, one packet per 100 ms of sensor time
+    std::vector<ZACwire::Edge> stream;
+    uint32_t tick = 1000000;
+    for ( unsigned packet = 0; packet < STREAM_PACKETS; ++packet ) {
+        ZACwire::packet( stream, ZACwire::raw( 20.0 + 0.07 * packet ), tick );
+        tick += 100000;
+    }
+
+    std::cout << "tsiccontention: " << READERS << " readers, " << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    {
+        MutexSensor sensor;
+        const Result result = run( stream,
+            [&]( bool level, uint32_t edgeTick ) { sensor.edge( level, edgeTick ); },
+            [&]( double& value ) { return sensor.getDegrees( value ); } );
+        report( "mutex", result );
+    }
+
+    {
+        SeqLockSensor sensor;
+        const Result result = run( stream,
+            [&]( bool level, uint32_t edgeTick ) { sensor.edge( level, edgeTick ); },
+            [&]( double& value ) { return sensor.getDegrees( value ); } );
+        report( "seqlock", result );
+    }
+
+    StubBackend* stub = new StubBackend();
+    Singleton<PIGPIOManager>::initialize( new PIGPIOManager( stub ) );
+
+    {
+        // TSIC waits for a first packet while it opens
+        std::atomic<bool> opened( false );
+        std::thread sensor( [&]{
+            uint32_t now = stub->getTick();
+            while ( !opened ) {
+                std::vector<ZACwire::Edge> edges;
+                ZACwire::packet( edges, ZACwire::raw( 20.0 ), now );
+                for ( const ZACwire::Edge& edge : edges ) {
+                    stub->edge( TSIC_GPIO, edge.level, edge.tick );
+                }
+                now += 100000;
+                delayms( 100 );
+            }
+        } );
+
+        TSIC tsic( std::vector<TSIC::Channel>( 1, TSIC::Channel( TSIC_GPIO ) ) );
+        opened = true;
+        sensor.join();
+
+        if ( CHECK( tsic.ready() ) ) {
+            const Result result = run( stream,
+                [&]( bool level, uint32_t edgeTick ) { stub->edge( TSIC_GPIO, level, edgeTick ); },
+                [&]( double& value ) { return tsic.getDegrees( value ); } );
+            report( "tsic", result );
+
+            double value = 0.0;
+            CHECK( tsic.getDegrees( value ) );
+            CHECK( tsic.getEdgeOverflows() == 0 );
+        }
+    }
+
+    Singleton<PIGPIOManager>::deinitialize();
+
+    const int result = Check::result( "tsiccontention" );
+    Singleton<Logger>::deinitialize();
+    return result;
+}
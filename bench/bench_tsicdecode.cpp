@@ -0,0 +1,199 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// TSIC word decoding: the lookup tables of TSICDecoder::decode against the
+// arithmetic decode they replaced, kept here as the reference. Both must
+// agree on every possible word, value and error; then both are timed on
+// all words and on the words of a boiler warm-up trace.
+//
+//-----------------------------------------------------------------------------
+
+#include <math.h>
+#include <random>
+#include <vector>
+#include <iostream>
+
+#include "check.h"
+#include "zacwire.h"
+
+#include "tsicdecoder.h"
+#include "timing.h"
+
+//-----------------------------------------------------------------------------
+
+/// number of 18 bit words
+static const int WORDS = 1 << 18;
+
+/// passes over all words when timing
+static const unsigned PASSES = 100;
+
+/// warm-up trace: 10 packets per second for 5 minutes
+static const unsigned TRACE_PACKETS = 3000;
+
+/// share of trace words with a bit flipped by noise
+static const double TRACE_NOISE = 0.01;
+
+//-----------------------------------------------------------------------------
+
+static const int MIN_TEMP = -50;
+static const int MAX_TEMP = 150;
+static const int SCALE_FACTOR = TSICDecoder::SCALE_FACTOR;
+static const int INVALID_TEMP = TSICDecoder::INVALID_TEMPERATURE;
+
+/// Error the reference found
+struct Error {
+    enum Value {
+        None,
+        Parity,
+        Prefix,
+        Range
+    };
+};
+
+/// calculate parity for an eight bit value (as before the tables)
+static int parity8( int value ) {
+    value = (value ^ (value >> 4)) & 0x0F;
+    return (0x6996 >> value) & 1;
+}
+
+/// The arithmetic decode as it was before the tables, with the error it
+/// found instead of a log line; out of line like the table path
+static int __attribute__((noinline)) referenceDecode( int packet0, int packet1, Error::Value& error ) {
+    // strip off the parity bits (LSB)
+    int parity0 = packet0 & 1;
+    packet0 >>= 1;
+    int parity1 = packet1 & 1;
+    packet1 >>= 1;
+
+    // check the parity on both bytes
+    bool valid =
+        ( parity0 == parity8(packet0) ) &&
+        ( parity1 == parity8(packet1) );
+
+    // if the parity is wrong, return INVALID_TEMP
+    if ( !valid ) {
+        error = Error::Parity;
+        return INVALID_TEMP;
+    }
+
+    // if any of the top 5 bits of packet 0 are high, that's an error
+    if ( (packet0 & 0xF8) != 0 ) {
+        error = Error::Prefix;
+        return INVALID_TEMP;
+    }
+
+    // this is our raw 11 bit word
+    int raw = (packet0 << 8) | packet1;
+
+    // convert raw integer to temperature in degrees C
+    int temp = (MAX_TEMP - MIN_TEMP) * SCALE_FACTOR * raw / 2047 + MIN_TEMP * SCALE_FACTOR;
+
+    // check that the temperature lies in the measurable range
+    if ( (temp >= MIN_TEMP * SCALE_FACTOR) && (temp <= MAX_TEMP * SCALE_FACTOR) ) {
+        error = Error::None;
+        return temp;
+    }
+    else {
+        error = Error::Range;
+        return INVALID_TEMP;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/// Both paths agree on word, in value and in the error counted
+static bool agree( int word ) {
+    const int packet0 = ( word >> 9 ) & 0x1FF;
+    const int packet1 = word & 0x1FF;
+
+    Error::Value error = Error::None;
+    const int reference = referenceDecode( packet0, packet1, error );
+
+    TSICDecoder::Statistics statistics;
+    const int table = TSICDecoder::decode( packet0, packet1, statistics );
+
+    const Error::Value counted =
+        ( statistics.parityErrors > 0 ) ? Error::Parity :
+        ( statistics.prefixErrors > 0 ) ? Error::Prefix :
+        ( statistics.rangeErrors  > 0 ) ? Error::Range : Error::None;
+
+    return ( table == reference ) && ( counted == error );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Words of a boiler warming from 20 C to 95 C, with some noise
+static std::vector<int> traceWords() {
+    std::mt19937 random( 306 );
+    std::uniform_real_distribution<double> chance( 0.0, 1.0 );
+    std::uniform_int_distribution<int> bit( 0, 17 );
+
+    std::vector<int> words;
+    for ( unsigned packet = 0; packet < TRACE_PACKETS; ++packet ) {
+        const double time = packet / 10.0;
+        const double temperature = 95.0 - 75.0 * exp( -time / 90.0 );
+
+        int word = ZACwire::word( ZACwire::raw( temperature ) );
+        if ( chance( random ) < TRACE_NOISE ) {
+            word ^= 1 << bit( random );
+        }
+        words.push_back( word );
+    }
+    return words;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Time of one decode over passes through words (ns), table or reference
+static double timeDecode( const std::vector<int>& words, unsigned passes, bool table ) {
+    TSICDecoder::Statistics statistics;
+    Error::Value error = Error::None;
+    volatile int sink = 0;
+
+    const double start = getClock();
+    for ( unsigned pass = 0; pass < passes; ++pass ) {
+        for ( int word : words ) {
+            const int packet0 = ( word >> 9 ) & 0x1FF;
+            const int packet1 = word & 0x1FF;
+            sink = table ? TSICDecoder::decode( packet0, packet1, statistics ) : referenceDecode( packet0, packet1, error );
+        }
+    }
+    const double elapsed = getClock() - start;
+
+    (void)sink;
+    return 1.0E9 * elapsed / ( static_cast<double>( passes ) * words.size() );
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    std::vector<int> all;
+    unsigned disagreements = 0;
+    for ( int word = 0; word < WORDS; ++word ) {
+        all.push_back( word );
+        disagreements += agree( word ) ? 0 : 1;
+    }
+
+    const std::vector<int> trace = traceWords();
+    for ( int word : trace ) {
+        disagreements += agree( word ) ? 0 : 1;
+    }
+
+    CHECK( disagreements == 0 );
+    std::cout << "tsicdecode: " << WORDS << " words and " << trace.size() << " trace words, "
+        << disagreements << " disagreements" << std::endl;
+
+    const unsigned tracePasses = PASSES * WORDS / TRACE_PACKETS;
+    std::cout << "tsicdecode: all words, table " << timeDecode( all, PASSES, true ) << " ns, arithmetic "
+        << timeDecode( all, PASSES, false ) << " ns per word" << std::endl;
+    std::cout << "tsicdecode: trace words, table " << timeDecode( trace, tracePasses, true ) << " ns, arithmetic "
+        << timeDecode( trace, tracePasses, false ) << " ns per word" << std::endl;
+
+    return Check::result( "tsicdecode" );
+}
@@ -0,0 +1,128 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// Watchdog heartbeat overhead and stall detection: the cost of a check-in,
+// and its share of a core at the rates of the monitored loops; then how
+// long after the deadline a stalled critical loop calls the failsafes, and
+// that a stalled loop which is not critical calls none.
+//
+//-----------------------------------------------------------------------------
+
+#include <atomic>
+#include <iostream>
+
+#include "check.h"
+
+#include "watchdog.h"
+#include "timing.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// check-ins per timed run
+static const unsigned CHECK_INS = 10000000;
+
+/// rates of the monitored loops (Hz): gaggia, display, flow, regulator
+static const double LOOP_RATES[] = { 40.0, 100.0, 10.0, 10.0 };
+
+/// deadline of the stalled loops (s)
+static const double STALL_DEADLINE = 0.5;
+
+/// length of the stalls (s)
+static const double STALL_TIME = 1.0;
+
+//-----------------------------------------------------------------------------
+
+/// Time of one check-in (ns)
+static double timeCheckIn( Watchdog& watchdog ) {
+    const int loop = watchdog.add( "bench", 10.0 );
+    if ( !CHECK( loop >= 0 ) ) {
+        return 0.0;
+    }
+
+    const double start = getClock();
+    for ( unsigned count = 0; count < CHECK_INS; ++count ) {
+        watchdog.checkIn( loop );
+    }
+    const double elapsed = getClock() - start;
+
+    watchdog.remove( loop );
+    return 1.0E9 * elapsed / CHECK_INS;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Stall a loop for STALL_TIME; returns the time from the deadline to the
+/// first failsafe call (s), or a negative value if none was called
+static double stall( Watchdog& watchdog, bool critical ) {
+    std::atomic<double> called( 0.0 );
+    const int failsafe = watchdog.addFailsafe( [&called] {
+        if ( called.load() == 0.0 ) {
+            called.store( getClock() );
+        }
+    } );
+
+    const int loop = watchdog.add( critical ? "critical" : "uncritical", STALL_DEADLINE, critical );
+    watchdog.checkIn( loop );
+    const double deadline = getClock() + STALL_DEADLINE;
+
+    delayms( static_cast<unsigned>( 1000 * STALL_TIME ) );
+
+    watchdog.checkIn( loop );
+    delayms( 200 );
+
+    watchdog.remove( loop );
+    watchdog.removeFailsafe( failsafe );
+
+    return ( called.load() > 0.0 ) ? called.load() - deadline : -1.0;
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    Singleton<Logger>::initialize( new Logger() );
+    Singleton<Logger>::reference().enableConsoleLog( Log::LS_Critical );
+
+    {
+        Watchdog watchdog;
+        CHECK( watchdog.ready() );
+
+        const double checkIn = timeCheckIn( watchdog );
+
+        double rate = 0.0;
+        for ( double loopRate : LOOP_RATES ) {
+            rate += loopRate;
+        }
+
+        std::cout << "watchdog: check-in " << checkIn << " ns, " << 100.0 * checkIn * 1.0E-9 * rate
+            << "% of a core at " << rate << " check-ins/s" << std::endl;
+
+        // the stall of the display loop must not switch anything off
+        const double uncritical = stall( watchdog, false );
+        CHECK( uncritical < 0.0 );
+
+        std::string name;
+        CHECK( !watchdog.getTrip( name ) );
+
+        const double critical = stall( watchdog, true );
+        CHECK( critical >= 0.0 );
+        CHECK( watchdog.getTrip( name ) && name == "critical" );
+
+        std::cout << "watchdog: failsafe " << 1.0E3 * critical << " ms after a " << STALL_DEADLINE
+            << " s deadline, none for a loop that is not critical" << std::endl;
+
+        CHECK( watchdog.getStallCount() == 2 );
+    }
+
+    const int result = Check::result( "watchdog" );
+    Singleton<Logger>::deinitialize();
+    return result;
+}
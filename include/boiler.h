@@ -11,6 +11,8 @@
 #define __BOILER_H__
 
 #include <stdlib.h>
+#include <mutex>
+#include <thread>
 
 //-----------------------------------------------------------------------------
 
@@ -21,7 +23,20 @@ class GPIOPin;
 
 class Boiler {
 public:
-    Boiler();
+    /// How the power level is turned into heater switching
+    struct Mode {
+        enum Value {
+            PWM,        ///< pigpiod software PWM
+            HalfCycle   ///< mains half-cycles (zero-cross SSR); the gate is
+                        ///< switched from a sleeping thread through the
+                        ///< command queue, not at the zero crossings, so
+                        ///< the SSR rounds each switch to a whole
+                        ///< half-cycle and the count per second is
+                        ///< approximate and jitters
+        };
+    };
+
+    Boiler( Mode::Value mode = Mode::PWM, unsigned mainsFrequency = 50 );
     ~Boiler();
     
     bool ready() const;
@@ -29,17 +44,40 @@ public:
     // Set current power level (0..1)
     void setPower( double value );
     double getPower() const;
+
+    /// Switch the boiler off and ignore setPower until resetTrip is called;
+    /// the write is sent before it returns. Safe to call from any thread
+    void trip();
+    bool tripped() const;
+    void resetTrip();
     
 private:
     void _open();
     void _close();
+    void _worker();
 
     bool _opened;
+    Mode::Value _mode;
     
     size_t _pwmRange;
     size_t _pwmFrequency;
     double _pwmCurrentPower;
+    bool   _tripped;
+
+    // Half-cycle mode: length of a mains half-cycle (s), current state of
+    // the SSR input and the sigma-delta error (delivered minus requested
+    // half-cycles, clamped to plus or minus one so a late wake-up is not
+    // made up afterwards)
+    double _halfCycle;
+    bool   _gateOn;
+    double _error;
+
+    bool _run;
+    std::thread _thread;
+    int _watchdog; ///< watchdog handle of the half-cycle worker, or -1
     
+    mutable std::mutex _mutex;
+
     GPIOPin* _gpioPin;
 };
 
@@ -0,0 +1,106 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __BOILERMODEL_H__
+#define __BOILERMODEL_H__
+
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <thread>
+#include <mutex>
+
+//-----------------------------------------------------------------------------
+
+// Forward decls
+class Boiler;
+class TSIC;
+
+//-----------------------------------------------------------------------------
+
+/// Online estimate of a first order plus dead time boiler model
+///
+///   dT/dt = heaterGain * drive( t - deadTime ) - lossCoefficient * ( T - ambient )
+///
+/// fitted once a second from the boiler drive and the TSIC slope by
+/// recursive least squares. The ambient temperature is given; the boiler sits
+/// near one temperature most of the time, so it cannot be told apart from
+/// the loss coefficient. One estimator runs for every candidate dead time
+/// (whole seconds up to MAX_DEAD_TIME) and the one predicting best is
+/// reported, so memory and work per sample are constant. Samples taken while
+/// water flows through the boiler are not used, that heat loss is not part
+/// of the model.
+class BoilerModel {
+public:
+    /// longest dead time considered (s)
+    static const size_t MAX_DEAD_TIME = 15;
+
+    /// Current model estimate
+    struct Parameters {
+        double   heaterGain;         ///< heating rate at full drive (C/s)
+        double   lossCoefficient;    ///< heat loss rate per degree (1/s)
+        double   ambientTemperature; ///< temperature without heating (C, given)
+        double   deadTime;           ///< delay from drive to temperature (s)
+        double   timeConstant;       ///< 1 / lossCoefficient (s)
+        double   confidence;         ///< 0 (unknown) .. 1 (well determined
+                                     ///< and explaining the slope well)
+        unsigned samples;            ///< samples used so far
+        bool     valid;              ///< enough samples and physical values
+    };
+
+    BoilerModel( Boiler* boiler, TSIC* tsic, double ambientTemperature );
+    ~BoilerModel();
+
+    bool ready() const;
+
+    /// Copy the current estimate, returns its valid flag
+    bool getParameters( Parameters& parameters ) const;
+
+    /// Forget everything learned (e.g. after descaling)
+    void reset();
+
+    /// Pause learning while water flows into the boiler
+    void setFlow( bool flowing );
+
+private:
+    void _open();
+    void _close();
+    void _worker();
+    void _update( double drive, double temperature, double slope );
+
+    /// Recursive least squares estimator for one dead time
+    struct Estimator {
+        double theta[2];   ///< heaterGain, lossCoefficient
+        double p[2][2];    ///< parameter covariance (scaled)
+        double error;      ///< filtered squared prediction error
+    };
+
+    void _resetEstimators();
+
+    Boiler* _boiler;
+    TSIC*   _tsic;
+    double  _ambient;   ///< ambient temperature (C)
+    bool    _opened;
+    bool    _flowing;   ///< water is flowing, samples are not used
+
+    Estimator _estimators[MAX_DEAD_TIME + 1];
+    double    _drives[MAX_DEAD_TIME + 1]; ///< drive of the last seconds (ring)
+    size_t    _head;                      ///< index of the newest drive
+    unsigned  _samples;                   ///< samples seen since reset
+    double    _slopeMean;                 ///< filtered mean of the slope
+    double    _slopeVariance;             ///< filtered variance of the slope
+
+    bool _run;
+    std::thread _thread;
+    mutable std::mutex _mutex;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __BOILERMODEL_H__
@@ -0,0 +1,161 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __COMMANDQUEUE_H__
+#define __COMMANDQUEUE_H__
+
+//-----------------------------------------------------------------------------
+
+#include <inttypes.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "gpiobackend.h"
+
+//-----------------------------------------------------------------------------
+
+/// Command layer in front of a GPIOBackend (which it owns), keeping the
+/// number of round trips to pigpiod down; the local backend is used
+/// without it:
+///
+/// - a level or PWM duty a pin already has is not sent again
+/// - writes to pins set asynchronous are queued and return at once; a
+///   worker sends them in order, consecutive levels of different pins
+///   together as one clear and one set of bank 1
+/// - readBank1 reads all pins in one call
+///
+/// Commands on a pin wait for its queued writes, and for a write sent again
+/// after writeNow overtook it, so the order per pin is kept. Every command
+/// is counted and timed.
+class CommandQueue : public GPIOBackend {
+public:
+    /// Command groups counted
+    struct Command {
+        enum Value {
+            Mode,       ///< mode and pull resistor
+            Read,
+            Write,
+            PWMDuty,
+            PWMSetup,   ///< PWM range and frequency
+            Edge,       ///< callbacks, edge filters and waiting for edges
+            Tick,
+            Notify,
+            Bank,       ///< bank reads
+            Count
+        };
+    };
+
+    /// Counters of one command group
+    struct Statistics {
+        uint64_t calls;      ///< commands asked for
+        uint64_t coalesced;  ///< commands not sent, the pin had the value
+        uint64_t roundTrips; ///< calls to the backend
+        double   latency;    ///< total time of the calls (s)
+        double   maxLatency; ///< longest call (s)
+    };
+
+    CommandQueue( GPIOBackend* backend );
+    ~CommandQueue();
+
+    /// Queue the writes to pin instead of waiting for them
+    void setAsync( unsigned pin, bool async );
+
+    /// Wait until all queued writes are sent
+    void flush();
+
+    /// Write a level or PWM duty to pin at once, ahead of the queue: writes
+    /// to the pin still queued are dropped, and one the worker has in
+    /// flight is sent again afterwards with this value. Waits neither for
+    /// the worker nor for other pins, for switching a heater off.
+    int writeNow( unsigned pin, unsigned level );
+    int setPWMDutyNow( unsigned pin, unsigned duty );
+
+    void getStatistics( Command::Value command, Statistics& statistics ) const;
+
+    int start();
+    void stop();
+    const char* name() const;
+
+    int setMode( unsigned pin, unsigned mode );
+    int setPullUpDown( unsigned pin, unsigned pull );
+    int read( unsigned pin );
+    int write( unsigned pin, unsigned level );
+
+    uint32_t readBank1();
+    int clearBank1( uint32_t bits );
+    int setBank1( uint32_t bits );
+
+    int setPWMDuty( unsigned pin, unsigned duty );
+    int setPWMRange( unsigned pin, unsigned range );
+    int getPWMRealRange( unsigned pin );
+    int setPWMFrequency( unsigned pin, unsigned frequency );
+    int getPWMFrequency( unsigned pin );
+
+    int callback( unsigned pin, unsigned edge, EdgeCallback edgeCallback, void* userData );
+    void cancelCallback( int id );
+    bool waitForEdge( unsigned pin, unsigned edge, double seconds );
+    int setGlitchFilter( unsigned pin, unsigned steady );
+    int setNoiseFilter( unsigned pin, unsigned steady, unsigned active );
+    uint32_t getTick();
+
+    int notifyOpen();
+    int notifyBegin( unsigned handle, uint32_t bits );
+    int notifyPause( unsigned handle );
+    int notifyClose( unsigned handle );
+    std::string notifyPath( unsigned handle ) const;
+
+private:
+    /// number of pins with cached values (bank 1)
+    static const unsigned MAX_PINS = 32;
+
+    /// value of a pin not known
+    static const int UNKNOWN = -1;
+
+    /// Queued write
+    struct Entry {
+        unsigned pin;
+        bool     duty;   ///< PWM duty, else level
+        unsigned value;
+    };
+
+    void _worker();
+    void _send( const std::vector<Entry>& entries );
+    void _sendLevels( uint32_t setBits, uint32_t clearBits );
+    void _waitPin( std::unique_lock<std::mutex>& lock, unsigned pin );
+    void _overtake( unsigned pin );
+    void _replay( std::vector<Entry>& replays );
+    void _forget( unsigned pin );
+    void _record( Command::Value command, double start );
+    void _count( Command::Value command, bool coalesced );
+
+    GPIOBackend* _backend;
+    double       _started;            ///< time of start (s)
+
+    int      _level[MAX_PINS];        ///< last level asked for, or UNKNOWN
+    int      _duty[MAX_PINS];         ///< last duty asked for, or UNKNOWN
+    bool     _async[MAX_PINS];        ///< writes are queued
+    unsigned _pending[MAX_PINS];      ///< queued writes not sent yet
+    bool     _overtaken[MAX_PINS];    ///< written at once while in flight
+
+    std::vector<Entry> _queue;
+    Statistics         _statistics[Command::Count];
+
+    bool _run;
+    int  _watchdog;                   ///< watchdog handle of the worker, or -1
+    std::thread _thread;
+    mutable std::mutex _mutex;
+    std::condition_variable _queued;  ///< entries were queued
+    std::condition_variable _sent;    ///< queued entries were sent
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __COMMANDQUEUE_H__
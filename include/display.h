@@ -115,6 +115,7 @@ private:
 
     bool _run;
     std::thread* _thread;
+    int _watchdog; ///< watchdog handle of the worker, or -1
     std::mutex* _mutex;
 };
 
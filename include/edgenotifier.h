@@ -0,0 +1,89 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __EDGENOTIFIER_H__
+#define __EDGENOTIFIER_H__
+
+//-----------------------------------------------------------------------------
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <thread>
+#include <mutex>
+
+#include "pigpiomgr.h"
+
+//-----------------------------------------------------------------------------
+
+/// Edge capture through a pigpio notification pipe, an alternative to one
+/// callback per pin. pigpio writes a level report of all GPIOs of bank
+/// 1 to the pipe whenever a monitored pin changes; the worker reads them in
+/// batches and, with one lock per batch, hands the edges of each pin to its
+/// function. GPIOPin uses it for edge functions while it is initialized.
+class EdgeNotifier {
+public:
+    /// Counters of the reports and edges handled
+    struct Statistics {
+        uint64_t reads;    ///< reads from the pipe
+        uint64_t reports;  ///< level reports read
+        uint64_t edges;    ///< edges handed to edge functions
+        uint64_t gaps;     ///< reports lost (sequence number jumps)
+    };
+
+    /// number of pins that can be monitored (bank 1)
+    static const unsigned MAX_PINS = 32;
+
+    EdgeNotifier();
+    ~EdgeNotifier();
+
+    bool ready() const;
+
+    /// Monitor a pin, calling edgeCallback for the edges selected by edge
+    /// (RISING_EDGE, FALLING_EDGE or EITHER_EDGE), as a backend callback
+    bool add( unsigned pin, unsigned edge, GPIOBackend::EdgeCallback edgeCallback, void* userData );
+
+    /// Stop monitoring a pin; no edge function runs after it returns
+    void remove( unsigned pin );
+
+    void getStatistics( Statistics& statistics ) const;
+
+private:
+    void _open();
+    void _close();
+    void _worker();
+    bool _begin();
+    void _dispatch( const gpioReport_t* reports, size_t count );
+
+    /// Monitored pin
+    struct Pin {
+        GPIOBackend::EdgeCallback edgeCallback;
+        void*    userData;
+        unsigned edge;
+    };
+
+    bool     _opened;
+    GPIOBackend* _backend; ///< GPIO access, from PIGPIOManager
+    int      _handle;      ///< notification handle
+    int      _pipe;        ///< file descriptor of /dev/pigpio<handle>
+    uint32_t _bits;        ///< monitored pins
+    uint32_t _level;       ///< levels of the last report
+    uint16_t _sequence;    ///< sequence number expected next
+    bool     _started;     ///< a report has been seen
+
+    Pin        _pins[MAX_PINS];
+    Statistics _statistics;
+
+    bool _run;
+    std::thread _thread;
+    mutable std::mutex _mutex;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __EDGENOTIFIER_H__
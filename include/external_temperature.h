@@ -10,9 +10,46 @@
 #ifndef __EXTERNAL_TEMPERATURE_H__
 #define __EXTERNAL_TEMPERATURE_H__
 
+//-----------------------------------------------------------------------------
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <mutex>
+
+//-----------------------------------------------------------------------------
+
+/// DS18B20 on the 1-wire bus (w1-gpio / w1-therm kernel modules), e.g. in
+/// the brew water or on the group head. A conversion takes about 750ms, so
+/// the sensor is read by a worker thread and the latest reading is kept.
 class ExternalTemperature {
+public:
+    ExternalTemperature();
+    ~ExternalTemperature();
+
+    bool ready() const;
 
+    /// Most recent reading (C), false if the last read failed
+    bool getDegrees( double& degrees ) const;
 
-}; // ExternalTemperatureSensors
+private:
+    void _open();
+    void _close();
+    void _worker();
+
+    static std::string _findSensorPath();
+    static bool _readDegrees( const std::string& path, double& degrees );
+
+    bool _opened;
+    std::string _path;
+    double _degrees;
+    bool _valid;
+
+    std::atomic<bool> _run; ///< worker keeps running, cleared by _close
+    std::thread _thread;
+    mutable std::mutex _mutex;
+}; // ExternalTemperature
+
+//-----------------------------------------------------------------------------
 
 #endif // __EXTERNAL_TEMPERATURE_H__
@@ -31,7 +31,9 @@ public:
         };
     };
 
-    Flow();
+    /// glitchFilter: level changes of the flow pin shorter than this are
+    /// ignored (us, 0 = off)
+    Flow( unsigned glitchFilter = 0 );
     ~Flow();
 
     bool ready() const;
@@ -49,6 +51,7 @@ private:
     void _alertFunction( unsigned pin, bool level, unsigned tick );
 
     GPIOPin* _flowPin;
+    unsigned _glitchFilter; ///< glitch filter of the flow pin (us)
     bool _opened;
     State::Value _state;
 
@@ -63,6 +66,7 @@ private:
 
     bool _run;
     std::thread _thread;
+    int _watchdog; ///< watchdog handle of the worker, or -1
     mutable std::mutex _mutex;
 };
 
@@ -19,6 +19,11 @@
 #include <string>
 #include <vector>
 
+#include "boilermodel.h"
+#include "overtemperature.h"
+#include "powerbudget.h"
+#include "pid.h"
+
 //-----------------------------------------------------------------------------
 // Forward decls
 
@@ -28,6 +33,7 @@ class Boiler;
 class Pump;
 class Regulator;
 class Ranger;
+class ExternalTemperature;
 
 class Timer;
 
@@ -48,6 +54,24 @@ public:
         };
     };
 
+    /// TSIC sensors, in the order they are passed to the TSIC class
+    struct TemperatureSensor {
+        enum Value {
+            Boiler,            // Boiler (required, used by the regulator)
+            GroupHead,         // Group head (optional)
+            SteamWand          // Steam wand (optional)
+        };
+    };
+
+    /// Temperature regulated by the cascade outer loop while brewing
+    struct CascadeSource {
+        enum Value {
+            Off,               // Boiler target from the settings
+            GroupHead,         // Group head TSIC
+            External           // DS18B20, e.g. in the brew water
+        };
+    };
+
     Gaggia( bool activeHeating = true, bool logging = false );
     ~Gaggia();
     
@@ -56,6 +80,17 @@ public:
 
     double getBoilerTemperature() const;
     double getBoilerTargetTemperature() const;
+
+    /// Filtered boiler temperature and the one expected at the next
+    /// regulator step, false while the regulator has no estimate
+    bool getBoilerEstimate( double& temperature, double& predicted ) const;
+
+    /// Latest reading of any TSIC sensor, false if it is missing, switched
+    /// off in the settings or invalid
+    bool getTemperature( TemperatureSensor::Value sensor, double& value ) const;
+
+    /// Latest reading of the cascade source, false if cascade is off
+    bool getCascadeTemperature( double& value ) const;
     
     double getWaterTankLevel() const;
     
@@ -76,6 +111,28 @@ public:
 
     void setSteamMode( bool steam );
     bool getSteamMode() const;
+
+    /// Run a relay autotune at the brew (or steam) target temperature; the
+    /// gains found are stored in the settings when it finishes
+    void startAutotune( bool steam );
+    bool getAutotuneRunning() const;
+
+    /// Boiler model learned while running, returns its valid flag
+    bool getBoilerModel( BoilerModel::Parameters& parameters ) const;
+
+    /// Latched over-temperature trip, false if the cutoff has not tripped
+    bool getOverTemperatureTrip( OverTemperature::Trip& trip ) const;
+
+    /// Release the over-temperature trip once the boiler has cooled down;
+    /// the okay button shown on the main screen while tripped calls it
+    bool resetOverTemperature();
+
+    /// Name of the stalled thread if the watchdog switched the heater and
+    /// the pump off, false otherwise; latched until the application restarts
+    bool getWatchdogTrip( std::string& thread ) const;
+
+    /// Peak power and deferred heating of the last shot, false if none
+    bool getShotPowerReport( PowerBudget::Report& report ) const;
       
 private:
     void _initialize( bool activeHeating );
@@ -83,6 +140,9 @@ private:
     void _worker(); 
 
     void _setRegulatorSettings();
+    bool _getCascadeTemperature( double& value ) const;
+    bool _getTsicTemperature( TemperatureSensor::Value sensor, double& value ) const;
+    void _updateCascade( State::Value state, double dt );
 
     void _openShotLog();
     void _closeShotLog( double extractionTime );
@@ -102,14 +162,28 @@ private:
     Flow* _flowSensor;
     Ranger* _tankSensor;
     Regulator* _regulator;
+    BoilerModel* _boilerModel;
+    OverTemperature* _overTemperature;
+    PowerBudget* _powerBudget;
     TSIC* _tsicSensor;
+    int _tsicChannels[3]; // TSIC channel of each TemperatureSensor, or -1
     Boiler* _boilerController;
     Pump* _pumpController;
+    ExternalTemperature* _externalSensor;
 
     State::Value _currentState;
     State::Value _oldState;
 
     double _preHeatingTime;
+
+    bool _autotuning;      // Autotune run in progress
+    bool _autotuneSteam;   // Autotune run is for the steam gains
+
+    CascadeSource::Value _cascadeSource;
+    PID _cascade;             // Outer loop: brew temperature to boiler target
+    double _cascadeTarget;    // Brew temperature target
+    double _cascadeSetPoint;  // Boiler target set by the outer loop (0 = unset)
+    double _cascadeMaxOffset; // Highest boiler target above the brew target
     double _flowOffsetOneCup;
     double _flowOffsetTwoCups;
 
@@ -119,6 +193,8 @@ private:
 
     bool _run;
     std::thread _thread;
+    int _watchdog; // watchdog handle of the worker, or -1
+    int _failsafe; // watchdog failsafe handle, or -1
     mutable std::mutex _mutex;
     
 }; // Gaggia
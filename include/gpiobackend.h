@@ -0,0 +1,199 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __GPIOBACKEND_H__
+#define __GPIOBACKEND_H__
+
+//-----------------------------------------------------------------------------
+
+#include <inttypes.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+//-----------------------------------------------------------------------------
+
+/// Access to the GPIOs, used by GPIOPin and owned by PIGPIOManager. Return
+/// values follow pigpio: 0 or a value on success, a negative error code on
+/// failure.
+class GPIOBackend {
+public:
+    /// Edge function, level 0 or 1
+    typedef void (*EdgeCallback)( unsigned pin, unsigned level, uint32_t tick, void* userData );
+
+    virtual ~GPIOBackend();
+
+    /// Connect, returns the pigpio version or PI_INIT_FAILED
+    virtual int start() = 0;
+    virtual void stop() = 0;
+
+    /// Short name for the log
+    virtual const char* name() const = 0;
+
+    virtual int setMode( unsigned pin, unsigned mode ) = 0;
+    virtual int setPullUpDown( unsigned pin, unsigned pull ) = 0;
+    virtual int read( unsigned pin ) = 0;
+    virtual int write( unsigned pin, unsigned level ) = 0;
+
+    /// Levels of GPIO 0-31 in one call, and setting/clearing several
+    /// outputs at once
+    virtual uint32_t readBank1() = 0;
+    virtual int clearBank1( uint32_t bits ) = 0;
+    virtual int setBank1( uint32_t bits ) = 0;
+
+    virtual int setPWMDuty( unsigned pin, unsigned duty ) = 0;
+    virtual int setPWMRange( unsigned pin, unsigned range ) = 0;
+    virtual int getPWMRealRange( unsigned pin ) = 0;
+    virtual int setPWMFrequency( unsigned pin, unsigned frequency ) = 0;
+    virtual int getPWMFrequency( unsigned pin ) = 0;
+
+    /// Call edgeCallback for the given edges of pin, returns an identifier
+    /// for cancelCallback or a negative error code
+    virtual int callback( unsigned pin, unsigned edge, EdgeCallback edgeCallback, void* userData ) = 0;
+    virtual void cancelCallback( int id ) = 0;
+
+    /// Wait for an edge, true if it came before the timeout
+    virtual bool waitForEdge( unsigned pin, unsigned edge, double seconds ) = 0;
+
+    /// Report level changes only once stable for steady us (0 = off)
+    virtual int setGlitchFilter( unsigned pin, unsigned steady ) = 0;
+
+    /// After steady us without a change report changes for active us,
+    /// then wait again (0 = off)
+    virtual int setNoiseFilter( unsigned pin, unsigned steady, unsigned active ) = 0;
+
+    /// Current tick (us, wraps around)
+    virtual uint32_t getTick() = 0;
+
+    /// Notification pipe of a handle, see EdgeNotifier
+    virtual int notifyOpen() = 0;
+    virtual int notifyBegin( unsigned handle, uint32_t bits ) = 0;
+    virtual int notifyPause( unsigned handle ) = 0;
+    virtual int notifyClose( unsigned handle ) = 0;
+
+    /// Path of the pipe the reports of handle are read from
+    virtual std::string notifyPath( unsigned handle ) const = 0;
+};
+
+//-----------------------------------------------------------------------------
+
+#ifndef GPIO_LOCAL
+
+/// Client of the pigpiod daemon (pigpiod_if), every call is a round trip
+/// over its socket
+class DaemonBackend : public GPIOBackend {
+public:
+    int start();
+    void stop();
+    const char* name() const;
+
+    int setMode( unsigned pin, unsigned mode );
+    int setPullUpDown( unsigned pin, unsigned pull );
+    int read( unsigned pin );
+    int write( unsigned pin, unsigned level );
+
+    uint32_t readBank1();
+    int clearBank1( uint32_t bits );
+    int setBank1( uint32_t bits );
+
+    int setPWMDuty( unsigned pin, unsigned duty );
+    int setPWMRange( unsigned pin, unsigned range );
+    int getPWMRealRange( unsigned pin );
+    int setPWMFrequency( unsigned pin, unsigned frequency );
+    int getPWMFrequency( unsigned pin );
+
+    int callback( unsigned pin, unsigned edge, EdgeCallback edgeCallback, void* userData );
+    void cancelCallback( int id );
+    bool waitForEdge( unsigned pin, unsigned edge, double seconds );
+    int setGlitchFilter( unsigned pin, unsigned steady );
+    int setNoiseFilter( unsigned pin, unsigned steady, unsigned active );
+    uint32_t getTick();
+
+    int notifyOpen();
+    int notifyBegin( unsigned handle, uint32_t bits );
+    int notifyPause( unsigned handle );
+    int notifyClose( unsigned handle );
+    std::string notifyPath( unsigned handle ) const;
+};
+
+#else // GPIO_LOCAL
+
+/// The pigpio library in this process (gpioInitialise), accessing the GPIO
+/// registers directly. Needs root and pigpiod must not be running.
+class LocalBackend : public GPIOBackend {
+public:
+    LocalBackend();
+
+    int start();
+    void stop();
+    const char* name() const;
+
+    int setMode( unsigned pin, unsigned mode );
+    int setPullUpDown( unsigned pin, unsigned pull );
+    int read( unsigned pin );
+    int write( unsigned pin, unsigned level );
+
+    uint32_t readBank1();
+    int clearBank1( uint32_t bits );
+    int setBank1( uint32_t bits );
+
+    int setPWMDuty( unsigned pin, unsigned duty );
+    int setPWMRange( unsigned pin, unsigned range );
+    int getPWMRealRange( unsigned pin );
+    int setPWMFrequency( unsigned pin, unsigned frequency );
+    int getPWMFrequency( unsigned pin );
+
+    int callback( unsigned pin, unsigned edge, EdgeCallback edgeCallback, void* userData );
+    void cancelCallback( int id );
+    bool waitForEdge( unsigned pin, unsigned edge, double seconds );
+    int setGlitchFilter( unsigned pin, unsigned steady );
+    int setNoiseFilter( unsigned pin, unsigned steady, unsigned active );
+    uint32_t getTick();
+
+    int notifyOpen();
+    int notifyBegin( unsigned handle, uint32_t bits );
+    int notifyPause( unsigned handle );
+    int notifyClose( unsigned handle );
+    std::string notifyPath( unsigned handle ) const;
+
+private:
+    /// number of user GPIOs
+    static const unsigned MAX_PINS = 32;
+
+    /// Edge function of a pin; the library alert has no edge selection
+    /// and one function per pin, the identifier is the pin number. Threads
+    /// in waitForEdge share the alert, it counts the edges for them.
+    struct Alert {
+        LocalBackend*         backend;
+        EdgeCallback          edgeCallback;
+        void*                 userData;
+        unsigned              edge;
+        std::atomic<unsigned> waiters;  ///< threads in waitForEdge
+        unsigned              rising;   ///< rising edges seen while waited for
+        unsigned              falling;  ///< falling edges seen while waited for
+    };
+
+    static void _alert( int pin, int level, uint32_t tick, void* userData );
+
+    /// Install the alert of pin if it has a callback or waiters, remove it
+    /// otherwise; called with _waitMutex held
+    int _updateAlert( unsigned pin );
+
+    Alert _alerts[MAX_PINS];
+
+    std::mutex _waitMutex;
+    std::condition_variable _edgeArrived;
+};
+
+#endif // GPIO_LOCAL
+
+//-----------------------------------------------------------------------------
+
+#endif // __GPIOBACKEND_H__
@@ -13,6 +13,9 @@
 //-----------------------------------------------------------------------------
 
 #include <functional>
+#include <atomic>
+#include <mutex>
+#include <utility>
 
 #include "pigpiomgr.h"
 
@@ -30,9 +33,19 @@ public:
         Both    = EITHER_EDGE
     };
 
+    /// Supported pull resistor settings
+    enum Pull {
+        PullOff  = PI_PUD_OFF,
+        PullDown = PI_PUD_DOWN,
+        PullUp   = PI_PUD_UP
+    };
+
     /// Set the pin to be an output (true) or input (false)
     bool setOutput( bool output );
 
+    /// Set the internal pull up/down resistor of the pin
+    bool setPullUpDown( Pull pull );
+
     /// Set the pin state
     bool setState( bool state );
 
@@ -45,9 +58,23 @@ public:
     /// Set PWM frequency on a pin (nearest match is used)
     bool setPWMFrequency( unsigned frequency );
 
+    /// PWM frequency and real range in use (0 on failure)
+    unsigned getPWMFrequency() const;
+    unsigned getPWMRange() const;
+
     /// Get the pin state
     bool getState() const;
 
+    /// Queue writes to the pin (setState, setPWMDuty) instead of waiting
+    /// for pigpiod; other commands on the pin still wait for them. Has no
+    /// effect on the local backend, which is not queued
+    void setAsync( bool async );
+
+    /// Set the pin state or PWM duty at once, ahead of the writes queued
+    /// for the pin, which are dropped
+    bool setStateNow( bool state );
+    bool setPWMDutyNow( unsigned int duty );
+
     /// Pulse high or low for specified number of microseconds
     bool usPulse( bool state, unsigned us );
 
@@ -67,9 +94,42 @@ public:
     /// Set edge notification
     bool edgeFuncRegister( EdgeFunc edgeFunc );
 
+    /// Set edge notification to a member function bound at compile time,
+    /// e.g. edgeMethodRegister<Flow, &Flow::_alertFunction>( this ); pigpio
+    /// calls a trampoline that filters the edge and calls the member
+    /// directly, with no std::function in between
+    template <class T, void (T::*Method)( unsigned pin, bool level, unsigned tick )>
+    bool edgeMethodRegister( T* object );
+
     /// Cancel edge notification
     void edgeFuncCancel();
 
+    /// Report level changes only once stable for steady us (pigpio glitch
+    /// filter, 0 = off); false if the backend has none
+    bool setGlitchFilter( unsigned steady );
+
+    /// pigpio noise filter: after steady us without a change, report
+    /// changes for active us, then wait again (0 = off)
+    bool setNoiseFilter( unsigned steady, unsigned active );
+
+    /// Software filter (0 = off): each edge is held until the next one
+    /// shows the pulse it started lasted at least us, a shorter pulse is
+    /// dropped with both its edges. Edges keep their ticks but arrive one
+    /// edge late, the last of a burst only with the next burst unless
+    /// flushEdge passes it on. With Both edges, an edge repeating the level
+    /// of the one before is dropped too. False while an edge function is
+    /// registered, the filter is only changed before
+    bool setMinimumPulse( unsigned us );
+
+    /// Pass the edge held by the software filter on to the edge function
+    /// once the minimum pulse has passed without a further edge, e.g. from
+    /// a worker polling the pin; the edge function is then called on this
+    /// thread. True if an edge was passed on
+    bool flushEdge();
+
+    /// Edges passed to the edge function and dropped by the software filter
+    void getEdgeCounts( unsigned& accepted, unsigned& rejected ) const;
+
     /// Poll the pin with timeout
     bool poll( unsigned timeout );
 
@@ -87,6 +147,26 @@ private:
     /// Called when an edge event is received
     void _callback( unsigned pin, bool level, unsigned tick );
 
+    /// Register a backend callback, through the EdgeNotifier if it runs
+    bool _edgeRegister( GPIOBackend::EdgeCallback edgeCallback, void* userData );
+
+    /// Software filter and edge counters, on the callback thread: true if
+    /// an edge is passed on, level and tick are then replaced by the held
+    /// edge's
+    bool _accept( bool& level, uint32_t& tick );
+
+    /// Call of the registered edge function or method, for flushEdge
+    typedef void (*EdgeDeliver)( GPIOPin* self, bool level, unsigned tick );
+
+    /// Trampoline of edgeMethodRegister
+    template <class T, void (T::*Method)( unsigned pin, bool level, unsigned tick )>
+    static void _methodCallback( unsigned pin, unsigned level, uint32_t tick, void* userData );
+
+    /// Edge deliveries of edgeMethodRegister and edgeFuncRegister
+    template <class T, void (T::*Method)( unsigned pin, bool level, unsigned tick )>
+    static void _methodDeliver( GPIOPin* self, bool level, unsigned tick );
+    static void _funcDeliver( GPIOPin* self, bool level, unsigned tick );
+
 private:
     unsigned _pin;         ///< GPIO pin number
     bool     _opened;      ///< Successfully opened
@@ -96,8 +176,103 @@ private:
 
     EdgeFunc _edgeFunc;    ///< Edge function
     int      _callbackId;  ///< Callback function identifier
+    bool     _notified;    ///< Edges come from the EdgeNotifier
+
+    GPIOBackend* _backend; ///< GPIO access, from PIGPIOManager
+    void*    _edgeObject;  ///< Object of edgeMethodRegister
+    EdgeDeliver _deliver;  ///< Delivery of the edge function, for flushEdge
+
+    /// The software filter's state below is used with _filterMutex held,
+    /// by the callback thread and flushEdge; _minimumPulse only changes
+    /// while no edge function is registered
+    unsigned _minimumPulse;   ///< Software filter (us, 0 = off)
+    bool     _filterStarted;  ///< An edge has been passed on
+    bool     _lastLevel;      ///< Level of the last edge passed on
+    bool     _held;           ///< An edge waits for the next one
+    bool     _heldLevel;      ///< Level of the held edge
+    uint32_t _heldTick;       ///< Tick of the held edge
+    bool     _filtered;       ///< A pigpio filter is set
+    std::mutex _filterMutex;
+
+    std::atomic<unsigned> _accepted;  ///< Edges passed on
+    std::atomic<unsigned> _rejected;  ///< Edges dropped by the software filter
 };
 
 //-----------------------------------------------------------------------------
 
+template <class T, void (T::*Method)( unsigned pin, bool level, unsigned tick )>
+bool GPIOPin::edgeMethodRegister( T* object ) {
+    if ( !_opened || object == nullptr ) {
+        return false;
+    }
+
+    edgeFuncCancel();
+
+    _edgeObject = object;
+    _deliver    = &GPIOPin::_methodDeliver<T, Method>;
+    return _edgeRegister( &GPIOPin::_methodCallback<T, Method>, this );
+}
+
+//-----------------------------------------------------------------------------
+
+template <class T, void (T::*Method)( unsigned pin, bool level, unsigned tick )>
+void GPIOPin::_methodCallback( unsigned pin, unsigned level, uint32_t tick, void* userData ) {
+    GPIOPin* self = static_cast<GPIOPin*>( userData );
+    bool edgeLevel = ( level != 0 );
+
+    if ( self->_accept( edgeLevel, tick ) ) {
+        _methodDeliver<T, Method>( self, edgeLevel, static_cast<unsigned>( tick ) );
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+template <class T, void (T::*Method)( unsigned pin, bool level, unsigned tick )>
+void GPIOPin::_methodDeliver( GPIOPin* self, bool level, unsigned tick ) {
+    ( static_cast<T*>( self->_edgeObject )->*Method )( self->_pin, level, tick );
+}
+
+//-----------------------------------------------------------------------------
+
+inline bool GPIOPin::_accept( bool& level, uint32_t& tick ) {
+    if ( _minimumPulse == 0 ) {
+        _accepted.fetch_add( 1, std::memory_order_relaxed );
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock( _filterMutex );
+
+    // an edge was lost in between, the first of the two is kept
+    if ( _edge == Both && ( _held ? level == _heldLevel : ( _filterStarted && level == _lastLevel ) ) ) {
+        _rejected.fetch_add( 1, std::memory_order_relaxed );
+        return false;
+    }
+
+    if ( !_held ) {
+        _held      = true;
+        _heldLevel = level;
+        _heldTick  = tick;
+        return false;
+    }
+
+    // the held edge started a pulse too short to be one: neither happened
+    if ( tick - _heldTick < _minimumPulse ) {
+        _held = false;
+        _rejected.fetch_add( 2, std::memory_order_relaxed );
+        return false;
+    }
+
+    // the held edge is passed on, this one waits for the next
+    std::swap( level, _heldLevel );
+    std::swap( tick, _heldTick );
+
+    _filterStarted = true;
+    _lastLevel     = level;
+
+    _accepted.fetch_add( 1, std::memory_order_relaxed );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
 #endif // __GPIOPIN_H__
@@ -0,0 +1,75 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __KALMAN_H__
+#define __KALMAN_H__
+
+//-----------------------------------------------------------------------------
+
+/// Kalman filter estimating the boiler temperature and its rate of change
+/// from the TSIC readings and the boiler drive. The rate follows the boiler
+/// model
+///
+///   rate -> heaterGain * drive - lossCoefficient * ( T - ambient )
+///
+/// with a first order lag of the dead time, so between readings (or while
+/// they drop out) the estimate moves the way the drive makes the boiler go.
+/// Readings far off the prediction are rejected, unless several in a row
+/// are, which restarts the filter at the reading. While water flows into
+/// the boiler the model misses the heat it takes, so the process noise is
+/// raised and the readings are followed instead of rejected.
+class Kalman {
+public:
+    Kalman();
+
+    /// Boiler model: heating rate at full drive (C/s), loss per degree above
+    /// ambient (1/s), ambient temperature (C) and dead time (s)
+    void setModel( double heaterGain, double lossCoefficient, double ambientTemperature, double deadTime );
+
+    /// Forget the estimate, the next reading starts it
+    void reset();
+    bool started() const;
+
+    /// Advance the estimate by dt with the drive applied in that time (the
+    /// drive less any part compensating a known loss)
+    void predict( double drive, double dt );
+
+    /// Correct the estimate with a reading, false if it was rejected
+    bool correct( double temperature );
+
+    /// Water is flowing into the boiler (pump running or flow measured)
+    void setFlowing( bool flowing );
+
+    double getTemperature() const;
+    double getRate() const;
+
+    /// Standard deviation of the temperature estimate (C)
+    double getUncertainty() const;
+
+    /// Temperature expected dt from now at the current rate
+    double getPrediction( double dt ) const;
+
+private:
+    void _transition( double dt, double f[2][2], double& input, double& offset ) const;
+
+    double _heaterGain;
+    double _lossCoefficient;
+    double _ambient;
+    double _lagTime;
+
+    double _x[2];        ///< temperature (C) and rate (C/s)
+    double _p[2][2];     ///< covariance of the estimate
+    unsigned _rejected;  ///< readings rejected in a row
+    bool   _flowing;     ///< the process noise is raised
+    bool   _started;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __KALMAN_H__
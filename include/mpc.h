@@ -0,0 +1,125 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __MPC_H__
+#define __MPC_H__
+
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+
+//-----------------------------------------------------------------------------
+
+/// Model predictive controller for the boiler, an alternative to the PID
+/// class with the same output convention (duty cycle).
+///
+/// The boiler is modelled as
+///
+///   dT/dt = heaterGain * h - lossCoefficient * ( T - ambient ) + disturbance
+///   dh/dt = ( drive - h ) / deadTime
+///
+/// i.e. the dead time of the first order plus dead time model is taken as a
+/// first order heater lag, which needs no history of past drives. The
+/// disturbance is estimated from the prediction error of every update and
+/// gives the controller integral action against model errors.
+///
+/// Each update plans HORIZON drive moves, each held for BLOCK_TIME seconds,
+/// minimising the squared distance to the set point plus moveWeight times
+/// the squared drive changes. The drive is limited to the output range and
+/// the predicted temperature at the end of every block to the temperature
+/// limit. All prediction matrices are computed when the model or weights
+/// change; an update runs a fixed number of projected gradient iterations
+/// and one constraint pass on fixed size arrays, so its time is bounded and
+/// it does not allocate.
+class MPC {
+public:
+    /// number of planned drive moves
+    static const size_t HORIZON = 12;
+
+    /// time each planned drive is held (s)
+    static const double BLOCK_TIME;
+
+    MPC();
+
+    /// Boiler model: heating rate at full drive (C/s), loss per degree above
+    /// ambient (1/s), ambient temperature (C) and dead time (s)
+    void setModel( double heaterGain, double lossCoefficient, double ambientTemperature, double deadTime );
+
+    /// Weight of drive changes against the squared temperature error
+    void setMoveWeight( double moveWeight );
+
+    /// Limits of the output (duty) and of the predicted temperature (C)
+    void setOutputLimits( double minimum, double maximum );
+    void setTemperatureLimit( double maximum );
+
+    /// Known part of the output, added to the planned drive before limiting;
+    /// the model assumes it exactly compensates the disturbance it is for
+    void setFeedforward( double feedforward );
+
+    /// Output that reached the boiler after the last update, if a limit
+    /// outside the controller (a power budget) cut it; the model is advanced
+    /// with it, so the cut is not taken for a disturbance
+    void setAppliedOutput( double applied );
+
+    /// Forget the plan, heater state and disturbance estimate
+    void reset();
+
+    /// Next output for the position measured dt seconds after the last update
+    double update( double setPoint, double position, double dt );
+
+    /// Time taken by the last and by the slowest solve since construction (s)
+    double getLastSolveTime() const;
+    double getWorstSolveTime() const;
+
+private:
+    void _precompute();
+    void _discretize( double t, double phi[2][2], double gamma[2], double gammaD[2] ) const;
+    void _solve( double setPoint, double lower, double upper );
+    void _limitTemperature( double lower );
+    double _clamp( double value, double minimum, double maximum ) const;
+
+    // model
+    double _heaterGain;
+    double _lossCoefficient;
+    double _ambient;
+    double _lagTime;      ///< heater lag standing in for the dead time (s)
+
+    double _moveWeight;
+    double _outputMin;
+    double _outputMax;
+    double _temperatureMax;
+    double _feedforward;
+
+    // prediction, temperature at the end of block j:
+    //   T[j] = ambient + free[j][0] * ( T0 - ambient ) + free[j][1] * h0
+    //        + freeD[j] * disturbance + sum( step[j][i] * u[i], i <= j )
+    double _free[HORIZON][2];
+    double _freeD[HORIZON];
+    double _step[HORIZON][HORIZON];
+
+    // cost 0.5 u' H u + g' u, H = step' step + moveWeight * D' D
+    double _hessian[HORIZON][HORIZON];
+    double _stepSize;     ///< 1 / upper bound of the largest eigenvalue of H
+
+    // state
+    double _plan[HORIZON];    ///< planned drives, warm start of the next solve
+    double _prediction[HORIZON]; ///< free response of the last solve (C)
+    double _heater;           ///< heater state h
+    double _disturbance;      ///< estimated disturbance (C/s)
+    double _lastPosition;
+    double _lastDrive;        ///< planned (model) part of the last output
+    bool   _started;
+
+    double _lastSolveTime;
+    double _worstSolveTime;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __MPC_H__
@@ -0,0 +1,91 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __OVERTEMPERATURE_H__
+#define __OVERTEMPERATURE_H__
+
+//-----------------------------------------------------------------------------
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <mutex>
+
+#include "tsic.h"
+
+//-----------------------------------------------------------------------------
+
+// Forward decls
+class Boiler;
+
+//-----------------------------------------------------------------------------
+
+/// Hard over-temperature cutoff. Every valid packet of the boiler TSIC is
+/// checked on the sensor's decoding thread, before the regulator sees it,
+/// against a temperature limit and a maximum rate of rise. On a violation
+/// the boiler is tripped: its PWM is set to zero and further drives are
+/// ignored until reset, so a stalled or misbehaving regulator thread cannot
+/// keep the heater on for more than one sensor period.
+class OverTemperature {
+public:
+    /// Cause of a trip
+    struct Reason {
+        enum Value {
+            None,
+            Temperature,
+            Rise
+        };
+    };
+
+    /// Details of the latched trip
+    struct Trip {
+        Reason::Value reason;
+        double   temperature; ///< reading that tripped (C)
+        double   slope;       ///< rate of rise at that reading (C/s)
+        uint32_t tick;        ///< pigpio time stamp of the packet (us)
+        uint32_t latency;     ///< end of the packet to PWM off sent (us)
+    };
+
+    OverTemperature( Boiler* boiler, TSIC* tsic, double limit, double maxRise );
+    ~OverTemperature();
+
+    bool ready() const;
+
+    /// True while a trip is latched
+    bool tripped() const;
+
+    /// Copy the latched trip, false if there is none
+    bool getTrip( Trip& trip ) const;
+
+    /// Release the latch, refused while the last reading is not at least
+    /// RESET_MARGIN below the limit
+    bool reset();
+
+    /// distance below the limit required to reset (C)
+    static const double RESET_MARGIN;
+
+private:
+    void _open();
+    void _close();
+    void _check( size_t sensor, const TSIC::Reading& reading, double slope, bool slopeValid );
+
+    Boiler* _boiler;
+    TSIC*   _tsic;
+    double  _limit;     ///< temperature limit (C)
+    double  _maxRise;   ///< rate of rise limit (C/s), 0 = off
+    bool    _opened;
+
+    Trip   _trip;       ///< latched trip, reason None if not tripped
+    double _latest;     ///< last checked temperature (C)
+
+    mutable std::mutex _mutex;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __OVERTEMPERATURE_H__
@@ -0,0 +1,83 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __PID_H__
+#define __PID_H__
+
+//-----------------------------------------------------------------------------
+
+/// PID controller working on the measured interval between updates. Gains
+/// are per second: the integral grows by iGain * error * dt and the
+/// derivative term is dGain * rate of change in units per second.
+///
+/// The derivative acts on the measurement (not the error, so set point
+/// changes do not kick the output) and is low-pass filtered. The integral is
+/// held in output units and wound back towards the saturated output
+/// (back-calculation), so it does not wind up while the output is limited.
+/// Changing the gains moves the difference into the integral, so the output
+/// stays continuous.
+class PID {
+public:
+    PID();
+
+    /// Set the gains, without a step in the output
+    void setGains( double pGain, double iGain, double dGain );
+
+    /// Limits of the output and of the integral part (output units)
+    void setOutputLimits( double minimum, double maximum );
+    void setIntegralLimits( double minimum, double maximum );
+
+    /// Time constant of the derivative low-pass filter (s, 0 = unfiltered)
+    void setDerivativeFilter( double timeConstant );
+
+    /// Known part of the output added before limiting (output units); it
+    /// steps the output directly and is not transferred into the integral
+    void setFeedforward( double feedforward );
+
+    /// Output that reached the actuator after the last update, if a limit
+    /// outside the controller (a power budget) cut it; the integral is
+    /// wound back by the whole difference, so the next update continues
+    /// from the applied output
+    void setAppliedOutput( double applied );
+
+    /// Forget the integral and derivative history
+    void reset();
+
+    /// Next output, differentiating the measured position
+    double update( double setPoint, double position, double dt );
+
+    /// Next output, using an externally measured rate (units per second)
+    double update( double setPoint, double position, double rate, double dt );
+
+private:
+    double _output( double error, double rate ) const;
+    double _clamp( double value, double minimum, double maximum ) const;
+
+    double _pGain;
+    double _iGain;
+    double _dGain;
+
+    double _outputMin;
+    double _outputMax;
+    double _integralMin;
+    double _integralMax;
+    double _filterTime;    ///< derivative filter time constant (s)
+    double _feedforward;   ///< output added ahead of the PID terms
+
+    double _integral;      ///< integral part of the output
+    double _rate;          ///< filtered rate of change of the position
+    double _lastPosition;  ///< position at the previous update
+    double _lastError;     ///< error at the previous update
+    double _lastOutput;    ///< limited output of the previous update
+    bool   _started;       ///< the previous values are valid
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __PID_H__
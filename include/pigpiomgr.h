@@ -19,12 +19,20 @@ extern "C" {
     #include <pigpio.h>
 }
 
+#include "gpiobackend.h"
+#include "commandqueue.h"
+
 //-----------------------------------------------------------------------------
 
-/// Singleton class to manage initialisation of PIGPIO
+/// Singleton class to manage initialisation of PIGPIO, through the pigpiod
+/// daemon or the library in this process (local)
 class PIGPIOManager {
 public:
-    PIGPIOManager();
+    PIGPIOManager( bool local = false );
+
+    /// Use the given backend (which is taken over), e.g. a stub in tests;
+    /// queued puts a command queue in front of it, as for pigpiod
+    PIGPIOManager( GPIOBackend* backend, bool queued = true );
     ~PIGPIOManager();
 
     /// Returns true if PIPGIO is available
@@ -33,8 +41,25 @@ public:
     /// Returns the PIGPIO version number
     int version() const;
 
+    /// Backend all GPIO access goes through
+    GPIOBackend* backend() const;
+
+    /// Command layer in front of the backend (the same object), nullptr
+    /// if the backend is called directly: the local library needs no
+    /// queue, its calls are register accesses
+    CommandQueue* commands() const;
+
+    /// Average time of a call to the backend measured at startup (s)
+    double getCallLatency() const;
+
 private:
-    int _version;  ///< PIGPIO version number (or PI_INIT_FAILED)
+    void _start();
+    void _measureLatency();
+
+    int           _version;     ///< PIGPIO version number (or PI_INIT_FAILED)
+    GPIOBackend*  _backend;     ///< The daemon, local or given backend
+    CommandQueue* _commands;    ///< Queue in front of it (== _backend), or nullptr
+    double        _callLatency; ///< Average time of a call (s)
 };
 
 //-----------------------------------------------------------------------------
@@ -0,0 +1,102 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __POWERBUDGET_H__
+#define __POWERBUDGET_H__
+
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <mutex>
+
+//-----------------------------------------------------------------------------
+
+// Forward decls
+class Boiler;
+class Pump;
+
+//-----------------------------------------------------------------------------
+
+/// Arbiter for the electrical load of boiler and pump. Boiler and pump
+/// commands go through it; the boiler duty is capped so that the total
+/// stays within a peak limit (averaged over one drive period, the heater
+/// itself is either on or off) while the pump runs, and within an average
+/// limit over about a minute. Heating held back by the caps is accounted as
+/// deferred energy. A shot is a period in which the pump runs; its peak
+/// power and deferred heating are reported when it ends.
+class PowerBudget {
+public:
+    /// Load of one shot (or the shot in progress)
+    struct Report {
+        double peakPower;      ///< highest total power (W)
+        double averagePower;   ///< mean total power (W)
+        double deferredEnergy; ///< heating held back by the caps (J)
+        double cappedTime;     ///< time the boiler duty was capped (s)
+        double duration;       ///< length of the shot (s)
+    };
+
+    /// Heater and pump power (W) and the limits of the total (W, 0 = none)
+    PowerBudget( Boiler* boiler, Pump* pump, double heaterPower, double pumpPower, double peakLimit, double averageLimit );
+    ~PowerBudget();
+
+    bool ready() const;
+
+    /// Requested boiler duty (0..1); the boiler gets it less any cap, the
+    /// duty it got is returned
+    double setBoilerPower( double value );
+
+    /// Switch the pump
+    void setPumpPower( bool power );
+    bool getPumpPower() const;
+
+    /// Water is flowing, i.e. the pump runs even if it was switched on at
+    /// the machine rather than through setPumpPower
+    void setFlowing( bool flowing );
+
+    /// Report of the last finished shot, false if there was none
+    bool getShotReport( Report& report ) const;
+
+    /// Heating deferred since construction (J)
+    double getDeferredEnergy() const;
+
+private:
+    void _open();
+    void _close();
+    void _apply( double now );
+    void _account( double now );
+
+    Boiler* _boiler;
+    Pump*   _pump;
+    double  _heaterPower;
+    double  _pumpPower;
+    double  _peakLimit;
+    double  _averageLimit;
+    bool    _opened;
+
+    double _requested;    ///< requested boiler duty
+    double _applied;      ///< boiler duty after the caps
+    bool   _pumpOn;       ///< pump switched on through setPumpPower
+    bool   _flowing;      ///< water is flowing
+    double _average;      ///< filtered total power (W)
+    double _lastUpdate;   ///< time of the last accounting (s)
+    double _deferred;     ///< total deferred energy (J)
+
+    bool   _inShot;
+    double _shotStart;
+    double _shotEnergy;   ///< energy used in the shot so far (J)
+    Report _shot;         ///< shot in progress
+    Report _lastShot;
+    bool   _hasLastShot;
+
+    mutable std::mutex _mutex;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __POWERBUDGET_H__
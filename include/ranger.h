@@ -37,7 +37,7 @@ private:
 
     void _worker();
     double _measureRange();
-    void _alertFunction( unsigned gpio, unsigned level, uint32_t tick );
+    void _alertFunction( unsigned pin, bool level, unsigned tick );
 
     bool _opened;
     double _timeLastRun;
@@ -51,6 +51,7 @@ private:
 
     bool _run;
     std::thread _thread;
+    int _watchdog; ///< watchdog handle of the worker, or -1
     mutable std::mutex _rangeMutex;
     mutable std::mutex _countMutex;
 };
@@ -16,16 +16,40 @@
 #include <mutex>
 #include <atomic>
 
+#include "pid.h"
+#include "mpc.h"
+#include "trajectory.h"
+#include "kalman.h"
+
 //-----------------------------------------------------------------------------
 // Forward decls
 
 class TSIC;
 class Boiler;
+class PowerBudget;
 
 //-----------------------------------------------------------------------------
 
 class Regulator {
 public:
+    /// Relay autotune progress
+    struct Autotune {
+        enum Value {
+            Idle,              // No autotune started
+            Running,           // Relay experiment in progress
+            Done,              // Finished, result available
+            Failed             // Aborted, boiler was switched off
+        };
+    };
+
+    /// Control law computing the boiler drive
+    struct Engine {
+        enum Value {
+            PID,               // PID with feedforward
+            Predictive         // Model predictive control
+        };
+    };
+
     Regulator(Boiler* boiler, TSIC* tsic);
     ~Regulator();
 
@@ -34,44 +58,167 @@ public:
     /// Set the Proportional, Integral and Derivative gains
     void setPIDGains( double pGain, double iGain, double dGain );
 
+    /// Set the target; the PID engine follows a rate and acceleration
+    /// limited profile towards it, and the time until the temperature has
+    /// settled near a changed target is measured and logged
     void setTargetTemperature( double targetTemperature );
     double getTargetTemperature() const;
 
+    /// Filtered boiler temperature (C), its rate (C/s) and the temperature
+    /// expected at the next step; false while there is no estimate
+    bool getEstimate( double& temperature, double& rate, double& prediction ) const;
+
+    /// Last finished set point transition: start and end target (C), time
+    /// until the temperature settled (s) and the overshoot past the end
+    /// target (C); false if none has settled yet
+    bool getLastTransition( double& from, double& to, double& settlingTime, double& overshoot ) const;
+
     void setPower( bool power );
     bool getPower() const;
+
+    /// Step once per TSIC packet (perSample) or on the fixed time step; in
+    /// per sample mode only every decimation'th packet is used and the
+    /// boiler is switched off if no valid packet arrives within timeout (s)
+    void setSampling( bool perSample, unsigned decimation, double timeout );
+
+    /// Heat demand model of the flow feedforward: gain (0 = off), heater
+    /// power (W), inlet water temperature (C) and the flow assumed while the
+    /// pump runs but the flow meter has not reported yet (ml/s)
+    void setFeedforwardModel( double gain, double heaterPower, double inletTemperature, double pumpFlowRate );
+
+    /// Current pump state and measured flow into the boiler (ml/s); the
+    /// boiler drive follows changes immediately, between PID updates
+    void setFlow( bool pumpOn, double flowRate );
+
+    /// Send the boiler drive through a power budget (nullptr: directly)
+    void setPowerBudget( PowerBudget* budget );
+
+    /// Select the control law; moveWeight and temperatureMargin (C above the
+    /// target) are used by the predictive engine
+    void setEngine( Engine::Value engine, double moveWeight, double temperatureMargin );
+    Engine::Value getEngine() const;
+
+    /// Boiler model of the predictive engine and of the set point profile,
+    /// see MPC::setModel
+    void setBoilerModel( double heaterGain, double lossCoefficient, double ambientTemperature, double deadTime );
+
+    /// Time of the last and of the slowest predictive engine step (s)
+    void getSolveTime( double& last, double& worst ) const;
+
+    /// Replace the PID by a relay switching the drive between amplitude and
+    /// zero around target, until the given number of oscillations has been
+    /// measured. The run fails with the boiler off if the temperature
+    /// exceeds maxTemperature, readings stop or the regulator is switched off.
+    void startAutotune( double target, double amplitude, unsigned cycles, double maxTemperature );
+    void stopAutotune();
+    Autotune::Value getAutotuneState() const;
+
+    /// Ultimate gain (duty per C) and period (s) of the last finished run and
+    /// the PID gains derived from them; false unless the run is Done
+    bool getAutotuneResult( double& ultimateGain, double& ultimatePeriod, double& iGain, double& pGain, double& dGain ) const;
     
 private:
     void _open();
     void _close();
     void _worker();
-    double _update( double error, double position, double iGain, double pGain, double dGain );
+    double _feedforward() const;
+    double _setBoilerPower( double drive );
+    double _applyFeedforward( double drive, double& applied );
+    double _relayStep( double temperature, double now );
+    void _failAutotune( const char* reason );
+    double _followTrajectory( double temperature, double dt, double& rate, double& drive );
+    void _startTransition( double from, double to, double now );
+    void _trackTransition( double temperature, double now );
 
 private:
     bool _opened;
     bool _run;
     std::thread* _thread;
+    int _watchdog; ///< watchdog handle of the worker, or -1
     std::mutex* _mutex;
 
     bool _power;
     double _timeStep;    
+
+    bool     _perSample;     ///< step on every TSIC packet instead of the clock
+    unsigned _decimation;    ///< use every n-th packet in per sample mode
+    double   _sampleTimeout; ///< longest gap between valid packets (s)
+
+    bool   _pumpOn;           ///< pump is running
+    double _flowRate;         ///< measured flow into the boiler (ml/s)
+    double _feedforwardGain;  ///< scale of the feedforward (0 = off)
+    double _heaterPower;      ///< heater power at full drive (W)
+    double _inletTemperature; ///< temperature of the incoming water (C)
+    double _pumpFlowRate;     ///< flow assumed before the meter reports (ml/s)
     
     double _latestTemp;    
     double _latestPower;
 
     TSIC* _temperature;    
     Boiler* _boiler;    
+    std::atomic<PowerBudget*> _powerBudget;
     
     double _targetTemperature;
 
-    double _dState;    
-    double _iState;    
-           
     double _iMax;    
     double _iMin;    
            
-    double _iGain;    
-    double _pGain;    
-    double _dGain;    
+    Engine::Value _engine;
+    double _temperatureMargin; ///< predictive limit above the target (C)
+
+    PID _pid;              ///< PID engine, used with the mutex held
+    MPC _mpc;              ///< predictive engine, used with the mutex held
+
+    double _modelHeaterGain;  ///< heating rate at full drive (C/s)
+    double _modelLoss;        ///< heat loss rate per degree (1/s)
+    double _modelAmbient;     ///< ambient temperature (C)
+    double _modelDeadTime;    ///< delay from drive to temperature (s)
+
+    Trajectory _trajectory; ///< set point profile, used with the mutex held
+
+    /// Set point transition being timed, used with the mutex held
+    struct Transition {
+        bool   active;       ///< waiting for the temperature to settle
+        double from;         ///< target before the change (C)
+        double to;           ///< target after the change (C)
+        double start;        ///< time of the change (s)
+        double entered;      ///< time the temperature entered the band (s, <0 outside)
+        double overshoot;    ///< largest excursion past the new target (C)
+        double settlingTime; ///< time from the change until settled (s)
+    };
+
+    Transition _transition;
+    Transition _lastTransition; ///< last settled transition (active = valid)
+
+    Kalman _kalman;        ///< temperature estimate, used with the mutex held
+    bool   _estimated;     ///< the estimate is current
+    double _stepTime;      ///< time between the last two steps (s)
+
+    /// Relay autotune experiment, used with the mutex held
+    struct Relay {
+        double   target;         ///< temperature to oscillate around (C)
+        double   amplitude;      ///< drive while the relay is on
+        double   maxTemperature; ///< abort above this temperature (C)
+        unsigned cycles;         ///< oscillations to measure
+        double   start;          ///< time the run started (s)
+        bool     on;             ///< relay is on
+        double   lastOn;         ///< time the relay last switched on (s, <0 before)
+        double   lastOff;        ///< time the relay last switched off (s)
+        double   high;           ///< highest temperature in this cycle
+        double   low;            ///< lowest temperature in this cycle
+        unsigned measured;       ///< oscillations measured so far
+        double   periodSum;      ///< sum of measured periods (s)
+        double   onSum;          ///< sum of the on times of measured periods (s)
+        double   heightSum;      ///< sum of measured half peak-to-peak heights (C)
+    };
+
+    Autotune::Value _autotuneState;
+    Relay  _relay;
+    double _ultimateGain;
+    double _ultimatePeriod;
+    double _tunedIGain;
+    double _tunedPGain;
+    double _tunedDGain;
 };
 
 //-----------------------------------------------------------------------------
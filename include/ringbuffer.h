@@ -0,0 +1,95 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors.
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __RINGBUFFER_H__
+#define __RINGBUFFER_H__
+
+//-----------------------------------------------------------------------------
+
+#include <atomic>
+#include <stdlib.h>
+#include <inttypes.h>
+
+//-----------------------------------------------------------------------------
+
+/// Lock-free single-producer/single-consumer ring buffer. Exactly one thread
+/// may push and exactly one (other) thread may pop. Capacity must be a power
+/// of two. When the buffer is full, new items are dropped and counted.
+template <typename T, size_t Capacity>
+class RingBuffer {
+public:
+    RingBuffer()
+        :_head( 0 )
+        ,_tail( 0 )
+        ,_overflows( 0 )
+        ,_highWater( 0 )
+    {
+        static_assert( ( Capacity & ( Capacity - 1 ) ) == 0, "capacity must be a power of two" );
+    }
+
+    /// Producer: append an item, returns false (and counts it) if full
+    bool push( const T& item ) {
+        const uint32_t head = _head.load( std::memory_order_relaxed );
+        const uint32_t used = head - _tail.load( std::memory_order_acquire );
+
+        if ( used >= Capacity ) {
+            _overflows.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+        }
+
+        _items[head & ( Capacity - 1 )] = item;
+        _head.store( head + 1, std::memory_order_release );
+
+        if ( used + 1 > _highWater.load( std::memory_order_relaxed ) ) {
+            _highWater.store( used + 1, std::memory_order_relaxed );
+        }
+
+        return true;
+    }
+
+    /// Consumer: remove up to count items into items, returns number removed
+    size_t pop( T* items, size_t count ) {
+        const uint32_t tail = _tail.load( std::memory_order_relaxed );
+        const uint32_t head = _head.load( std::memory_order_acquire );
+
+        size_t available = head - tail;
+        if ( available > count ) {
+            available = count;
+        }
+
+        for ( size_t index = 0; index < available; ++index ) {
+            items[index] = _items[( tail + index ) & ( Capacity - 1 )];
+        }
+
+        _tail.store( tail + available, std::memory_order_release );
+        return available;
+    }
+
+    /// Number of items dropped because the buffer was full
+    uint32_t overflows() const {
+        return _overflows.load( std::memory_order_relaxed );
+    }
+
+    /// Largest number of items that were ever waiting in the buffer
+    uint32_t highWater() const {
+        return _highWater.load( std::memory_order_relaxed );
+    }
+
+private:
+    T _items[Capacity];
+
+    std::atomic<uint32_t> _head;      ///< next slot to write (producer)
+    std::atomic<uint32_t> _tail;      ///< next slot to read (consumer)
+    std::atomic<uint32_t> _overflows; ///< items dropped while full
+    std::atomic<uint32_t> _highWater; ///< peak fill level
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __RINGBUFFER_H__
@@ -0,0 +1,67 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __SAMPLEHISTORY_H__
+#define __SAMPLEHISTORY_H__
+
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+//-----------------------------------------------------------------------------
+
+/// Fixed capacity history of time stamped fixed point samples with a
+/// smoothed slope over the most recent samples. The slope is the least
+/// squares fit over the window (the Savitzky-Golay first derivative at the
+/// window centre), updated from running integer sums in O(1) per sample.
+class SampleHistory {
+public:
+    /// Number of samples kept
+    static const size_t CAPACITY = 64;
+
+    struct Sample {
+        uint32_t tick;  ///< pigpio time stamp (us)
+        int      value; ///< fixed point value
+    };
+
+    /// Window is the number of samples used for the slope (2..CAPACITY)
+    SampleHistory( size_t window );
+
+    /// Append a sample, dropping the oldest one when full
+    void push( uint32_t tick, int value );
+
+    /// Remove all samples
+    void clear();
+
+    /// Number of samples held
+    size_t size() const;
+
+    /// Copy the newest count samples (oldest first), returns number copied
+    size_t latest( Sample* samples, size_t count ) const;
+
+    /// Slope over the window in value units per second, false until the
+    /// window is full
+    bool slope( double& perSecond ) const;
+
+private:
+    const Sample& _at( size_t age ) const;
+
+    Sample  _samples[CAPACITY];
+    size_t  _head;    ///< index of the next sample to write
+    size_t  _size;    ///< number of valid samples
+    size_t  _window;  ///< number of samples in slope fit
+
+    int64_t _sum;     ///< sum of values in window
+    int64_t _moment;  ///< sum of index * value in window (oldest has index 0)
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __SAMPLEHISTORY_H__
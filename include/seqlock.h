@@ -0,0 +1,88 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __SEQLOCK_H__
+#define __SEQLOCK_H__
+
+//-----------------------------------------------------------------------------
+
+#include <atomic>
+#include <string.h>
+#include <inttypes.h>
+
+//-----------------------------------------------------------------------------
+
+/// Sequence lock for publishing a small plain-old-data value from a single
+/// writer to any number of readers. The writer never blocks and never waits
+/// for readers; readers retry if they raced with a write. T must be safe to
+/// copy with memcpy.
+template <typename T>
+class SeqLock {
+public:
+    SeqLock()
+        :_sequence( 0 )
+    {
+        store( T() );
+    }
+
+    /// Publish a new value (must only be called from one thread)
+    void store( const T& value ) {
+        uint32_t words[WORDS] = {};
+        memcpy( words, &value, sizeof(T) );
+
+        // odd sequence number marks a write in progress
+        const uint32_t sequence = _sequence.load( std::memory_order_relaxed );
+        _sequence.store( sequence + 1, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+
+        for ( size_t index = 0; index < WORDS; ++index ) {
+            _words[index].store( words[index], std::memory_order_relaxed );
+        }
+
+        _sequence.store( sequence + 2, std::memory_order_release );
+    }
+
+    /// Read a consistent copy of the most recently published value
+    T load() const {
+        uint32_t words[WORDS];
+        uint32_t before = 0;
+        uint32_t after  = 0;
+
+        do {
+            before = _sequence.load( std::memory_order_acquire );
+
+            for ( size_t index = 0; index < WORDS; ++index ) {
+                words[index] = _words[index].load( std::memory_order_relaxed );
+            }
+
+            std::atomic_thread_fence( std::memory_order_acquire );
+            after = _sequence.load( std::memory_order_relaxed );
+        }
+        while ( ( before & 1 ) || ( before != after ) );
+
+        T value;
+        memcpy( &value, words, sizeof(T) );
+        return value;
+    }
+
+    /// Returns the number of values published so far
+    uint32_t sequence() const {
+        return _sequence.load( std::memory_order_acquire ) / 2;
+    }
+
+private:
+    static const size_t WORDS = ( sizeof(T) + sizeof(uint32_t) - 1 ) / sizeof(uint32_t);
+
+    std::atomic<uint32_t> _sequence;     ///< even when stable, odd during a write
+    std::atomic<uint32_t> _words[WORDS]; ///< published value, word by word
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __SEQLOCK_H__
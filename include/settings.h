@@ -21,6 +21,11 @@
 
 #define TSIC_PIN 15
 
+// GPIO pins used for the optional TSIC sensors on group head and steam wand,
+// when they are switched on in the settings
+#define TSIC_GROUP_PIN 17
+#define TSIC_STEAM_PIN 18
+
 // GPIO pin used for DS18B20
 #define DS_TEMP_PIN 2
 
@@ -47,16 +52,73 @@ public:
     bool ready() const;
 
     void getRegulatorSettings( bool steam, double& iGain, double& pGain, double& dGain, double& targetTemperature ) const;
+    void setRegulatorGains( bool steam, double iGain, double pGain, double dGain );
     void getPreHeatingSettings( double& time, double& temperature ) const;
+
+    /// Regulator timing: step once per TSIC packet (true) or on a fixed one
+    /// second clock, use every decimation'th packet, and switch the boiler
+    /// off when no packet arrived for sampleTimeout seconds
+    void getRegulatorTimingSettings( bool& perSample, unsigned& decimation, double& sampleTimeout ) const;
+
+    /// Heat demand model for the flow feedforward: gain (0 = off, the
+    /// default until tuned on the machine), heater power (W), temperature
+    /// of the water entering the boiler (C) and the flow assumed while the
+    /// pump runs before the flow meter reports (ml/s)
+    void getFeedforwardSettings( double& gain, double& heaterPower, double& inletTemperature, double& pumpFlowRate ) const;
+
+    /// Regulator engine: PID (false) or model predictive (true), the weight
+    /// of drive changes of the predictive engine and how far above the target
+    /// it may let the temperature rise (C)
+    void getRegulatorEngineSettings( bool& predictive, double& moveWeight, double& temperatureMargin ) const;
+
+    /// Cascade control of the brew water temperature: source (0 = off,
+    /// 1 = group head TSIC, 2 = DS18B20), its target (C), the gains of the
+    /// outer loop and how far above that target the boiler may be set (C)
+    void getCascadeSettings( int& mode, double& targetTemperature, double& pGain, double& iGain, double& maxOffset ) const;
+
+    /// Hard over-temperature cutoff: boiler temperature (C) and rate of rise
+    /// (C/s, 0 = off) at which the boiler is switched off until reset
+    void getOverTemperatureSettings( double& limit, double& maxRise ) const;
+
+    /// Feed the Linux hardware watchdog while all worker threads run
+    bool getHardwareWatchdog() const;
+
+    /// Boiler drive: software PWM (false) or mains half-cycles (true)
+    /// and the mains frequency (Hz)
+    void getBoilerDriveSettings( bool& halfCycle, unsigned& mainsFrequency ) const;
+
+    /// Power budget of boiler and pump: pump power (W) and the peak and
+    /// average limits of the total (W, 0 = no limit)
+    void getPowerBudgetSettings( double& pumpPower, double& peakLimit, double& averageLimit ) const;
+
+    /// Edge capture: 0 = one pigpiod callback per pin, 1 = shared
+    /// notification pipe (EdgeNotifier)
+    int getEdgeBackend() const;
+
+    /// GPIO access: 0 = pigpiod daemon, 1 = pigpio library in this process;
+    /// only the one built in is available, see GPIO_LOCAL in the Makefile
+    int getGPIOBackend() const;
+
+    /// Glitch filters of the flow meter and TSIC lines: level changes
+    /// shorter than this are ignored (us, 0 = off)
+    void getGlitchFilterSettings( unsigned& flow, unsigned& tsic ) const;
+
+    /// Optional TSIC sensors on the group head and steam wand are
+    /// connected (off by default, their pins are left alone)
+    void getTsicSensorSettings( bool& groupHead, bool& steamWand ) const;
     
     double getFlowOffset30() const;
     double getFlowOffset60() const;
 
     std::string getPath() const;
 
+    /// Write the settings file now (it is also written on shutdown)
+    bool save() const;
+
 private:
     bool _open();
     void _close();
+    bool _store() const;
     void _loadDefaults();
 
     // Regulator settings
@@ -75,6 +137,46 @@ private:
     double _flowOffset30;
     double _flowOffset60;
 
+    int    _regulatorMode;
+    int    _regulatorDecimation;
+    double _regulatorSampleTimeout;
+
+    double _feedforwardGain;
+    double _heaterPower;
+    double _inletTemperature;
+    double _pumpFlowRate;
+
+    int    _regulatorEngine;
+    double _mpcMoveWeight;
+    double _mpcTemperatureMargin;
+
+    int    _cascadeMode;
+    double _cascadeTargetTemperature;
+    double _cascadePGain;
+    double _cascadeIGain;
+    double _cascadeMaxOffset;
+
+    double _overTemperatureLimit;
+    double _overTemperatureRise;
+
+    int    _hardwareWatchdog;
+
+    int    _boilerDriveMode;
+    int    _mainsFrequency;
+
+    double _pumpPower;
+    double _peakPowerLimit;
+    double _averagePowerLimit;
+
+    int    _edgeBackend;
+    int    _gpioBackend;
+
+    int    _flowGlitchFilter;
+    int    _tsicGlitchFilter;
+
+    int    _tsicGroupHead;
+    int    _tsicSteamWand;
+
     std::string _path;
 
     bool _opened;
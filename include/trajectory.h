@@ -0,0 +1,53 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __TRAJECTORY_H__
+#define __TRAJECTORY_H__
+
+//-----------------------------------------------------------------------------
+
+/// Set point profile moving towards a target with limited rate and
+/// acceleration, so that a step in the target becomes a smooth ramp the
+/// boiler can follow. Rising and falling rates are separate: the boiler heats
+/// far faster than it cools.
+class Trajectory {
+public:
+    Trajectory();
+
+    /// Largest rising and falling rate (units/s) and acceleration (units/s^2)
+    void setLimits( double riseRate, double fallRate, double acceleration );
+
+    /// Start the profile at rest at the given position
+    void start( double position );
+    bool started() const;
+
+    /// Forget the profile, the next update starts it at the target
+    void reset();
+
+    /// Advance the profile by dt towards target, returns the new position
+    double update( double target, double dt );
+
+    double getPosition() const;
+    double getRate() const;
+    double getAcceleration() const;
+
+private:
+    double _riseRate;
+    double _fallRate;
+    double _acceleration;
+
+    double _position;
+    double _rate;
+    double _currentAcceleration; ///< rate change of the last update
+    bool   _started;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __TRAJECTORY_H__
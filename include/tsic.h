@@ -19,47 +19,156 @@
 //-----------------------------------------------------------------------------
 
 #include <inttypes.h>
+#include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <functional>
 
-//-----------------------------------------------------------------------------
+#include "seqlock.h"
+#include "ringbuffer.h"
+#include "tsicdecoder.h"
+#include "samplehistory.h"
 
-// Forward decls
-class GPIOPin;
+#include "gpiopin.h"
 
 //-----------------------------------------------------------------------------
 
 /// TSIC Temperature Sensor Class, designed for use with the TSIC 306 sensor,
 /// but may be adaptable for use with other devices of the same class.
+/// Several sensors on different GPIO pins share one edge buffer and one
+/// decoding thread; sensors are addressed by their index in the channel list.
 class TSIC
 {
 public:
+    /// Time stamped temperature reading
+    struct Reading {
+        uint32_t tick;        ///< pigpio time stamp of the packet (us)
+        double   temperature; ///< temperature in degrees C
+    };
+
+    /// Wiring of one sensor
+    struct Channel {
+        Channel( unsigned gpio, GPIOPin::Pull pull = GPIOPin::PullUp, bool required = true, unsigned glitchFilter = 0 );
+
+        unsigned      gpio;         ///< the GPIO pin used for the sensor
+        GPIOPin::Pull pull;         ///< pull resistor on the data line
+        bool          required;     ///< opening fails if this sensor is silent
+        unsigned      glitchFilter; ///< level changes shorter than this are
+                                    ///< ignored (us, 0 = off; the shortest
+                                    ///< pulse of the protocol is about 30us)
+    };
+
+    /// Called on the decoding thread for every valid packet before it is
+    /// published, with the smoothed slope (C/s) when slopeValid is set; it
+    /// must return quickly and must not call back into this object
+    typedef std::function<void( size_t sensor, const Reading& reading, double slope, bool slopeValid )> PacketHook;
+
     TSIC( unsigned gpio );
+    TSIC( const std::vector<Channel>& channels );
     ~TSIC();
 
-    bool getDegrees( double& value ) const;
+    bool getDegrees( double& value, size_t sensor = 0 ) const;
     bool ready() const;
 
+    /// Number of configured sensors (including silent optional ones)
+    size_t getSensorCount() const;
+
+    /// Number of packets (valid or not) published so far by a sensor
+    uint32_t getSampleCount( size_t sensor = 0 ) const;
+
+    /// Block until the sensor publishes a packet after sampleCount, at most
+    /// timeoutMs milliseconds; sampleCount is updated to the latest count.
+    /// Returns false on timeout.
+    bool waitForSample( uint32_t& sampleCount, unsigned timeoutMs, size_t sensor = 0 ) const;
+
+    /// Decoding confidence of the latest packet (0..1, see TSICDecoder)
+    double getConfidence( size_t sensor = 0 ) const;
+
+    /// Smoothed rate of change in degrees C per second, fitted over the
+    /// last 1.5s of valid readings (so it lags by about 0.75s)
+    bool getSlope( double& degreesPerSecond, size_t sensor = 0 ) const;
+
+    /// Copy the newest valid readings (oldest first), returns number copied
+    size_t getHistory( Reading* readings, size_t count, size_t sensor = 0 ) const;
+
+    /// Copy the bus timing and error counters (also logged on shutdown)
+    void getStatistics( TSICDecoder::Statistics& statistics, size_t sensor = 0 ) const;
+
+    /// Install (or remove, with an empty function) the packet hook
+    void setPacketHook( const PacketHook& hook );
+
+    /// Number of edges dropped because the edge buffer was full
+    unsigned getEdgeOverflows() const;
+
+    /// Largest number of edges that were waiting to be decoded
+    unsigned getEdgeHighWater() const;
+
 private:
     void _open();
     void _close();
-    void _alertFunction( int gpio, int level, uint32_t tick );
+    bool _openSensor( size_t sensor );
+    void _worker();
+    void _logStatistics( size_t sensor ) const;
+    void _alertFunction( unsigned pin, bool level, unsigned tick );
+
+    /// Edge as recorded by the callback, decoded later by the worker
+    struct Edge {
+        uint32_t tick;  ///< pigpio time stamp (us)
+        uint8_t  gpio;  ///< pin the edge was seen on
+        bool     level; ///< level after the edge
+    };
+
+    /// Temperature reading as published to readers
+    struct Sample {
+        double temperature; ///< current temperature
+        double confidence;  ///< decoding confidence of the latest packet
+        double slope;       ///< smoothed slope in degrees C per second
+        bool   valid;       ///< temperature data is valid
+        bool   slopeValid;  ///< slope window is filled
+    };
+
+    /// Per sensor decoding state
+    struct Sensor {
+        Sensor( const Channel& channel );
+
+        Channel         channel;
+        GPIOPin*        pin;
 
-    GPIOPin* _pin;
+        TSICDecoder     decoder; ///< bit decoder state, used by the worker only
+        SampleHistory   history; ///< recent valid readings at the full sensor rate
+        SeqLock<Sample> sample;  ///< latest reading, written without blocking readers
+    };
 
-    unsigned _gpio;        ///< the GPIO pin used for the sensor
-    bool     _opened;      ///< true if the sensor is open
-    bool     _valid;       ///< temperature data is valid
-    double   _temperature; ///< current temperature
+    /// number of addressable GPIO pins (bank 1)
+    static const size_t MAX_GPIO = 32;
 
-    uint32_t _count;       ///< number of bits received in current packet
-    uint32_t _lastLow;     ///< time when GPIO pin last went low (us)
-    uint32_t _lastHigh;
-    int      _word;        ///< used to consolidate incoming packet bits
+    std::vector<Sensor*> _sensors;
 
-    bool _running;
+    /// index of the sensor on each GPIO pin, or -1 (read by the worker)
+    int _sensorOfGpio[MAX_GPIO];
 
-    /// Mutex to control access to the sensor data
+    bool     _opened;      ///< true if all required sensors are open
+
+    uint32_t _overflows;   ///< edge overflows already seen by the worker
+
+    PacketHook _packetHook; ///< called by the worker (with the mutex held)
+
+    bool _run;
+    std::thread _thread;
+
+    /// Edges handed over from the pigpiod callback thread to the worker; all
+    /// pigpiod callbacks run on one thread, so this has a single producer
+    /// however many sensors are connected
+    RingBuffer<Edge, 256> _edges;
+
+    /// Mutex to control access to the decoders and histories (worker and
+    /// readers only, never taken on the pigpiod callback thread)
     mutable std::mutex _mutex;
+
+    /// Signalled by the worker after it has published new packets
+    mutable std::condition_variable _sampleReady;
+    mutable std::mutex _sampleMutex;
 };
 
 //-----------------------------------------------------------------------------
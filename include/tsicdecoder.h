@@ -0,0 +1,104 @@
+#ifndef __TSICDECODER_H__
+#define __TSICDECODER_H__
+
+//-----------------------------------------------------------------------------
+//
+// Copyright (C) 2014-2015 James Ward
+// Copyright (C) 2015 Alexander Giesler
+//
+// This software is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+//-----------------------------------------------------------------------------
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+//-----------------------------------------------------------------------------
+
+/// Decoder for the ZACwire protocol used by the TSIC 306. Every byte starts
+/// with a 50% duty strobe bit; its low time is measured and used as the
+/// threshold between the 25% (one) and 75% (zero) duty data bits of that
+/// byte, so decoding follows the bit period as it drifts with temperature.
+class TSICDecoder {
+public:
+    /// scale factor used to convert sensor values to fixed point integer
+    static const int SCALE_FACTOR = 1000;
+
+    /// Result of a completed packet
+    struct Packet {
+        int      temperature; ///< fixed point temperature (* SCALE_FACTOR)
+        bool     valid;       ///< parity, prefix and range checks passed
+        double   confidence;  ///< smallest bit margin in packet (0..1)
+        uint32_t tick;        ///< time stamp of the last edge of the packet
+    };
+
+    /// Counts of values in fixed width bins
+    struct Histogram {
+        static const size_t BINS = 32;
+
+        Histogram( uint32_t width );
+        void add( uint32_t value );
+
+        uint32_t binWidth;     ///< width of each bin
+        uint32_t counts[BINS]; ///< the last bin also counts everything above
+    };
+
+    /// Bus timing and error counters
+    struct Statistics {
+        Statistics();
+
+        uint32_t packets;      ///< packets completed (valid or not)
+        uint32_t parityErrors; ///< packets with a parity error
+        uint32_t prefixErrors; ///< packets with prefix bits set
+        uint32_t rangeErrors;  ///< packets outside the measurable range
+        uint32_t frameResets;  ///< packets abandoned part way through
+
+        Histogram lowWidth;    ///< low pulse widths inside packets (us)
+        Histogram highWidth;   ///< high pulse widths inside packets (us)
+        Histogram interval;    ///< time between completed packets (us)
+    };
+
+    TSICDecoder();
+
+    /// Feed the next edge; returns true when a packet has been completed
+    bool edge( bool level, uint32_t tick, Packet& packet );
+
+    /// Discard the packet in progress
+    void reset();
+
+    /// Counters since construction
+    const Statistics& statistics() const;
+
+    /// value of decode for a packet failing a check
+    static const int INVALID_TEMPERATURE = -100000;
+
+    /// Decode a word as assembled from the bits after the strobes: the two
+    /// 9-bit packets of data and parity bits. Returns the temperature
+    /// (* SCALE_FACTOR) or INVALID_TEMPERATURE, counting the error
+    static int decode( int packet0, int packet1, Statistics& statistics );
+
+private:
+    uint32_t _count;        ///< number of bits received in current packet
+    uint32_t _lastLow;      ///< time when GPIO pin last went low (us)
+    uint32_t _lastHigh;     ///< time when GPIO pin last went high (us)
+    double   _strobe;       ///< filtered strobe low time (us)
+    bool     _calibrated;   ///< a strobe has been measured
+    bool     _synchronised; ///< the start of the current packet was seen
+    int      _word;         ///< used to consolidate incoming packet bits
+    double   _confidence;   ///< smallest bit margin seen in current packet
+    uint32_t _lastPacket;   ///< time stamp of the last completed packet
+
+    Statistics _statistics;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __TSICDECODER_H__
@@ -0,0 +1,103 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __WATCHDOG_H__
+#define __WATCHDOG_H__
+
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <functional>
+
+//-----------------------------------------------------------------------------
+
+/// Watchdog for the worker threads. Each monitored loop registers with a
+/// deadline and checks in once per iteration; a check-in is one clock read
+/// and one atomic store, it takes no lock. A loop that has not checked in
+/// within its deadline is logged with the time it has been stalled. If the
+/// loop is critical the failsafe functions are called (from the watchdog
+/// thread, so they must not wait for the stalled threads) and the trip is
+/// latched with the loop's name; a stall of any other loop is only logged.
+/// Optionally the Linux hardware watchdog is fed as long as no critical
+/// loop is stalled, so a stall of the watchdog thread itself, or one the
+/// failsafes cannot help, resets the system.
+class Watchdog {
+public:
+    /// number of loops that can be registered at the same time
+    static const size_t MAX_LOOPS = 16;
+
+    /// Called once when a loop stalls
+    typedef std::function<void()> Failsafe;
+
+    Watchdog( bool hardware = false );
+    ~Watchdog();
+
+    bool ready() const;
+
+    /// Register a loop that checks in at least every deadline seconds,
+    /// returns its handle or -1 if the table is full. A stall of a loop that
+    /// is not critical calls no failsafe
+    int add( const std::string& name, double deadline, bool critical = true );
+    void remove( int loop );
+
+    /// Called by the loop on every iteration
+    void checkIn( int loop );
+
+    /// Register a failsafe, returns its handle for removeFailsafe
+    int addFailsafe( const Failsafe& failsafe );
+    void removeFailsafe( int failsafe );
+
+    /// Number of stalls seen so far
+    unsigned getStallCount() const;
+
+    /// Name of the critical loop whose stall called the failsafes, false
+    /// if none has stalled; latched until the application restarts
+    bool getTrip( std::string& name ) const;
+
+private:
+    void _open( bool hardware );
+    void _close();
+    void _worker();
+
+    /// Registered loop
+    struct Loop {
+        Loop();
+
+        std::string         name;
+        double              deadline;     ///< maximum time between check-ins (s)
+        std::atomic<double> lastCheckIn;  ///< getClock() of the last check-in
+        double              stalledSince; ///< last check-in before the stall
+        bool                critical;     ///< a stall calls the failsafes
+        bool                used;
+        bool                stalled;
+    };
+
+    bool _opened;
+    int  _device;          ///< hardware watchdog file descriptor, or -1
+
+    Loop _loops[MAX_LOOPS];
+
+    std::vector< std::pair<int, Failsafe> > _failsafes;
+    int      _nextFailsafe;
+    unsigned _stalls;
+    std::string _trip;     ///< loop that called the failsafes first, or empty
+
+    bool _run;
+    std::thread _thread;
+    mutable std::mutex _mutex; ///< guards everything but lastCheckIn
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __WATCHDOG_H__
@@ -7,6 +7,8 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <chrono>
+
 #include "boiler.h"
 #include "settings.h"
 #include "timing.h"
@@ -14,14 +16,28 @@
 
 #include "logger.h"
 #include "singleton.h"
+#include "watchdog.h"
+
+//-----------------------------------------------------------------------------
+
+// Watchdog deadline of the half-cycle loop in seconds; a stall leaves the
+// SSR in its last state, which may be on
+static const double BOILER_WATCHDOG_DEADLINE = 0.5;
 
 //-----------------------------------------------------------------------------
 
-Boiler::Boiler() 
+Boiler::Boiler( Mode::Value mode, unsigned mainsFrequency ) 
     :_opened( false )
+    ,_mode( mode )
     ,_pwmRange( 20000 )
     ,_pwmFrequency( 10 )
     ,_pwmCurrentPower( 0.0 )
+    ,_tripped( false )
+    ,_halfCycle( mainsFrequency > 0 ? 0.5 / static_cast<double>( mainsFrequency ) : 0.0 )
+    ,_gateOn( false )
+    ,_error( 0.0 )
+    ,_run( false )
+    ,_watchdog( -1 )
     ,_gpioPin( nullptr )
 {
     _open();
@@ -56,8 +72,20 @@ void Boiler::setPower( double value ) {
         value = 1.0;
     }
     
+    // the lock keeps a trip from being overwritten by a drive computed
+    // before it
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    if ( _tripped ) {
+        value = 0.0;
+    }
+
+    // in half-cycle mode the worker picks the level up at the next
+    // half-cycle
     _pwmCurrentPower = value;
-    _gpioPin->setPWMDuty( value * _pwmRange );
+    if ( _mode == Mode::PWM ) {
+        _gpioPin->setPWMDuty( value * _pwmRange );
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -67,11 +95,49 @@ double Boiler::getPower() const {
         return 0.0;
     }
     
+    std::lock_guard<std::mutex> lock( _mutex );
     return _pwmCurrentPower;
 }
 
 //-----------------------------------------------------------------------------
 
+void Boiler::trip() {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    _tripped = true;
+    _pwmCurrentPower = 0.0;
+
+    // past the command queue, so the drive is written when this returns
+    // and does not wait for the queue worker
+    if ( _mode == Mode::PWM ) {
+        _gpioPin->setPWMDutyNow( 0 );
+    }
+    else {
+        _gateOn = false;
+        _gpioPin->setStateNow( false );
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool Boiler::tripped() const {
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _tripped;
+}
+
+//-----------------------------------------------------------------------------
+
+void Boiler::resetTrip() {
+    std::lock_guard<std::mutex> lock( _mutex );
+    _tripped = false;
+}
+
+//-----------------------------------------------------------------------------
+
 void Boiler::_open() {    
     _gpioPin = new GPIOPin( BOILER_PIN );
     
@@ -86,6 +152,31 @@ void Boiler::_open() {
         _close();
         return;
     }
+
+    if ( _mode == Mode::HalfCycle ) {
+        if ( _halfCycle < 0.005 || _halfCycle > 0.0125 ) {
+            LogError("Boiler mains frequency must be 40Hz to 100Hz for half-cycle drive");
+            _close();
+            return;
+        }
+
+        if ( !_gpioPin->setState( false ) ) {
+            LogError("Boiler GPIO-Pin set state failed");
+            _close();
+            return;
+        }
+
+        LogInfo("Boiler drive: whole mains half-cycles of " << 1.0E3 * _halfCycle << "ms");
+
+        // the worker must not wait for pigpiod at every half-cycle
+        _gpioPin->setAsync( true );
+
+        _opened = true;
+        _run = true;
+        _watchdog = Singleton<Watchdog>::ready() ? Singleton<Watchdog>::pointer()->add( "boiler", BOILER_WATCHDOG_DEADLINE ) : -1;
+        _thread = std::thread( &Boiler::_worker, this );
+        return;
+    }
     
     if ( !_gpioPin->setPWMFrequency( _pwmFrequency ) ) {
         LogError("Boiler GPIO-Pin PWM set frequency failed");
@@ -105,12 +196,16 @@ void Boiler::_open() {
         return;
     }
     
-    const unsigned int realFrequency = get_PWM_frequency( BOILER_PIN );
-    const unsigned int realRange = get_PWM_real_range( BOILER_PIN );
+    const unsigned int realFrequency = _gpioPin->getPWMFrequency();
+    const unsigned int realRange = _gpioPin->getPWMRange();
     
     if ( realFrequency != _pwmFrequency || realRange != _pwmRange ) {
         LogInfo( "Boiler PWM Setup: Frequency = " << realFrequency << ", Range = " << realRange );
     }
+
+    // the duty is set with the boiler lock held, which should not wait
+    // for pigpiod
+    _gpioPin->setAsync( true );
     
     _opened = true;
 }
@@ -118,9 +213,79 @@ void Boiler::_open() {
 //-----------------------------------------------------------------------------
 
 void Boiler::_close() {    
+    if ( _run ) {
+        _run = false;
+        _thread.join();
+    }
+
+    if ( _watchdog >= 0 ) {
+        Singleton<Watchdog>::pointer()->remove( _watchdog );
+        _watchdog = -1;
+    }
+
     if ( _gpioPin ) {
         _gpioPin->setState( false );
         delete _gpioPin;
+        _gpioPin = nullptr;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void Boiler::_worker() {
+    // decisions are scheduled on absolute times, so sleeping late does not
+    // make the half-cycles drift; the elapsed time is accounted for anyway
+    double next = getClock();
+    double last = next;
+
+    while ( _run ) {
+        next += _halfCycle;
+
+        const double remain = next - getClock();
+        if ( remain > 0.0 ) {
+            std::this_thread::sleep_for( std::chrono::duration<double>( remain ) );
+        }
+        else {
+            next = getClock();
+        }
+
+        if ( _watchdog >= 0 ) {
+            Singleton<Watchdog>::pointer()->checkIn( _watchdog );
+        }
+
+        const double now = getClock();
+        const double elapsed = ( now - last ) / _halfCycle;
+        last = now;
+
+        std::lock_guard<std::mutex> lock( _mutex );
+
+        const double duty = _tripped ? 0.0 : _pwmCurrentPower;
+
+        // half-cycles delivered in the past interval against those asked
+        // for; a long stall is not made up afterwards
+        _error += elapsed * ( ( _gateOn ? 1.0 : 0.0 ) - duty );
+        if ( _error > 1.0 ) {
+            _error = 1.0;
+        }
+        else if ( _error < -1.0 ) {
+            _error = -1.0;
+        }
+
+        // switch the next half-cycle on if that leaves the smaller error;
+        // full and zero power need no accumulation
+        bool on = false;
+        if ( duty <= 0.0 || duty >= 1.0 ) {
+            on = ( duty >= 1.0 );
+            _error = 0.0;
+        }
+        else {
+            on = ( duty - _error > 0.5 );
+        }
+
+        if ( on != _gateOn ) {
+            _gpioPin->setState( on );
+            _gateOn = on;
+        }
     }
 }
 
@@ -0,0 +1,309 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include <math.h>
+#include <algorithm>
+
+#include "boilermodel.h"
+#include "boiler.h"
+#include "tsic.h"
+#include "timing.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// interval at which the boiler drive is sampled (ms)
+static const unsigned MODEL_POLL_MS = 100;
+
+/// drive samples averaged into one model sample (one second)
+static const unsigned MODEL_POLLS_PER_SAMPLE = 10;
+
+/// forgetting factor of the estimators (memory of about 15 minutes)
+static const double MODEL_FORGETTING = 0.999;
+
+/// covariance trace above which forgetting is suspended, so that the
+/// estimators do not blow up while the boiler sits at a steady state
+static const double MODEL_MAX_TRACE = 1.0E4;
+
+/// initial covariance of the parameters
+static const double MODEL_INITIAL_COVARIANCE = 10.0;
+
+/// filter constant of the squared prediction error used to pick the
+/// dead time (about a minute)
+static const double MODEL_ERROR_FILTER = 0.02;
+
+/// samples before the estimate is reported as valid
+static const unsigned MODEL_WARMUP = 120;
+
+//-----------------------------------------------------------------------------
+
+BoilerModel::BoilerModel( Boiler* boiler, TSIC* tsic, double ambientTemperature )
+    :_boiler( boiler )
+    ,_tsic( tsic )
+    ,_ambient( ambientTemperature )
+    ,_opened( false )
+    ,_flowing( false )
+    ,_head( 0 )
+    ,_samples( 0 )
+    ,_slopeMean( 0.0 )
+    ,_slopeVariance( 0.0 )
+    ,_run( false )
+{
+    _resetEstimators();
+    _open();
+}
+
+//-----------------------------------------------------------------------------
+
+BoilerModel::~BoilerModel() {
+    _close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool BoilerModel::ready() const {
+    return _opened;
+}
+
+//-----------------------------------------------------------------------------
+
+bool BoilerModel::getParameters( Parameters& parameters ) const {
+    parameters = Parameters();
+
+    if ( !_opened ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    // report the dead time whose estimator predicts best
+    size_t best = MAX_DEAD_TIME + 1;
+    for ( size_t delay = 0; delay <= MAX_DEAD_TIME; ++delay ) {
+        if ( _samples <= delay + MODEL_WARMUP ) {
+            continue;
+        }
+
+        if ( best > MAX_DEAD_TIME || _estimators[delay].error < _estimators[best].error ) {
+            best = delay;
+        }
+    }
+
+    parameters.samples = _samples;
+
+    if ( best > MAX_DEAD_TIME ) {
+        return false;
+    }
+
+    const Estimator& estimator = _estimators[best];
+
+    parameters.heaterGain      = estimator.theta[0];
+    parameters.lossCoefficient = estimator.theta[1];
+    parameters.deadTime        = static_cast<double>( best );
+
+    if ( parameters.heaterGain <= 0.0 || parameters.lossCoefficient <= 0.0 ) {
+        return false;
+    }
+
+    parameters.ambientTemperature = _ambient;
+    parameters.timeConstant       = 1.0 / parameters.lossCoefficient;
+
+    // relative standard deviation of the heater gain, from the covariance
+    // scaled by the prediction error variance, and the share of the slope
+    // variance the model explains; the lower of both is reported
+    const double deviation = sqrt( estimator.error * estimator.p[0][0] );
+    const double determined = 1.0 - deviation / parameters.heaterGain;
+    const double explained = ( _slopeVariance > 0.0 ) ? 1.0 - estimator.error / _slopeVariance : 0.0;
+
+    parameters.confidence = std::min( determined, explained );
+    if ( parameters.confidence < 0.0 ) {
+        parameters.confidence = 0.0;
+    }
+
+    parameters.valid = true;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void BoilerModel::reset() {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    _resetEstimators();
+}
+
+//-----------------------------------------------------------------------------
+
+void BoilerModel::setFlow( bool flowing ) {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    _flowing = flowing;
+}
+
+//-----------------------------------------------------------------------------
+
+void BoilerModel::_open() {
+    if ( _boiler == nullptr || !_boiler->ready() ) {
+        LogError("Boiler controller not ready, aborting boiler model");
+        return;
+    }
+
+    if ( _tsic == nullptr || !_tsic->ready() ) {
+        LogError("Temperature sensor not ready, aborting boiler model");
+        return;
+    }
+
+    _run = true;
+    _thread = std::thread( &BoilerModel::_worker, this );
+    _opened = true;
+}
+
+//-----------------------------------------------------------------------------
+
+void BoilerModel::_close() {
+    if ( _run ) {
+        _run = false;
+        _thread.join();
+    }
+
+    if ( _opened ) {
+        Parameters parameters;
+        if ( getParameters( parameters ) ) {
+            LogInfo("Boiler model: heater " << parameters.heaterGain << " C/s, time constant " << parameters.timeConstant
+                << " s, ambient " << parameters.ambientTemperature << " C, dead time " << parameters.deadTime
+                << " s, confidence " << parameters.confidence);
+        }
+    }
+
+    _opened = false;
+}
+
+//-----------------------------------------------------------------------------
+
+void BoilerModel::_resetEstimators() {
+    for ( size_t delay = 0; delay <= MAX_DEAD_TIME; ++delay ) {
+        Estimator& estimator = _estimators[delay];
+
+        for ( size_t row = 0; row < 2; ++row ) {
+            estimator.theta[row] = 0.0;
+
+            for ( size_t column = 0; column < 2; ++column ) {
+                estimator.p[row][column] = ( row == column ) ? MODEL_INITIAL_COVARIANCE : 0.0;
+            }
+        }
+
+        estimator.error = 0.0;
+        _drives[delay] = 0.0;
+    }
+
+    _head          = 0;
+    _samples       = 0;
+    _slopeMean     = 0.0;
+    _slopeVariance = 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+void BoilerModel::_update( double drive, double temperature, double slope ) {
+    // must be called with the mutex held; the drive history advances even
+    // while water flows, so the dead times stay aligned
+    _head = ( _head + 1 ) % ( MAX_DEAD_TIME + 1 );
+    _drives[_head] = drive;
+
+    if ( _flowing ) {
+        return;
+    }
+
+    ++_samples;
+
+    const double deviation = slope - _slopeMean;
+    _slopeMean     += MODEL_ERROR_FILTER * deviation;
+    _slopeVariance += MODEL_ERROR_FILTER * ( deviation * deviation - _slopeVariance );
+
+    for ( size_t delay = 0; delay <= MAX_DEAD_TIME && delay < _samples; ++delay ) {
+        Estimator& estimator = _estimators[delay];
+
+        // regressors: delayed drive and the temperature above ambient
+        const double phi[2] = {
+            _drives[( _head + MAX_DEAD_TIME + 1 - delay ) % ( MAX_DEAD_TIME + 1 )],
+            -( temperature - _ambient )
+        };
+
+        double prediction = 0.0;
+        double pPhi[2] = { 0.0, 0.0 };
+        for ( size_t row = 0; row < 2; ++row ) {
+            prediction += estimator.theta[row] * phi[row];
+
+            for ( size_t column = 0; column < 2; ++column ) {
+                pPhi[row] += estimator.p[row][column] * phi[column];
+            }
+        }
+
+        const double error = slope - prediction;
+        estimator.error += MODEL_ERROR_FILTER * ( error * error - estimator.error );
+
+        const double trace = estimator.p[0][0] + estimator.p[1][1];
+        const double forgetting = ( trace < MODEL_MAX_TRACE ) ? MODEL_FORGETTING : 1.0;
+
+        double denominator = forgetting;
+        for ( size_t row = 0; row < 2; ++row ) {
+            denominator += phi[row] * pPhi[row];
+        }
+
+        // theta += K * error, P = ( P - K * phi' * P ) / forgetting, where
+        // K = P * phi / denominator (P is symmetric, so phi' * P = pPhi')
+        for ( size_t row = 0; row < 2; ++row ) {
+            estimator.theta[row] += pPhi[row] / denominator * error;
+
+            for ( size_t column = 0; column < 2; ++column ) {
+                estimator.p[row][column] = ( estimator.p[row][column] - pPhi[row] * pPhi[column] / denominator ) / forgetting;
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void BoilerModel::_worker() {
+    double   driveSum = 0.0;
+    unsigned polls    = 0;
+
+    while ( _run ) {
+        delayms( MODEL_POLL_MS );
+
+        // average the drive over the sample period, it changes faster
+        driveSum += _boiler->getPower();
+        if ( ++polls < MODEL_POLLS_PER_SAMPLE ) {
+            continue;
+        }
+
+        const double drive = driveSum / static_cast<double>( polls );
+        driveSum = 0.0;
+        polls    = 0;
+
+        // the smoothed slope is far less noisy than differencing readings
+        double temperature = 0.0;
+        double slope       = 0.0;
+        if ( !_tsic->getDegrees( temperature ) || !_tsic->getSlope( slope ) ) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock( _mutex );
+        _update( drive, temperature, slope );
+    }
+}
+
+//-----------------------------------------------------------------------------
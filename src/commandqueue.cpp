@@ -0,0 +1,853 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include "commandqueue.h"
+#include "pigpiomgr.h"
+#include "timing.h"
+#include "watchdog.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// names of the command groups for the log
+static const char* COMMAND_NAMES[CommandQueue::Command::Count] = {
+    "mode", "read", "write", "PWM duty", "PWM setup", "edge", "tick", "notify", "bank read"
+};
+
+/// longest the worker may be busy with one batch before the watchdog trips (s)
+static const double COMMANDS_WATCHDOG_DEADLINE = 2.0;
+
+/// time the idle worker waits for entries before checking in (ms)
+static const unsigned COMMANDS_IDLE_MS = 500;
+
+//-----------------------------------------------------------------------------
+
+CommandQueue::CommandQueue( GPIOBackend* backend )
+    :_backend( backend )
+    ,_started( 0.0 )
+    ,_run( false )
+    ,_watchdog( -1 )
+{
+    for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+        _level[pin]   = UNKNOWN;
+        _duty[pin]    = UNKNOWN;
+        _async[pin]   = false;
+        _pending[pin] = 0;
+        _overtaken[pin] = false;
+    }
+
+    for ( unsigned command = 0; command < Command::Count; ++command ) {
+        _statistics[command] = Statistics();
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+CommandQueue::~CommandQueue() {
+    delete _backend;
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::setAsync( unsigned pin, bool async ) {
+    if ( pin >= MAX_PINS ) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock( _mutex );
+
+    // writes queued so far are sent before the pin waits again
+    if ( !async ) {
+        _waitPin( lock, pin );
+    }
+
+    _async[pin] = async;
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::flush() {
+    std::unique_lock<std::mutex> lock( _mutex );
+
+    for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+        _waitPin( lock, pin );
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::getStatistics( Command::Value command, Statistics& statistics ) const {
+    std::lock_guard<std::mutex> lock( _mutex );
+    statistics = _statistics[command];
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::start() {
+    const int result = _backend->start();
+    if ( result == PI_INIT_FAILED ) {
+        return result;
+    }
+
+    _started = getClock();
+    _run = true;
+
+    // a worker stuck on pigpiod leaves the boiler at its last drive
+    _watchdog = Singleton<Watchdog>::ready() ? Singleton<Watchdog>::pointer()->add( "gpio commands", COMMANDS_WATCHDOG_DEADLINE ) : -1;
+    _thread = std::thread( &CommandQueue::_worker, this );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::stop() {
+    if ( _run ) {
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _run = false;
+        }
+
+        // the worker sends what is queued before it ends
+        _queued.notify_all();
+        _thread.join();
+
+        if ( _watchdog >= 0 ) {
+            Singleton<Watchdog>::pointer()->remove( _watchdog );
+            _watchdog = -1;
+        }
+
+        const double uptime = getClock() - _started;
+        uint64_t roundTrips = 0;
+
+        for ( unsigned command = 0; command < Command::Count; ++command ) {
+            const Statistics& statistics = _statistics[command];
+            roundTrips += statistics.roundTrips;
+
+            if ( statistics.calls == 0 ) {
+                continue;
+            }
+
+            const double average = ( statistics.roundTrips > 0 ) ? statistics.latency / statistics.roundTrips : 0.0;
+            LogInfo("GPIO " << COMMAND_NAMES[command] << ": " << statistics.calls << " calls, " << statistics.coalesced
+                << " coalesced, " << statistics.roundTrips << " round trips, " << 1.0E3 * average << " ms average, "
+                << 1.0E3 * statistics.maxLatency << " ms worst");
+        }
+
+        if ( uptime > 0.0 ) {
+            LogInfo("GPIO round trips: " << roundTrips << " (" << roundTrips / uptime << " per second)");
+        }
+    }
+
+    _backend->stop();
+}
+
+//-----------------------------------------------------------------------------
+
+const char* CommandQueue::name() const {
+    return _backend->name();
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::setMode( unsigned pin, unsigned mode ) {
+    if ( pin < MAX_PINS ) {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _count( Command::Mode, false );
+        _waitPin( lock, pin );
+        _forget( pin );
+    }
+
+    const double start = getClock();
+    const int result = _backend->setMode( pin, mode );
+    _record( Command::Mode, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::setPullUpDown( unsigned pin, unsigned pull ) {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Mode, false );
+    }
+
+    const double start = getClock();
+    const int result = _backend->setPullUpDown( pin, pull );
+    _record( Command::Mode, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::read( unsigned pin ) {
+    if ( pin < MAX_PINS ) {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _count( Command::Read, false );
+        _waitPin( lock, pin );
+    }
+
+    const double start = getClock();
+    const int result = _backend->read( pin );
+    _record( Command::Read, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::write( unsigned pin, unsigned level ) {
+    if ( pin < MAX_PINS ) {
+        const int value = ( level != 0 ) ? 1 : 0;
+
+        std::unique_lock<std::mutex> lock( _mutex );
+
+        if ( _level[pin] == value ) {
+            _count( Command::Write, true );
+            return 0;
+        }
+
+        _count( Command::Write, false );
+
+        // a level ends PWM on the pin
+        _level[pin] = value;
+        _duty[pin]  = UNKNOWN;
+
+        if ( _async[pin] && _run ) {
+            const Entry entry = { pin, false, static_cast<unsigned>( value ) };
+            _queue.push_back( entry );
+            ++_pending[pin];
+            _queued.notify_one();
+            return 0;
+        }
+
+        _waitPin( lock, pin );
+    }
+
+    const double start = getClock();
+    const int result = _backend->write( pin, level );
+    _record( Command::Write, start );
+
+    if ( result < 0 && pin < MAX_PINS ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _forget( pin );
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::writeNow( unsigned pin, unsigned level ) {
+    if ( pin < MAX_PINS ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Write, false );
+        _overtake( pin );
+
+        _level[pin] = ( level != 0 ) ? 1 : 0;
+        _duty[pin]  = UNKNOWN;
+    }
+
+    const double start = getClock();
+    const int result = _backend->write( pin, level );
+    _record( Command::Write, start );
+
+    if ( result < 0 && pin < MAX_PINS ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _forget( pin );
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+uint32_t CommandQueue::readBank1() {
+    std::unique_lock<std::mutex> lock( _mutex );
+    _count( Command::Bank, false );
+
+    // all pins are read, so all queued writes go first
+    for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+        _waitPin( lock, pin );
+    }
+
+    lock.unlock();
+
+    const double start = getClock();
+    const uint32_t levels = _backend->readBank1();
+    _record( Command::Bank, start );
+
+    return levels;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::clearBank1( uint32_t bits ) {
+    std::unique_lock<std::mutex> lock( _mutex );
+    _count( Command::Write, false );
+
+    for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+        if ( bits & ( 1u << pin ) ) {
+            _waitPin( lock, pin );
+            _forget( pin );
+        }
+    }
+
+    lock.unlock();
+
+    const double start = getClock();
+    const int result = _backend->clearBank1( bits );
+    _record( Command::Write, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::setBank1( uint32_t bits ) {
+    std::unique_lock<std::mutex> lock( _mutex );
+    _count( Command::Write, false );
+
+    for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+        if ( bits & ( 1u << pin ) ) {
+            _waitPin( lock, pin );
+            _forget( pin );
+        }
+    }
+
+    lock.unlock();
+
+    const double start = getClock();
+    const int result = _backend->setBank1( bits );
+    _record( Command::Write, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::setPWMDuty( unsigned pin, unsigned duty ) {
+    if ( pin < MAX_PINS ) {
+        const int value = static_cast<int>( duty );
+
+        std::unique_lock<std::mutex> lock( _mutex );
+
+        if ( _duty[pin] == value ) {
+            _count( Command::PWMDuty, true );
+            return 0;
+        }
+
+        _count( Command::PWMDuty, false );
+
+        _duty[pin]  = value;
+        _level[pin] = UNKNOWN;
+
+        if ( _async[pin] && _run ) {
+            const Entry entry = { pin, true, duty };
+            _queue.push_back( entry );
+            ++_pending[pin];
+            _queued.notify_one();
+            return 0;
+        }
+
+        _waitPin( lock, pin );
+    }
+
+    const double start = getClock();
+    const int result = _backend->setPWMDuty( pin, duty );
+    _record( Command::PWMDuty, start );
+
+    if ( result < 0 && pin < MAX_PINS ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _forget( pin );
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::setPWMDutyNow( unsigned pin, unsigned duty ) {
+    if ( pin < MAX_PINS ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::PWMDuty, false );
+        _overtake( pin );
+
+        _duty[pin]  = static_cast<int>( duty );
+        _level[pin] = UNKNOWN;
+    }
+
+    const double start = getClock();
+    const int result = _backend->setPWMDuty( pin, duty );
+    _record( Command::PWMDuty, start );
+
+    if ( result < 0 && pin < MAX_PINS ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _forget( pin );
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::setPWMRange( unsigned pin, unsigned range ) {
+    if ( pin < MAX_PINS ) {
+        // pigpio scales an active duty to the new range
+        std::unique_lock<std::mutex> lock( _mutex );
+        _count( Command::PWMSetup, false );
+        _waitPin( lock, pin );
+        _duty[pin] = UNKNOWN;
+    }
+
+    const double start = getClock();
+    const int result = _backend->setPWMRange( pin, range );
+    _record( Command::PWMSetup, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::getPWMRealRange( unsigned pin ) {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::PWMSetup, false );
+    }
+
+    const double start = getClock();
+    const int result = _backend->getPWMRealRange( pin );
+    _record( Command::PWMSetup, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::setPWMFrequency( unsigned pin, unsigned frequency ) {
+    if ( pin < MAX_PINS ) {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _count( Command::PWMSetup, false );
+        _waitPin( lock, pin );
+        _duty[pin] = UNKNOWN;
+    }
+
+    const double start = getClock();
+    const int result = _backend->setPWMFrequency( pin, frequency );
+    _record( Command::PWMSetup, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::getPWMFrequency( unsigned pin ) {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::PWMSetup, false );
+    }
+
+    const double start = getClock();
+    const int result = _backend->getPWMFrequency( pin );
+    _record( Command::PWMSetup, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::callback( unsigned pin, unsigned edge, EdgeCallback edgeCallback, void* userData ) {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Edge, false );
+    }
+
+    const double start = getClock();
+    const int result = _backend->callback( pin, edge, edgeCallback, userData );
+    _record( Command::Edge, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::cancelCallback( int id ) {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Edge, false );
+    }
+
+    const double start = getClock();
+    _backend->cancelCallback( id );
+    _record( Command::Edge, start );
+}
+
+//-----------------------------------------------------------------------------
+
+bool CommandQueue::waitForEdge( unsigned pin, unsigned edge, double seconds ) {
+    // counted, but not timed: the call lasts as long as the wait
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Edge, false );
+        ++_statistics[Command::Edge].roundTrips;
+    }
+
+    return _backend->waitForEdge( pin, edge, seconds );
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::setGlitchFilter( unsigned pin, unsigned steady ) {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Edge, false );
+    }
+
+    const double start = getClock();
+    const int result = _backend->setGlitchFilter( pin, steady );
+    _record( Command::Edge, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::setNoiseFilter( unsigned pin, unsigned steady, unsigned active ) {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Edge, false );
+    }
+
+    const double start = getClock();
+    const int result = _backend->setNoiseFilter( pin, steady, active );
+    _record( Command::Edge, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+uint32_t CommandQueue::getTick() {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Tick, false );
+    }
+
+    const double start = getClock();
+    const uint32_t tick = _backend->getTick();
+    _record( Command::Tick, start );
+
+    return tick;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::notifyOpen() {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Notify, false );
+    }
+
+    const double start = getClock();
+    const int result = _backend->notifyOpen();
+    _record( Command::Notify, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::notifyBegin( unsigned handle, uint32_t bits ) {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Notify, false );
+    }
+
+    const double start = getClock();
+    const int result = _backend->notifyBegin( handle, bits );
+    _record( Command::Notify, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::notifyPause( unsigned handle ) {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Notify, false );
+    }
+
+    const double start = getClock();
+    const int result = _backend->notifyPause( handle );
+    _record( Command::Notify, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int CommandQueue::notifyClose( unsigned handle ) {
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _count( Command::Notify, false );
+    }
+
+    const double start = getClock();
+    const int result = _backend->notifyClose( handle );
+    _record( Command::Notify, start );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+std::string CommandQueue::notifyPath( unsigned handle ) const {
+    // no call to pigpio
+    return _backend->notifyPath( handle );
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::_worker() {
+    std::vector<Entry> entries;
+    std::vector<Entry> replays;
+
+    while ( true ) {
+        if ( _watchdog >= 0 ) {
+            Singleton<Watchdog>::pointer()->checkIn( _watchdog );
+        }
+
+        {
+            std::unique_lock<std::mutex> lock( _mutex );
+
+            // woken now and then while idle, to check in
+            if ( !_queued.wait_for( lock, std::chrono::milliseconds( COMMANDS_IDLE_MS ), [this]{ return !_queue.empty() || !_run; } ) ) {
+                continue;
+            }
+
+            // stopped and drained
+            if ( _queue.empty() ) {
+                break;
+            }
+
+            entries.swap( _queue );
+        }
+
+        // the replays are in flight like queued writes, commands on their
+        // pins wait for them, and may be overtaken again themselves
+        while ( !entries.empty() ) {
+            _send( entries );
+
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+                for ( const Entry& entry : entries ) {
+                    --_pending[entry.pin];
+                }
+
+                _replay( replays );
+            }
+
+            _sent.notify_all();
+            entries.clear();
+            entries.swap( replays );
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::_replay( std::vector<Entry>& replays ) {
+    // must be called with the mutex held; a write sent at once may have
+    // reached pigpio before the one that was in flight, so its value is
+    // sent again to win; writes queued since then are sent later anyway
+    for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+        if ( !_overtaken[pin] ) {
+            continue;
+        }
+
+        _overtaken[pin] = false;
+
+        if ( _pending[pin] > 0 ) {
+            continue;
+        }
+
+        if ( _duty[pin] != UNKNOWN ) {
+            const Entry entry = { pin, true, static_cast<unsigned>( _duty[pin] ) };
+            replays.push_back( entry );
+            ++_pending[pin];
+        }
+        else if ( _level[pin] != UNKNOWN ) {
+            const Entry entry = { pin, false, static_cast<unsigned>( _level[pin] ) };
+            replays.push_back( entry );
+            ++_pending[pin];
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::_send( const std::vector<Entry>& entries ) {
+    // consecutive levels of different pins are collected and sent
+    // together; a duty or a second level for a pin sends them first, so the
+    // order of the commands is kept (e.g. the boiler drive is lowered
+    // before the pump is switched on)
+    uint32_t setBits   = 0;
+    uint32_t clearBits = 0;
+
+    for ( const Entry& entry : entries ) {
+        const uint32_t bit = 1u << entry.pin;
+
+        if ( entry.duty || ( ( setBits | clearBits ) & bit ) ) {
+            _sendLevels( setBits, clearBits );
+            setBits   = 0;
+            clearBits = 0;
+        }
+
+        if ( !entry.duty ) {
+            if ( entry.value != 0 ) {
+                setBits |= bit;
+            }
+            else {
+                clearBits |= bit;
+            }
+            continue;
+        }
+
+        const double start = getClock();
+        const int result = _backend->setPWMDuty( entry.pin, entry.value );
+        _record( Command::PWMDuty, start );
+
+        if ( result < 0 ) {
+            LogError("Queued PWM duty for pin " << entry.pin << " failed (" << result << ")");
+
+            std::lock_guard<std::mutex> lock( _mutex );
+            _forget( entry.pin );
+        }
+    }
+
+    _sendLevels( setBits, clearBits );
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::_sendLevels( uint32_t setBits, uint32_t clearBits ) {
+    const uint32_t bits = setBits | clearBits;
+    if ( bits == 0 ) {
+        return;
+    }
+
+    int result = 0;
+
+    // a single pin is written as such, which also ends PWM on it like a
+    // synchronous write; the bank commands only set the output levels
+    if ( ( bits & ( bits - 1 ) ) == 0 ) {
+        const unsigned pin = static_cast<unsigned>( __builtin_ctz( bits ) );
+
+        const double start = getClock();
+        result = _backend->write( pin, ( setBits != 0 ) ? 1 : 0 );
+        _record( Command::Write, start );
+    }
+    else {
+        if ( clearBits != 0 ) {
+            const double start = getClock();
+            result = _backend->clearBank1( clearBits );
+            _record( Command::Write, start );
+        }
+
+        if ( setBits != 0 && result >= 0 ) {
+            const double start = getClock();
+            result = _backend->setBank1( setBits );
+            _record( Command::Write, start );
+        }
+    }
+
+    if ( result < 0 ) {
+        LogError("Queued GPIO write failed (" << result << ")");
+
+        std::lock_guard<std::mutex> lock( _mutex );
+        for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+            if ( bits & ( 1u << pin ) ) {
+                _forget( pin );
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::_waitPin( std::unique_lock<std::mutex>& lock, unsigned pin ) {
+    _sent.wait( lock, [this, pin]{ return _pending[pin] == 0; } );
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::_overtake( unsigned pin ) {
+    // must be called with the mutex held; the queued writes are superseded
+    bool dropped = false;
+
+    for ( size_t index = 0; index < _queue.size(); ) {
+        if ( _queue[index].pin == pin ) {
+            _queue.erase( _queue.begin() + index );
+            --_pending[pin];
+            dropped = true;
+        }
+        else {
+            ++index;
+        }
+    }
+
+    // what is left is in flight
+    if ( _pending[pin] > 0 ) {
+        _overtaken[pin] = true;
+    }
+
+    if ( dropped ) {
+        _sent.notify_all();
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::_forget( unsigned pin ) {
+    // must be called with the mutex held
+    _level[pin] = UNKNOWN;
+    _duty[pin]  = UNKNOWN;
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::_record( Command::Value command, double start ) {
+    const double latency = getClock() - start;
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    Statistics& statistics = _statistics[command];
+    ++statistics.roundTrips;
+    statistics.latency    += latency;
+    if ( latency > statistics.maxLatency ) {
+        statistics.maxLatency = latency;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandQueue::_count( Command::Value command, bool coalesced ) {
+    // must be called with the mutex held
+    ++_statistics[command].calls;
+    if ( coalesced ) {
+        ++_statistics[command].coalesced;
+    }
+}
+
+//-----------------------------------------------------------------------------
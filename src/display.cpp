@@ -20,6 +20,14 @@
 #include "logger.h"
 #include "settings.h"
 #include "singleton.h"
+#include "watchdog.h"
+
+//-----------------------------------------------------------------------------
+
+// Watchdog deadline of the render loop in seconds, generous because a stuck
+// display does not endanger the machine; a stall is only logged, it does
+// not switch the heater off
+static const double DISPLAY_WATCHDOG_DEADLINE = 10.0;
 
 //-----------------------------------------------------------------------------
 
@@ -41,6 +49,7 @@ Display::Display()
     ,_currentMode( DisplayMode::MainScreen )
     ,_run( false )
     ,_thread( nullptr )
+    ,_watchdog( -1 )
     ,_mutex( nullptr )
 {
     _open();
@@ -147,6 +156,7 @@ void Display::_open() {
     _opened = true;
     _run = true;
     _mutex = new std::mutex;
+    _watchdog = Singleton<Watchdog>::ready() ? Singleton<Watchdog>::pointer()->add( "display", DISPLAY_WATCHDOG_DEADLINE, false ) : -1;
     _thread = new std::thread( &Display::_worker, this );
 }
 
@@ -159,6 +169,11 @@ void Display::_close() {
         delete _thread;
     }
 
+    if ( _watchdog >= 0 ) {
+        Singleton<Watchdog>::pointer()->remove( _watchdog );
+        _watchdog = -1;
+    }
+
     for ( auto iter = _uiElements.begin(); iter != _uiElements.end(); ++iter ) {
         SDL_FreeSurface( iter->second->surface );
     }
@@ -206,7 +221,16 @@ bool Display::getShutdown() const {
 
 void Display::_handleClickEvent( int x, int y ) {
     if ( _currentMode == DisplayMode::MainScreen ) {
-        if ( _clickedUIElement( _uiElements[ UIElementName::ButtonOneCup ], x, y )) {
+        // while the over-temperature cutoff is tripped the okay button takes
+        // the place of the one cup button and releases it, once the boiler
+        // has cooled down
+        OverTemperature::Trip trip;
+        const bool overTemperature = Singleton<Gaggia>::pointer()->getOverTemperatureTrip( trip );
+
+        if ( overTemperature && _clickedUIElement( _uiElements[ UIElementName::ButtonOkay ], x, y )) {
+            Singleton<Gaggia>::pointer()->resetOverTemperature();
+        }
+        else if ( !overTemperature && _clickedUIElement( _uiElements[ UIElementName::ButtonOneCup ], x, y )) {
             Singleton<Gaggia>::pointer()->extractOneCup();
         }
         else if ( _clickedUIElement( _uiElements[ UIElementName::ButtonTwoCups ], x, y )) {
@@ -239,6 +263,10 @@ void Display::_worker() {
     SDL_Event event;
 
     while ( _run ) {
+        if ( _watchdog >= 0 ) {
+            Singleton<Watchdog>::pointer()->checkIn( _watchdog );
+        }
+
         while( SDL_PollEvent( &event ) ) {
             switch(event.type) {      
                 case SDL_MOUSEBUTTONDOWN: {
@@ -283,7 +311,13 @@ void Display::_render() {
         const Gaggia::State::Value gaggiaState = Singleton<Gaggia>::pointer()->getState();
         const bool gaggiaHeating = Singleton<Gaggia>::pointer()->getPowerRegulator();
 
-        _drawUIElement( _uiElements[ UIElementName::ButtonOneCup ] );
+        OverTemperature::Trip trip;
+        if ( Singleton<Gaggia>::pointer()->getOverTemperatureTrip( trip ) ) {
+            _drawUIElement( _uiElements[ UIElementName::ButtonOkay ] );
+        }
+        else {
+            _drawUIElement( _uiElements[ UIElementName::ButtonOneCup ] );
+        }
         _drawUIElement( _uiElements[ UIElementName::ButtonTwoCups ] );
         
         if ( steamActive ) {
@@ -295,7 +329,12 @@ void Display::_render() {
 
         _drawUIElement( _uiElements[ UIElementName::ButtonShutdown ] );
 
-        const double currentTemperature = Singleton<Gaggia>::pointer()->getBoilerTemperature();
+        // Prefer the filtered estimate, it does not flicker with sensor noise
+        double currentTemperature = 0.0;
+        double predictedTemperature = 0.0;
+        if ( !Singleton<Gaggia>::pointer()->getBoilerEstimate( currentTemperature, predictedTemperature ) ) {
+            currentTemperature = Singleton<Gaggia>::pointer()->getBoilerTemperature();
+        }
         const double targetTemperature  = Singleton<Gaggia>::pointer()->getBoilerTargetTemperature();    
 
         // Current temperature
@@ -314,6 +353,14 @@ void Display::_render() {
         const std::string state = _getStatusText();
         _drawText( _infoFont, 15, 130, state, whiteColor, blackColor );
 
+        // Group head temperature, if that sensor is connected
+        double groupTemperature = 0.0;
+        if ( Singleton<Gaggia>::pointer()->getTemperature( Gaggia::TemperatureSensor::GroupHead, groupTemperature ) ) {
+            text.str( std::string() );
+            text << "Gruppe: " << std::fixed << std::setprecision(1) << groupTemperature << "";
+            _drawText( _infoFont, 225, 130, text.str(), greyColor, blackColor );
+        }
+
         bool showRemainingFlow = false;
         bool extraction = gaggiaState == Gaggia::State::Extracting || gaggiaState == Gaggia::State::ExtractingOneCup || gaggiaState == Gaggia::State::ExtractingTwoCups;
 
@@ -593,6 +640,19 @@ std::string Display::_getStatusText() const {
     const Gaggia::State::Value state = Singleton<Gaggia>::pointer()->getState();
     std::stringstream text;
 
+    // A latched over-temperature or watchdog trip overrides everything else
+    OverTemperature::Trip trip;
+    if ( Singleton<Gaggia>::pointer()->getOverTemperatureTrip( trip ) ) {
+        text << "bertemperatur, Boiler aus";
+        return text.str();
+    }
+
+    std::string stalledThread;
+    if ( Singleton<Gaggia>::pointer()->getWatchdogTrip( stalledThread ) ) {
+        text << "Watchdog: " << stalledThread << " hngt, Boiler aus";
+        return text.str();
+    }
+
     switch ( state ) {
         case Gaggia::State::Deactivated: {
             text << "Boiler Deaktiviert";
@@ -0,0 +1,252 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string>
+
+#include "edgenotifier.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// largest number of reports read at once
+static const size_t NOTIFY_BATCH = 64;
+
+/// time the worker waits for reports before checking for shutdown (ms)
+static const int NOTIFY_POLL_MS = 100;
+
+//-----------------------------------------------------------------------------
+
+EdgeNotifier::EdgeNotifier()
+    :_opened( false )
+    ,_backend( nullptr )
+    ,_handle( -1 )
+    ,_pipe( -1 )
+    ,_bits( 0 )
+    ,_level( 0 )
+    ,_sequence( 0 )
+    ,_started( false )
+    ,_statistics()
+    ,_run( false )
+{
+    for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+        _pins[pin].edgeCallback = nullptr;
+        _pins[pin].userData     = nullptr;
+        _pins[pin].edge         = EITHER_EDGE;
+    }
+
+    _open();
+}
+
+//-----------------------------------------------------------------------------
+
+EdgeNotifier::~EdgeNotifier() {
+    _close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool EdgeNotifier::ready() const {
+    return _opened;
+}
+
+//-----------------------------------------------------------------------------
+
+bool EdgeNotifier::add( unsigned pin, unsigned edge, GPIOBackend::EdgeCallback edgeCallback, void* userData ) {
+    if ( !_opened || pin >= MAX_PINS ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    _pins[pin].edgeCallback = edgeCallback;
+    _pins[pin].userData     = userData;
+    _pins[pin].edge         = edge;
+    _bits |= ( 1u << pin );
+
+    return _begin();
+}
+
+//-----------------------------------------------------------------------------
+
+void EdgeNotifier::remove( unsigned pin ) {
+    if ( !_opened || pin >= MAX_PINS ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    _pins[pin].edgeCallback = nullptr;
+    _bits &= ~( 1u << pin );
+
+    _begin();
+}
+
+//-----------------------------------------------------------------------------
+
+void EdgeNotifier::getStatistics( Statistics& statistics ) const {
+    std::lock_guard<std::mutex> lock( _mutex );
+    statistics = _statistics;
+}
+
+//-----------------------------------------------------------------------------
+
+void EdgeNotifier::_open() {
+    if ( !Singleton<PIGPIOManager>::ready() ) {
+        LogError("PIGPIOManager not ready, aborting edge notifier initialization");
+        return;
+    }
+
+    _backend = Singleton<PIGPIOManager>::pointer()->backend();
+
+    _handle = _backend->notifyOpen();
+    if ( _handle < 0 ) {
+        LogError("Could not open a pigpio notification handle");
+        return;
+    }
+
+    const std::string path = _backend->notifyPath( _handle );
+
+    _pipe = open( path.c_str(), O_RDONLY | O_NONBLOCK );
+    if ( _pipe < 0 ) {
+        LogError("Could not open notification pipe " << path);
+        _close();
+        return;
+    }
+
+    _run = true;
+    _thread = std::thread( &EdgeNotifier::_worker, this );
+    _opened = true;
+}
+
+//-----------------------------------------------------------------------------
+
+void EdgeNotifier::_close() {
+    if ( _run ) {
+        _run = false;
+        _thread.join();
+    }
+
+    if ( _handle >= 0 ) {
+        _backend->notifyClose( _handle );
+        _handle = -1;
+    }
+
+    if ( _pipe >= 0 ) {
+        close( _pipe );
+        _pipe = -1;
+    }
+
+    if ( _opened ) {
+        LogInfo("Edge notifier: " << _statistics.edges << " edges from " << _statistics.reports << " reports in "
+            << _statistics.reads << " reads, " << _statistics.gaps << " reports lost");
+    }
+
+    _opened = false;
+}
+
+//-----------------------------------------------------------------------------
+
+bool EdgeNotifier::_begin() {
+    // must be called with the mutex held; the levels of the next report
+    // are taken as they are, not as edges
+    _started = false;
+
+    const int result = ( _bits != 0 ) ? _backend->notifyBegin( _handle, _bits ) : _backend->notifyPause( _handle );
+    if ( result != 0 ) {
+        LogError("Could not update the notification pins (" << result << ")");
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void EdgeNotifier::_dispatch( const gpioReport_t* reports, size_t count ) {
+    // must be called with the mutex held
+    for ( size_t index = 0; index < count; ++index ) {
+        const gpioReport_t& report = reports[index];
+
+        // watchdog, keep alive and event reports carry no level change
+        if ( report.flags & ( PI_NTFY_FLAGS_WDOG | PI_NTFY_FLAGS_ALIVE | PI_NTFY_FLAGS_EVENT ) ) {
+            continue;
+        }
+
+        if ( _started && report.seqno != _sequence ) {
+            _statistics.gaps += static_cast<uint16_t>( report.seqno - _sequence );
+        }
+        _sequence = report.seqno + 1;
+
+        const uint32_t changed = _started ? ( ( report.level ^ _level ) & _bits ) : 0;
+        _level   = report.level;
+        _started = true;
+
+        for ( uint32_t bits = changed; bits != 0; bits &= bits - 1 ) {
+            const unsigned pin = static_cast<unsigned>( __builtin_ctz( bits ) );
+            const bool level = ( report.level >> pin ) & 1;
+            const Pin& entry = _pins[pin];
+
+            if ( ( entry.edge == RISING_EDGE && !level ) || ( entry.edge == FALLING_EDGE && level ) ) {
+                continue;
+            }
+
+            if ( entry.edgeCallback ) {
+                entry.edgeCallback( pin, level ? 1 : 0, report.tick, entry.userData );
+                ++_statistics.edges;
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void EdgeNotifier::_worker() {
+    gpioReport_t reports[NOTIFY_BATCH];
+    size_t pending = 0; // bytes of a report split over two reads
+
+    while ( _run ) {
+        struct pollfd descriptor;
+        descriptor.fd      = _pipe;
+        descriptor.events  = POLLIN;
+        descriptor.revents = 0;
+
+        if ( poll( &descriptor, 1, NOTIFY_POLL_MS ) <= 0 ) {
+            continue;
+        }
+
+        char* buffer = reinterpret_cast<char*>( reports );
+        const ssize_t got = read( _pipe, buffer + pending, sizeof( reports ) - pending );
+        if ( got <= 0 ) {
+            continue;
+        }
+
+        const size_t bytes = pending + static_cast<size_t>( got );
+        const size_t count = bytes / sizeof( gpioReport_t );
+
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            ++_statistics.reads;
+            _statistics.reports += count;
+            _dispatch( reports, count );
+        }
+
+        // keep a partial report for the next read
+        pending = bytes - count * sizeof( gpioReport_t );
+        for ( size_t index = 0; index < pending; ++index ) {
+            buffer[index] = buffer[count * sizeof( gpioReport_t ) + index];
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
@@ -7,3 +7,147 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <stdlib.h>
+#include <fstream>
+
+#include "external_temperature.h"
+#include "timing.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// interval between two readings (ms), a conversion takes about 750ms
+static const unsigned EXTERNAL_POLL_MS = 250;
+
+//-----------------------------------------------------------------------------
+
+ExternalTemperature::ExternalTemperature()
+    :_opened( false )
+    ,_degrees( 0.0 )
+    ,_valid( false )
+    ,_run( false )
+{
+    _open();
+}
+
+//-----------------------------------------------------------------------------
+
+ExternalTemperature::~ExternalTemperature() {
+    _close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool ExternalTemperature::ready() const {
+    return _opened;
+}
+
+//-----------------------------------------------------------------------------
+
+bool ExternalTemperature::getDegrees( double& degrees ) const {
+    if ( !_opened ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    degrees = _degrees;
+    return _valid;
+}
+
+//-----------------------------------------------------------------------------
+
+void ExternalTemperature::_open() {
+    _path = _findSensorPath();
+
+    if ( _path.empty() ) {
+        LogWarning("No DS18B20 found on the 1-wire bus");
+        return;
+    }
+
+    LogInfo("Using DS18B20 at " << _path);
+
+    _run.store( true );
+    _thread = std::thread( &ExternalTemperature::_worker, this );
+    _opened = true;
+}
+
+//-----------------------------------------------------------------------------
+
+void ExternalTemperature::_close() {
+    if ( _run.load() ) {
+        _run.store( false );
+        _thread.join();
+    }
+
+    _opened = false;
+}
+
+//-----------------------------------------------------------------------------
+
+void ExternalTemperature::_worker() {
+    while ( _run.load() ) {
+        // blocks for the conversion time
+        double degrees = 0.0;
+        const bool valid = _readDegrees( _path, degrees );
+
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _degrees = degrees;
+            _valid   = valid;
+        }
+
+        delayms( EXTERNAL_POLL_MS );
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+std::string ExternalTemperature::_findSensorPath() {
+    // open file containing list of W1 slaves
+    std::ifstream slaves(
+            "/sys/bus/w1/devices/w1_bus_master1/w1_master_slaves"
+    );
+    
+    // attempt to read first line of file: the name of the first slave
+    std::string firstSlave;
+    if ( !getline( slaves, firstSlave ) ) return std::string();
+    
+    // construct full path
+    std::string fullPath(
+            std::string("/sys/bus/w1/devices/") + firstSlave + "/w1_slave"
+    );
+    
+    // return to caller
+    return fullPath;
+}
+
+//-----------------------------------------------------------------------------
+
+bool ExternalTemperature::_readDegrees( const std::string& path, double& degrees ) {
+    // attempt to open the sensor
+    std::ifstream sensor( path.c_str() );
+    
+    std::string line;
+    getline( sensor, line );        // CRC check, ends with YES if valid
+
+    if ( line.find("YES") == std::string::npos ) {
+        return false;
+    }
+
+    getline( sensor, line );        // contains temperature at end, e.g. t=12345
+    
+    // if we don't find "t=" then something is wrong
+    size_t pos = line.find("t=");
+    if ( pos == std::string::npos ) return false;
+    
+    // extract just the number, example: 12345
+    line = line.substr( pos+2 );
+    
+    // convert to degrees
+    degrees = static_cast<double>( atoi(line.c_str()) ) / 1000.0;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
@@ -19,6 +19,7 @@
 
 #include "singleton.h"
 #include "logger.h"
+#include "watchdog.h"
 
 // Using the Digmesa FHKSC 932-9521-B flow sensor with 1.2mm diameter bore
 // With flow sensor in situ, pumping fresh water, measured:
@@ -28,10 +29,14 @@
 // Manufacturer data suggests 1925 pulses/l and we trigger on both rising and
 // falling edge which equates to 3850 pulses/l, about 6% difference
 
+// Watchdog deadline of the sampling loop in seconds
+static const double FLOW_WATCHDOG_DEADLINE = 2.0;
+
 //-----------------------------------------------------------------------------
 
-Flow::Flow() 
-    :_opened( false )
+Flow::Flow( unsigned glitchFilter ) 
+    :_glitchFilter( glitchFilter )
+    ,_opened( false )
     ,_state( State::Stopped )
     ,_samplingRate( 50 ) // Gaggia pump works with 50Hz/2 = 25Hz = 40ms, so limit flow measure to the pump intervall
     ,_speedSamplingRate( 500 ) // Speed sampling must be higher, because it is highly affected by noise
@@ -40,6 +45,7 @@ Flow::Flow()
     ,_flowSpeed( 0.0 )
     ,_milliLitrePerCounts( 0.229247353 )
     ,_run( false )    
+    ,_watchdog( -1 )
 {
     _flowPin = nullptr;
     _open();
@@ -118,13 +124,21 @@ void Flow::_open() {
         return;
     }
 
-    if ( !_flowPin->edgeFuncRegister( std::bind( &Flow::_alertFunction, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3 ) ) ) {
+    // pump triac noise otherwise shows up as extra counts; counting copes
+    // with the software filter's late edges, the worker flushes the last
+    if ( _glitchFilter > 0 && !_flowPin->setGlitchFilter( _glitchFilter ) ) {
+        LogWarning("Flow GPIO-Pin glitch filter not available, filtering in software");
+        _flowPin->setMinimumPulse( _glitchFilter );
+    }
+
+    if ( !_flowPin->edgeMethodRegister<Flow, &Flow::_alertFunction>( this ) ) {
         LogError("Flow GPIO-Pin could not register callback");
         _close();
         return;
     }
 
     _run = true;
+    _watchdog = Singleton<Watchdog>::ready() ? Singleton<Watchdog>::pointer()->add( "flow", FLOW_WATCHDOG_DEADLINE ) : -1;
     _thread = std::thread( &Flow::_worker, this );
     _opened = true;
 }
@@ -136,6 +150,11 @@ void Flow::_close() {
         _run = false;
         _thread.join();
     }
+
+    if ( _watchdog >= 0 ) {
+        Singleton<Watchdog>::pointer()->remove( _watchdog );
+        _watchdog = -1;
+    }
     
     if ( _flowPin ) {
         delete _flowPin;
@@ -157,6 +176,14 @@ void Flow::_worker() {
     while ( _run ) {
         delayms( _samplingRate );
 
+        if ( _watchdog >= 0 ) {
+            Singleton<Watchdog>::pointer()->checkIn( _watchdog );
+        }
+
+        // the software filter holds the last edge of a shot until the next
+        // shot, count it now (calls _alertFunction, so not under the mutex)
+        _flowPin->flushEdge();
+
         speedTimer += _samplingRate;
         const bool wasFlowing = flowing;
 
@@ -175,7 +202,7 @@ void Flow::_worker() {
 
             if ( speedTimer >= _speedSamplingRate ) {
                 const unsigned int countSinceLastSample = _count - startCount;
-                _flowSpeed = ( countSinceLastSample / _speedSamplingRate ) * 1000.0;
+                _flowSpeed = ( static_cast<double>( countSinceLastSample ) * _milliLitrePerCounts * 1000.0 ) / static_cast<double>( _speedSamplingRate );
                 
                 startCount = _count;
                 speedTimer = 0;
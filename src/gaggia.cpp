@@ -8,6 +8,7 @@
 //-----------------------------------------------------------------------------
 
 #include <iomanip>
+#include <algorithm>
 
 #include "boiler.h"
 #include "pump.h"
@@ -17,8 +18,10 @@
 #include "ranger.h"
 #include "settings.h"
 #include "regulator.h"
+#include "external_temperature.h"
 #include "pigpiomgr.h"
 #include "timing.h"
+#include "watchdog.h"
 
 #include "singleton.h"
 #include "logger.h"
@@ -27,24 +30,58 @@
 
 // -----------------------------------------------------------------------------------------
 
+// Autotune relay drive, number of oscillations measured and the margin above
+// the target temperature at which the run is aborted
+static const double   AUTOTUNE_AMPLITUDE = 0.5;
+static const unsigned AUTOTUNE_CYCLES    = 4;
+static const double   AUTOTUNE_MARGIN    = 10.0;
+
+// Lowest confidence of the learned boiler model handed to the regulator
+static const double BOILER_MODEL_CONFIDENCE = 0.5;
+
+// Largest boiler target change of one cascade update (C), below the change
+// the regulator times as a transition
+static const double CASCADE_MAX_STEP = 0.3;
+
+// Watchdog deadline of the state machine loop (s)
+static const double GAGGIA_WATCHDOG_DEADLINE = 2.0;
+
+// -----------------------------------------------------------------------------------------
+
 Gaggia::Gaggia( bool activeHeating, bool logging ) 
     :_ready( false )
     ,_logging( logging )
     ,_flowSensor( nullptr )
     ,_tankSensor( nullptr )
     ,_regulator( nullptr )
+    ,_boilerModel( nullptr )
+    ,_overTemperature( nullptr )
+    ,_powerBudget( nullptr )
     ,_tsicSensor( nullptr )
     ,_boilerController( nullptr )
     ,_pumpController( nullptr ) 
+    ,_externalSensor( nullptr )
     ,_currentState( State::Heating )
     ,_oldState( State::Heating )
     ,_preHeatingTime( 30.0 )
+    ,_autotuning( false )
+    ,_autotuneSteam( false )
+    ,_cascadeSource( CascadeSource::Off )
+    ,_cascadeTarget( 0.0 )
+    ,_cascadeSetPoint( 0.0 )
+    ,_cascadeMaxOffset( 0.0 )
     ,_flowOffsetOneCup( 0.0 )
     ,_flowOffsetTwoCups( 0.0 )
     ,_systemStateLog ( nullptr )
     //,_shotStateLog( nullptr )
     ,_run( false )
+    ,_watchdog( -1 )
+    ,_failsafe( -1 )
 {
+    for ( int& channel : _tsicChannels ) {
+        channel = -1;
+    }
+
     _initialize( activeHeating );
 }
 
@@ -77,6 +114,41 @@ double Gaggia::getBoilerTemperature() const {
 
 // -----------------------------------------------------------------------------------------
 
+bool Gaggia::getBoilerEstimate( double& temperature, double& predicted ) const {
+    if ( !_ready ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    double rate = 0.0;
+    return _regulator->getEstimate( temperature, rate, predicted );
+}
+
+// -----------------------------------------------------------------------------------------
+
+bool Gaggia::getTemperature( TemperatureSensor::Value sensor, double& value ) const {
+    if ( !_ready ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _getTsicTemperature( sensor, value );
+}
+
+// -----------------------------------------------------------------------------------------
+
+bool Gaggia::getCascadeTemperature( double& value ) const {
+    if ( !_ready ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _getCascadeTemperature( value );
+}
+
+// -----------------------------------------------------------------------------------------
+
 double Gaggia::getBoilerTargetTemperature() const {
     if ( !_ready ) {
         return 0.0;
@@ -254,7 +326,7 @@ void Gaggia::extractOneCup() {
     }
 
     _extractionTimer->reset();
-    _pumpController->setPower( true );
+    _powerBudget->setPumpPower( true );
 }
 
 // -----------------------------------------------------------------------------------------
@@ -279,11 +351,101 @@ void Gaggia::extractTwoCups() {
     }
 
     _extractionTimer->reset();
-    _pumpController->setPower( true );
+    _powerBudget->setPumpPower( true );
 }
 
 // -----------------------------------------------------------------------------------------
 
+void Gaggia::startAutotune( bool steam ) {
+    if ( !_ready ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    if ( !_regulator->getPower() ) {
+        LogError("Autotune needs the boiler regulator switched on");
+        return;
+    }
+
+    double iGain = 0.0;
+    double pGain = 0.0;
+    double dGain = 0.0;
+    double targetTemperature = 0.0;
+    Singleton<Settings>::pointer()->getRegulatorSettings( steam, iGain, pGain, dGain, targetTemperature );
+
+    _regulator->startAutotune( targetTemperature, AUTOTUNE_AMPLITUDE, AUTOTUNE_CYCLES, targetTemperature + AUTOTUNE_MARGIN );
+    _autotuning = true;
+    _autotuneSteam = steam;
+}
+
+// -----------------------------------------------------------------------------------------
+
+bool Gaggia::getAutotuneRunning() const {
+    if ( !_ready ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _autotuning;
+}
+
+// -----------------------------------------------------------------------------------------
+
+bool Gaggia::getBoilerModel( BoilerModel::Parameters& parameters ) const {
+    if ( !_ready ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _boilerModel->getParameters( parameters );
+}
+
+// -----------------------------------------------------------------------------------------
+
+bool Gaggia::getOverTemperatureTrip( OverTemperature::Trip& trip ) const {
+    if ( !_ready ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _overTemperature->getTrip( trip );
+}
+
+// -----------------------------------------------------------------------------------------
+
+bool Gaggia::resetOverTemperature() {
+    if ( !_ready ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _overTemperature->reset();
+}
+
+// -----------------------------------------------------------------------------------------
+
+bool Gaggia::getWatchdogTrip( std::string& thread ) const {
+    if ( !_ready || !Singleton<Watchdog>::ready() ) {
+        return false;
+    }
+
+    return Singleton<Watchdog>::pointer()->getTrip( thread );
+}
+
+// -----------------------------------------------------------------------------------------
+
+bool Gaggia::getShotPowerReport( PowerBudget::Report& report ) const {
+    if ( !_ready ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _powerBudget->getShotReport( report );
+}
+
+// -----------------------------------------------------------------------------------------
+
 void Gaggia::setSteamMode( bool steam ) {
     if ( !_ready ) {
         return;
@@ -361,7 +523,30 @@ void Gaggia::_initialize( bool activeHeating ) {
 
     LogInfo("Initializing TSIC Sensor");
 
-    _tsicSensor = new TSIC( TSIC_PIN );
+    unsigned flowGlitchFilter = 0;
+    unsigned tsicGlitchFilter = 0;
+    Singleton<Settings>::pointer()->getGlitchFilterSettings( flowGlitchFilter, tsicGlitchFilter );
+
+    // the optional sensors only claim their pins when switched on
+    bool tsicGroupHead = false;
+    bool tsicSteamWand = false;
+    Singleton<Settings>::pointer()->getTsicSensorSettings( tsicGroupHead, tsicSteamWand );
+
+    std::vector<TSIC::Channel> tsicChannels;
+    _tsicChannels[TemperatureSensor::Boiler] = static_cast<int>( tsicChannels.size() );
+    tsicChannels.push_back( TSIC::Channel( TSIC_PIN, GPIOPin::PullUp, true, tsicGlitchFilter ) );
+
+    if ( tsicGroupHead ) {
+        _tsicChannels[TemperatureSensor::GroupHead] = static_cast<int>( tsicChannels.size() );
+        tsicChannels.push_back( TSIC::Channel( TSIC_GROUP_PIN, GPIOPin::PullUp, false, tsicGlitchFilter ) );
+    }
+
+    if ( tsicSteamWand ) {
+        _tsicChannels[TemperatureSensor::SteamWand] = static_cast<int>( tsicChannels.size() );
+        tsicChannels.push_back( TSIC::Channel( TSIC_STEAM_PIN, GPIOPin::PullUp, false, tsicGlitchFilter ) );
+    }
+
+    _tsicSensor = new TSIC( tsicChannels );
 
     if ( !_tsicSensor->ready() ) {
         LogCritical("Initializing TSIC Sensor: Failed");
@@ -369,13 +554,54 @@ void Gaggia::_initialize( bool activeHeating ) {
         return;
     }
     LogInfo("Initializing TSIC Sensor: Success");
+
+    // -----------------------------------------------------------
+    // Cascade source
+    // -----------------------------------------------------------
+
+    int cascadeMode = 0;
+    double cascadeTarget = 0.0;
+    double cascadePGain = 0.0;
+    double cascadeIGain = 0.0;
+    double cascadeMaxOffset = 0.0;
+    Singleton<Settings>::pointer()->getCascadeSettings( cascadeMode, cascadeTarget, cascadePGain, cascadeIGain, cascadeMaxOffset );
+
+    if ( cascadeMode == CascadeSource::GroupHead ) {
+        if ( _tsicChannels[TemperatureSensor::GroupHead] < 0 ) {
+            LogWarning("Cascade control needs the group head TSIC, switch on tsicGroupHead; cascade control off");
+        }
+        else {
+            LogInfo("Cascade control on the group head temperature");
+            _cascadeSource = CascadeSource::GroupHead;
+        }
+    }
+    else if ( cascadeMode == CascadeSource::External ) {
+        LogInfo("Initializing External temperature sensor");
+        _externalSensor = new ExternalTemperature();
+
+        // Not required: without it the boiler target comes from the settings
+        if ( !_externalSensor->ready() ) {
+            LogWarning("Initializing External temperature sensor: Failed, cascade control off");
+            delete _externalSensor;
+            _externalSensor = nullptr;
+        }
+        else {
+            LogInfo("Initializing External temperature sensor: Success");
+            _cascadeSource = CascadeSource::External;
+        }
+    }
      
     // -----------------------------------------------------------
     // Boiler controller
     // -----------------------------------------------------------
 
     LogInfo("Initializing Boiler Controller");
-    _boilerController = new Boiler();
+
+    bool halfCycle = false;
+    unsigned mainsFrequency = 50;
+    Singleton<Settings>::pointer()->getBoilerDriveSettings( halfCycle, mainsFrequency );
+
+    _boilerController = new Boiler( halfCycle ? Boiler::Mode::HalfCycle : Boiler::Mode::PWM, mainsFrequency );
     if ( !_boilerController->ready() ) {
         LogCritical("Initializing Boiler: Failed");
         _deinitialize();
@@ -383,6 +609,25 @@ void Gaggia::_initialize( bool activeHeating ) {
     }
     LogInfo("Initializing Boiler: Success");
 
+    // -----------------------------------------------------------
+    // Over-temperature cutoff
+    // -----------------------------------------------------------
+
+    LogInfo("Initializing Over-temperature cutoff");
+
+    double overTemperatureLimit = 0.0;
+    double overTemperatureRise = 0.0;
+    Singleton<Settings>::pointer()->getOverTemperatureSettings( overTemperatureLimit, overTemperatureRise );
+
+    // Checks the sensor packets itself, the regulator is not involved
+    _overTemperature = new OverTemperature( _boilerController, _tsicSensor, overTemperatureLimit, overTemperatureRise );
+    if ( !_overTemperature->ready() ) {
+        LogCritical("Initializing Over-temperature cutoff: Failed");
+        _deinitialize();
+        return;
+    }
+    LogInfo("Initializing Over-temperature cutoff: Success");
+
     // -----------------------------------------------------------
     // Pump controller
     // -----------------------------------------------------------
@@ -396,6 +641,33 @@ void Gaggia::_initialize( bool activeHeating ) {
     }
     LogInfo("Initializing Pump: Success");
 
+    // -----------------------------------------------------------
+    // Power budget
+    // -----------------------------------------------------------
+
+    LogInfo("Initializing Power budget");
+
+    // The heater power is part of the feedforward model, which the boiler
+    // model below uses as well
+    double feedforwardGain = 0.0;
+    double heaterPower = 0.0;
+    double inletTemperature = 0.0;
+    double pumpFlowRate = 0.0;
+    Singleton<Settings>::pointer()->getFeedforwardSettings( feedforwardGain, heaterPower, inletTemperature, pumpFlowRate );
+
+    double pumpPower = 0.0;
+    double peakPowerLimit = 0.0;
+    double averagePowerLimit = 0.0;
+    Singleton<Settings>::pointer()->getPowerBudgetSettings( pumpPower, peakPowerLimit, averagePowerLimit );
+
+    _powerBudget = new PowerBudget( _boilerController, _pumpController, heaterPower, pumpPower, peakPowerLimit, averagePowerLimit );
+    if ( !_powerBudget->ready() ) {
+        LogCritical("Initializing Power budget: Failed");
+        _deinitialize();
+        return;
+    }
+    LogInfo("Initializing Power budget: Success");
+
     // -----------------------------------------------------------
     // Tank sensor
     // -----------------------------------------------------------
@@ -422,6 +694,8 @@ void Gaggia::_initialize( bool activeHeating ) {
         return;
     }
 
+    _regulator->setPowerBudget( _powerBudget );
+
     // Set PID settings
     _setRegulatorSettings();
     //setSteamMode( false );
@@ -442,12 +716,28 @@ void Gaggia::_initialize( bool activeHeating ) {
 
     LogInfo("Initializing Regulator: Success");
 
+    // -----------------------------------------------------------
+    // Boiler model
+    // -----------------------------------------------------------
+
+    LogInfo("Initializing Boiler model");
+
+    // The inlet water comes from the tank, so it is at room temperature
+    _boilerModel = new BoilerModel( _boilerController, _tsicSensor, inletTemperature );
+    if ( !_boilerModel->ready() ) {
+        LogCritical("Initializing Boiler model: Failed");
+        _deinitialize();
+        return;
+    }
+
+    LogInfo("Initializing Boiler model: Success");
+
     // -----------------------------------------------------------
     // Flow sensor
     // -----------------------------------------------------------
 
     LogInfo("Initializing Flow sensor");
-    _flowSensor = new Flow();
+    _flowSensor = new Flow( flowGlitchFilter );
     if ( !_flowSensor->ready() ) {
         LogCritical("Initializing Flow sensor: Failed");
         _deinitialize();
@@ -489,7 +779,25 @@ void Gaggia::_initialize( bool activeHeating ) {
     _systemTimer->start();
     _extractionTimer->stop();
 
-    _run = true;
+    // -----------------------------------------------------------
+    // Watchdog: a stalled critical worker thread switches the heater and
+    // the pump off; the boiler trip latches until the application restarts.
+    // The pump goes through the power budget, which must know it is off
+    // -----------------------------------------------------------
+
+    if ( Singleton<Watchdog>::ready() ) {
+        Boiler* boiler = _boilerController;
+        PowerBudget* powerBudget = _powerBudget;
+
+        _failsafe = Singleton<Watchdog>::pointer()->addFailsafe( [boiler, powerBudget] {
+            boiler->trip();
+            powerBudget->setPumpPower( false );
+        } );
+
+        _watchdog = Singleton<Watchdog>::pointer()->add( "gaggia", GAGGIA_WATCHDOG_DEADLINE );
+    }
+
+    _run = true;
     _thread = std::thread( &Gaggia::_worker, this );
 
     _ready = true;
@@ -498,9 +806,26 @@ void Gaggia::_initialize( bool activeHeating ) {
 // -----------------------------------------------------------------------------------------
 
 void Gaggia::_deinitialize() {    
-    if ( _run ) {
-        _run = false;
-        _thread.join();
+    if ( _run ) {
+        _run = false;
+        _thread.join();
+    }
+
+    if ( Singleton<Watchdog>::ready() ) {
+        Singleton<Watchdog>::pointer()->remove( _watchdog );
+        Singleton<Watchdog>::pointer()->removeFailsafe( _failsafe );
+    }
+
+    LogInfo("Deinitializing boiler model");
+
+    if ( _boilerModel ) {
+        delete _boilerModel;
+    }
+
+    LogInfo("Deinitializing over-temperature cutoff");
+
+    if ( _overTemperature ) {
+        delete _overTemperature;
     }
 
     LogInfo("Deinitializing regulator");
@@ -509,6 +834,12 @@ void Gaggia::_deinitialize() {
         delete _regulator;
     }
 
+    LogInfo("Deinitializing power budget");
+
+    if ( _powerBudget ) {
+        delete _powerBudget;
+    }
+
     LogInfo("Deinitializing boiler controller");
 
     if ( _boilerController ) {
@@ -527,6 +858,12 @@ void Gaggia::_deinitialize() {
         delete _tsicSensor;
     }
 
+    LogInfo("Deinitializing external temperature sensor");
+
+    if ( _externalSensor ) {
+        delete _externalSensor;
+    }
+
     LogInfo("Deinitializing flow sensor");
 
     if ( _flowSensor ) {
@@ -579,14 +916,22 @@ void Gaggia::_worker() {
     double targetTemperature      = 0.0;
     double timeSinceLastSystemLog = 0.0;
     double timeSinceLastShotLog   = 0.0;
+    double timeSinceLastModel     = 0.0;
+    double timeSinceLastCascade   = 0.0;
 
     const unsigned int systemLogRate = 500;
     const unsigned int shotLogRate   = 50;
     const unsigned int sampleRate    = 25;
+    const unsigned int modelRate     = 10000;
+    const unsigned int cascadeRate   = 1000;
 
     while ( _run ) {
         delayms( sampleRate );
 
+        if ( _watchdog >= 0 ) {
+            Singleton<Watchdog>::pointer()->checkIn( _watchdog );
+        }
+
         // -----------------------------------------------------------
         // Copy current states
         // -----------------------------------------------------------
@@ -617,6 +962,63 @@ void Gaggia::_worker() {
             pumpRunning            = _pumpController->getPower();
         }
 
+        // Water entering the boiler raises its heat demand right away
+        _regulator->setFlow( pumpRunning, flowState == Flow::State::Flowing ? flowSpeed : 0.0 );
+        _boilerModel->setFlow( pumpRunning || flowState == Flow::State::Flowing );
+        _powerBudget->setFlowing( flowState == Flow::State::Flowing );
+
+        // Hand the learned boiler model to the predictive engine once it is
+        // trustworthy; until then it uses its built-in defaults
+        timeSinceLastModel += sampleRate;
+
+        if ( timeSinceLastModel >= modelRate ) {
+            timeSinceLastModel = 0.0;
+
+            BoilerModel::Parameters model;
+            if ( _boilerModel->getParameters( model ) && model.confidence >= BOILER_MODEL_CONFIDENCE ) {
+                _regulator->setBoilerModel( model.heaterGain, model.lossCoefficient, model.ambientTemperature, model.deadTime );
+            }
+        }
+
+        // Cascade outer loop: adjust the boiler target to the brew temperature
+        timeSinceLastCascade += sampleRate;
+
+        if ( timeSinceLastCascade >= cascadeRate ) {
+            std::lock_guard<std::mutex> lock( _mutex );
+
+            _updateCascade( state, 1.0E-3 * timeSinceLastCascade );
+            timeSinceLastCascade = 0.0;
+        }
+
+        // -----------------------------------------------------------
+        // Store the gains of a finished autotune run
+        // -----------------------------------------------------------
+
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+
+            if ( _autotuning && _regulator->getAutotuneState() != Regulator::Autotune::Running ) {
+                _autotuning = false;
+
+                double ultimateGain = 0.0;
+                double ultimatePeriod = 0.0;
+                double iGain = 0.0;
+                double pGain = 0.0;
+                double dGain = 0.0;
+
+                if ( _regulator->getAutotuneResult( ultimateGain, ultimatePeriod, iGain, pGain, dGain ) ) {
+                    Singleton<Settings>::pointer()->setRegulatorGains( _autotuneSteam, iGain, pGain, dGain );
+                    Singleton<Settings>::pointer()->save();
+                    _setRegulatorSettings();
+
+                    LogInfo("Autotune finished, " << ( _autotuneSteam ? "steam" : "default" ) << " gains stored");
+                }
+                else {
+                    LogWarning("Autotune failed, gains unchanged");
+                }
+            }
+        }
+
         // -----------------------------------------------------------
         // State logging
         // -----------------------------------------------------------
@@ -672,7 +1074,7 @@ void Gaggia::_worker() {
                 if ( flowVolumeCorrected >= extractionTarget ) {
                     std::lock_guard<std::mutex> lock( _mutex );
 
-                    _pumpController->setPower( false );
+                    _powerBudget->setPumpPower( false );
                     pumpRunning = false;
 
                     _extractionTimer->stop();
@@ -774,10 +1176,103 @@ void Gaggia::_setRegulatorSettings() {
     if ( _currentState == State::Heating ) {
         double preHeatingTime = 0.0;
         Singleton<Settings>::pointer()->getPreHeatingSettings( preHeatingTime, targetTemperature );
-    }
-
+    }
+
+    // While brewing, the cascade outer loop sets the boiler target around
+    // the configured one, to reach its own target at the group or in the cup
+    if ( _cascadeSource != CascadeSource::Off && !steam && _currentState != State::Heating ) {
+        int cascadeMode = 0;
+        double cascadePGain = 0.0;
+        double cascadeIGain = 0.0;
+        Singleton<Settings>::pointer()->getCascadeSettings( cascadeMode, _cascadeTarget, cascadePGain, cascadeIGain, _cascadeMaxOffset );
+
+        _cascade.setGains( cascadePGain, cascadeIGain, 0.0 );
+        _cascade.setFeedforward( targetTemperature );
+        _cascade.setIntegralLimits( -_cascadeMaxOffset, _cascadeMaxOffset );
+
+        if ( _cascadeSetPoint <= 0.0 ) {
+            _cascadeSetPoint = targetTemperature;
+        }
+
+        targetTemperature = _cascadeSetPoint;
+    }
+
     _regulator->setPIDGains( pGain, iGain, dGain );
     _regulator->setTargetTemperature( targetTemperature );
+
+    bool perSample = false;
+    unsigned decimation = 1;
+    double sampleTimeout = 1.0;
+    Singleton<Settings>::pointer()->getRegulatorTimingSettings( perSample, decimation, sampleTimeout );
+
+    _regulator->setSampling( perSample, decimation, sampleTimeout );
+
+    double feedforwardGain = 0.0;
+    double heaterPower = 0.0;
+    double inletTemperature = 0.0;
+    double pumpFlowRate = 0.0;
+    Singleton<Settings>::pointer()->getFeedforwardSettings( feedforwardGain, heaterPower, inletTemperature, pumpFlowRate );
+
+    _regulator->setFeedforwardModel( feedforwardGain, heaterPower, inletTemperature, pumpFlowRate );
+
+    bool predictive = false;
+    double moveWeight = 0.0;
+    double temperatureMargin = 0.0;
+    Singleton<Settings>::pointer()->getRegulatorEngineSettings( predictive, moveWeight, temperatureMargin );
+
+    _regulator->setEngine( predictive ? Regulator::Engine::Predictive : Regulator::Engine::PID, moveWeight, temperatureMargin );
+}
+
+// -----------------------------------------------------------------------------------------
+
+bool Gaggia::_getCascadeTemperature( double& value ) const {
+    switch ( _cascadeSource ) {
+        case CascadeSource::GroupHead:
+            return _getTsicTemperature( TemperatureSensor::GroupHead, value );
+
+        case CascadeSource::External:
+            return _externalSensor->getDegrees( value );
+
+        default:
+            return false;
+    }
+}
+
+// -----------------------------------------------------------------------------------------
+
+bool Gaggia::_getTsicTemperature( TemperatureSensor::Value sensor, double& value ) const {
+    const int channel = _tsicChannels[sensor];
+    if ( channel < 0 ) {
+        return false;
+    }
+
+    return _tsicSensor->getDegrees( value, static_cast<size_t>( channel ) );
+}
+
+// -----------------------------------------------------------------------------------------
+
+void Gaggia::_updateCascade( State::Value state, double dt ) {
+    // Only while brewing; in the other states the boiler target is held
+    const bool brewing = ( state == State::Active || state == State::Extracting || state == State::ExtractingOneCup || state == State::ExtractingTwoCups );
+    if ( _cascadeSource == CascadeSource::Off || !brewing || _cascadeSetPoint <= 0.0 ) {
+        return;
+    }
+
+    // Hold the boiler target while the source has no reading
+    double measured = 0.0;
+    if ( !_getCascadeTemperature( measured ) ) {
+        return;
+    }
+
+    // Move the boiler target in small steps, which the regulator follows
+    // without timing each one as a transition; limiting the outer loop's
+    // output keeps its integral from running ahead
+    const double minimum = std::max( _cascadeTarget, _cascadeSetPoint - CASCADE_MAX_STEP );
+    const double maximum = std::min( _cascadeTarget + _cascadeMaxOffset, _cascadeSetPoint + CASCADE_MAX_STEP );
+    _cascade.setOutputLimits( minimum, maximum );
+
+    _cascadeSetPoint = _cascade.update( _cascadeTarget, measured, dt );
+    _regulator->setTargetTemperature( _cascadeSetPoint );
 }
 
 // -----------------------------------------------------------------------------------------
@@ -0,0 +1,452 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include <chrono>
+
+#include "gpiobackend.h"
+#include "pigpiomgr.h"
+
+//-----------------------------------------------------------------------------
+
+GPIOBackend::~GPIOBackend() {
+}
+
+#ifndef GPIO_LOCAL
+
+//-----------------------------------------------------------------------------
+// DaemonBackend
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::start() {
+    // guessing this is the same return value as gpioInitialise (undocumented)
+    return pigpio_start( NULL, NULL );
+}
+
+//-----------------------------------------------------------------------------
+
+void DaemonBackend::stop() {
+    pigpio_stop();
+}
+
+//-----------------------------------------------------------------------------
+
+const char* DaemonBackend::name() const {
+    return "pigpiod";
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::setMode( unsigned pin, unsigned mode ) {
+    return set_mode( pin, mode );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::setPullUpDown( unsigned pin, unsigned pull ) {
+    return set_pull_up_down( pin, pull );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::read( unsigned pin ) {
+    return gpio_read( pin );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::write( unsigned pin, unsigned level ) {
+    return gpio_write( pin, level );
+}
+
+//-----------------------------------------------------------------------------
+
+uint32_t DaemonBackend::readBank1() {
+    return read_bank_1();
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::clearBank1( uint32_t bits ) {
+    return clear_bank_1( bits );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::setBank1( uint32_t bits ) {
+    return set_bank_1( bits );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::setPWMDuty( unsigned pin, unsigned duty ) {
+    return set_PWM_dutycycle( pin, duty );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::setPWMRange( unsigned pin, unsigned range ) {
+    return set_PWM_range( pin, range );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::getPWMRealRange( unsigned pin ) {
+    return get_PWM_real_range( pin );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::setPWMFrequency( unsigned pin, unsigned frequency ) {
+    return set_PWM_frequency( pin, frequency );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::getPWMFrequency( unsigned pin ) {
+    return get_PWM_frequency( pin );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::callback( unsigned pin, unsigned edge, EdgeCallback edgeCallback, void* userData ) {
+    return callback_ex( pin, edge, edgeCallback, userData );
+}
+
+//-----------------------------------------------------------------------------
+
+void DaemonBackend::cancelCallback( int id ) {
+    callback_cancel( static_cast<unsigned>( id ) );
+}
+
+//-----------------------------------------------------------------------------
+
+bool DaemonBackend::waitForEdge( unsigned pin, unsigned edge, double seconds ) {
+    return ( wait_for_edge( pin, edge, seconds ) == 1 );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::setGlitchFilter( unsigned pin, unsigned steady ) {
+    return set_glitch_filter( pin, steady );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::setNoiseFilter( unsigned pin, unsigned steady, unsigned active ) {
+    return set_noise_filter( pin, steady, active );
+}
+
+//-----------------------------------------------------------------------------
+
+uint32_t DaemonBackend::getTick() {
+    return get_current_tick();
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::notifyOpen() {
+    return notify_open();
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::notifyBegin( unsigned handle, uint32_t bits ) {
+    return notify_begin( handle, bits );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::notifyPause( unsigned handle ) {
+    return notify_pause( handle );
+}
+
+//-----------------------------------------------------------------------------
+
+int DaemonBackend::notifyClose( unsigned handle ) {
+    return notify_close( handle );
+}
+
+//-----------------------------------------------------------------------------
+
+std::string DaemonBackend::notifyPath( unsigned handle ) const {
+    return "/dev/pigpio" + std::to_string( handle );
+}
+
+#else // GPIO_LOCAL
+
+//-----------------------------------------------------------------------------
+// LocalBackend
+//-----------------------------------------------------------------------------
+
+LocalBackend::LocalBackend() {
+    for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+        _alerts[pin].backend      = this;
+        _alerts[pin].edgeCallback = nullptr;
+        _alerts[pin].userData     = nullptr;
+        _alerts[pin].edge         = EITHER_EDGE;
+        _alerts[pin].waiters.store( 0 );
+        _alerts[pin].rising       = 0;
+        _alerts[pin].falling      = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::start() {
+    // signals stay with the application, it terminates the library itself
+    gpioCfgSetInternals( gpioCfgGetInternals() | PI_CFG_NOSIGHANDLER );
+    return gpioInitialise();
+}
+
+//-----------------------------------------------------------------------------
+
+void LocalBackend::stop() {
+    gpioTerminate();
+}
+
+//-----------------------------------------------------------------------------
+
+const char* LocalBackend::name() const {
+    return "local";
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::setMode( unsigned pin, unsigned mode ) {
+    return gpioSetMode( pin, mode );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::setPullUpDown( unsigned pin, unsigned pull ) {
+    return gpioSetPullUpDown( pin, pull );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::read( unsigned pin ) {
+    return gpioRead( pin );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::write( unsigned pin, unsigned level ) {
+    return gpioWrite( pin, level );
+}
+
+//-----------------------------------------------------------------------------
+
+uint32_t LocalBackend::readBank1() {
+    return gpioRead_Bits_0_31();
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::clearBank1( uint32_t bits ) {
+    return gpioWrite_Bits_0_31_Clear( bits );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::setBank1( uint32_t bits ) {
+    return gpioWrite_Bits_0_31_Set( bits );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::setPWMDuty( unsigned pin, unsigned duty ) {
+    return gpioPWM( pin, duty );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::setPWMRange( unsigned pin, unsigned range ) {
+    return gpioSetPWMrange( pin, range );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::getPWMRealRange( unsigned pin ) {
+    return gpioGetPWMrealRange( pin );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::setPWMFrequency( unsigned pin, unsigned frequency ) {
+    return gpioSetPWMfrequency( pin, frequency );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::getPWMFrequency( unsigned pin ) {
+    return gpioGetPWMfrequency( pin );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::callback( unsigned pin, unsigned edge, EdgeCallback edgeCallback, void* userData ) {
+    if ( pin >= MAX_PINS ) {
+        return PI_BAD_GPIO;
+    }
+
+    std::lock_guard<std::mutex> lock( _waitMutex );
+
+    Alert& alert = _alerts[pin];
+    if ( alert.edgeCallback != nullptr ) {
+        return PI_BAD_GPIO;
+    }
+
+    alert.edgeCallback = edgeCallback;
+    alert.userData     = userData;
+    alert.edge         = edge;
+
+    const int result = _updateAlert( pin );
+    if ( result != 0 ) {
+        alert.edgeCallback = nullptr;
+        return result;
+    }
+
+    return static_cast<int>( pin );
+}
+
+//-----------------------------------------------------------------------------
+
+void LocalBackend::cancelCallback( int id ) {
+    if ( id < 0 || static_cast<unsigned>( id ) >= MAX_PINS ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( _waitMutex );
+
+    // the alert stays while threads wait for an edge on the pin
+    _alerts[id].edgeCallback = nullptr;
+    _updateAlert( static_cast<unsigned>( id ) );
+}
+
+//-----------------------------------------------------------------------------
+
+bool LocalBackend::waitForEdge( unsigned pin, unsigned edge, double seconds ) {
+    if ( pin >= MAX_PINS ) {
+        return false;
+    }
+
+    // the library has no wait; sleep until the alert counts an edge
+    std::unique_lock<std::mutex> lock( _waitMutex );
+
+    Alert& alert = _alerts[pin];
+    alert.waiters.store( alert.waiters.load() + 1 );
+
+    if ( _updateAlert( pin ) != 0 ) {
+        alert.waiters.store( alert.waiters.load() - 1 );
+        return false;
+    }
+
+    const unsigned rising  = alert.rising;
+    const unsigned falling = alert.falling;
+
+    const bool arrived = _edgeArrived.wait_for( lock, std::chrono::duration<double>( seconds ), [&]() {
+        return ( edge != FALLING_EDGE && alert.rising != rising ) || ( edge != RISING_EDGE && alert.falling != falling );
+    } );
+
+    alert.waiters.store( alert.waiters.load() - 1 );
+    _updateAlert( pin );
+
+    return arrived;
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::setGlitchFilter( unsigned pin, unsigned steady ) {
+    return gpioGlitchFilter( pin, steady );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::setNoiseFilter( unsigned pin, unsigned steady, unsigned active ) {
+    return gpioNoiseFilter( pin, steady, active );
+}
+
+//-----------------------------------------------------------------------------
+
+uint32_t LocalBackend::getTick() {
+    return gpioTick();
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::notifyOpen() {
+    return gpioNotifyOpen();
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::notifyBegin( unsigned handle, uint32_t bits ) {
+    return gpioNotifyBegin( handle, bits );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::notifyPause( unsigned handle ) {
+    return gpioNotifyPause( handle );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::notifyClose( unsigned handle ) {
+    return gpioNotifyClose( handle );
+}
+
+//-----------------------------------------------------------------------------
+
+std::string LocalBackend::notifyPath( unsigned handle ) const {
+    return "/dev/pigpio" + std::to_string( handle );
+}
+
+//-----------------------------------------------------------------------------
+
+int LocalBackend::_updateAlert( unsigned pin ) {
+    Alert& alert = _alerts[pin];
+
+    if ( alert.edgeCallback == nullptr && alert.waiters.load() == 0 ) {
+        return gpioSetAlertFuncEx( pin, nullptr, nullptr );
+    }
+
+    return gpioSetAlertFuncEx( pin, &LocalBackend::_alert, &alert );
+}
+
+//-----------------------------------------------------------------------------
+
+void LocalBackend::_alert( int pin, int level, uint32_t tick, void* userData ) {
+    Alert* alert = reinterpret_cast<Alert*>( userData );
+
+    // level 2 is a watchdog timeout, not an edge
+    if ( alert == nullptr || level == PI_TIMEOUT ) {
+        return;
+    }
+
+    if ( alert->waiters.load() > 0 ) {
+        std::lock_guard<std::mutex> lock( alert->backend->_waitMutex );
+        ++( level == 1 ? alert->rising : alert->falling );
+        alert->backend->_edgeArrived.notify_all();
+    }
+
+    if ( alert->edgeCallback == nullptr ) {
+        return;
+    }
+
+    if ( ( alert->edge == RISING_EDGE && level == 0 ) || ( alert->edge == FALLING_EDGE && level == 1 ) ) {
+        return;
+    }
+
+    alert->edgeCallback( static_cast<unsigned>( pin ), static_cast<unsigned>( level ), tick, alert->userData );
+}
+
+#endif // GPIO_LOCAL
+
+//-----------------------------------------------------------------------------
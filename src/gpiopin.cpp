@@ -11,6 +11,7 @@
 #include "timing.h"
 
 #include "pigpiomgr.h"
+#include "edgenotifier.h"
 #include "logger.h"
 #include "singleton.h"
 
@@ -26,6 +27,19 @@ GPIOPin::GPIOPin( unsigned pin )
     ,_edge( Rising )
     ,_edgeFunc( nullptr )
     ,_callbackId( -1 )
+    ,_notified( false )
+    ,_backend( nullptr )
+    ,_edgeObject( nullptr )
+    ,_deliver( nullptr )
+    ,_minimumPulse( 0 )
+    ,_filterStarted( false )
+    ,_lastLevel( false )
+    ,_held( false )
+    ,_heldLevel( false )
+    ,_heldTick( 0 )
+    ,_filtered( false )
+    ,_accepted( 0 )
+    ,_rejected( 0 )
 {
     _open();
 }
@@ -44,7 +58,7 @@ bool GPIOPin::setOutput( bool output ) {
 	}
 
     // set pin to input/output as appropriate
-    if ( set_mode( _pin, output ? PI_OUTPUT : PI_INPUT ) != 0 ) {
+    if ( _backend->setMode( _pin, output ? PI_OUTPUT : PI_INPUT ) != 0 ) {
 		return false;
 	}
 
@@ -62,12 +76,26 @@ bool GPIOPin::setOutput( bool output ) {
 
 //-----------------------------------------------------------------------------
 
+bool GPIOPin::setPullUpDown( GPIOPin::Pull pull ) {
+    if ( !_opened ) {
+        return false;
+    }
+
+    if ( _backend->setPullUpDown( _pin, static_cast<unsigned>(pull) ) != 0 ) {
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
 bool GPIOPin::setState( bool state ) {
     if ( !_opened ) {
 		return false;
 	}
 
-	int result = gpio_write( _pin, state ? 1 : 0 );
+	int result = _backend->write( _pin, state ? 1 : 0 );
     
 	if ( result < 0 ) {
 		switch ( result ) {
@@ -103,7 +131,7 @@ bool GPIOPin::setPWMDuty( unsigned int duty ) {
 		return false;
 	}
 
-    if ( set_PWM_dutycycle( _pin, duty ) < 0 ) {
+    if ( _backend->setPWMDuty( _pin, duty ) < 0 ) {
 	    return false;
 	}
     
@@ -117,7 +145,7 @@ bool GPIOPin::setPWMRange( unsigned int range ) {
 		return false;
 	}
 
-	if ( set_PWM_range( _pin, range ) < 0 ) {
+	if ( _backend->setPWMRange( _pin, range ) < 0 ) {
 	    return false;
 	}
     
@@ -131,7 +159,7 @@ bool GPIOPin::setPWMFrequency( unsigned frequency ) {
 		return false;
 	}
 
-    if ( set_PWM_frequency( _pin, frequency ) < 0 ) {
+    if ( _backend->setPWMFrequency( _pin, frequency ) < 0 ) {
 		return false;
 	}
     
@@ -140,6 +168,28 @@ bool GPIOPin::setPWMFrequency( unsigned frequency ) {
 
 //-----------------------------------------------------------------------------
 
+unsigned GPIOPin::getPWMFrequency() const {
+    if ( !_opened ) {
+        return 0;
+    }
+
+    const int frequency = _backend->getPWMFrequency( _pin );
+    return ( frequency < 0 ) ? 0 : static_cast<unsigned>( frequency );
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned GPIOPin::getPWMRange() const {
+    if ( !_opened ) {
+        return 0;
+    }
+
+    const int range = _backend->getPWMRealRange( _pin );
+    return ( range < 0 ) ? 0 : static_cast<unsigned>( range );
+}
+
+//-----------------------------------------------------------------------------
+
 bool GPIOPin::getState() const {
 	if ( !_opened ) {
 		return false;
@@ -150,12 +200,65 @@ bool GPIOPin::getState() const {
         return _state;
     } else {
         // pin is set as an input: read the actual pin state
-        return ( gpio_read( _pin ) != 0 );
+        return ( _backend->read( _pin ) != 0 );
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+void GPIOPin::setAsync( bool async ) {
+    if ( !_opened ) {
+        return;
+    }
+
+    // without a command queue every write is sent at once anyway
+    CommandQueue* commands = Singleton<PIGPIOManager>::pointer()->commands();
+    if ( commands != nullptr ) {
+        commands->setAsync( _pin, async );
     }
 }
 
 //-----------------------------------------------------------------------------
 
+bool GPIOPin::setStateNow( bool state ) {
+    if ( !_opened ) {
+        return false;
+    }
+
+    CommandQueue* commands = Singleton<PIGPIOManager>::pointer()->commands();
+    const int result = ( commands != nullptr ) ? commands->writeNow( _pin, state ? 1 : 0 ) : _backend->write( _pin, state ? 1 : 0 );
+
+    if ( result < 0 ) {
+        LogError("GPIOPin::setStateNow - failed on pin " << _pin);
+        return false;
+    }
+
+    _state = state;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool GPIOPin::setPWMDutyNow( unsigned int duty ) {
+    if ( !_opened ) {
+        return false;
+    }
+
+    CommandQueue* commands = Singleton<PIGPIOManager>::pointer()->commands();
+    const int result = ( commands != nullptr ) ? commands->setPWMDutyNow( _pin, duty ) : _backend->setPWMDuty( _pin, duty );
+
+    if ( result < 0 ) {
+        LogError("GPIOPin::setPWMDutyNow - failed on pin " << _pin);
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
 bool GPIOPin::usPulse( bool state, unsigned us ) {
     if ( !setState( state ) ) {
 		return false;
@@ -189,7 +292,7 @@ bool GPIOPin::msPulse( bool state, unsigned ms ) {
 //-----------------------------------------------------------------------------
 
 bool GPIOPin::setEdgeTrigger( GPIOPin::Edge edge ) {
-    if ( !_opened || _edgeFunc ) {
+    if ( !_opened || _callbackId >= 0 || _notified ) {
         return false;
     }
     
@@ -220,29 +323,110 @@ bool GPIOPin::edgeFuncRegister( EdgeFunc edgeFunc ) {
 
     // install the function
     _edgeFunc = edgeFunc;
+    _deliver  = &GPIOPin::_funcDeliver;
 
-    // register a callback
-    unsigned edge = static_cast<unsigned>(_edge);
-    _callbackId = callback_ex( _pin, edge, local::callback, this );
-
-    return true;
+    return _edgeRegister( local::callback, this );
 }//edgeFuncRegister
 
 //-----------------------------------------------------------------------------
 
 void GPIOPin::edgeFuncCancel() {
+    // stop the notifications
+    if ( _notified ) {
+        if ( Singleton<EdgeNotifier>::ready() ) {
+            Singleton<EdgeNotifier>::pointer()->remove( _pin );
+        }
+        _notified = false;
+    }
+
     // cancel the pigpiod callback
     if ( _callbackId >= 0 ) {
-        callback_cancel( _callbackId );
+        _backend->cancelCallback( _callbackId );
         _callbackId = -1;
     }
 
     // remove the user function
-    _edgeFunc = nullptr;
+    _edgeFunc   = nullptr;
+    _edgeObject = nullptr;
+    _deliver    = nullptr;
 }//edgeFuncCancel
 
 //-----------------------------------------------------------------------------
 
+bool GPIOPin::setGlitchFilter( unsigned steady ) {
+    if ( !_opened ) {
+        return false;
+    }
+
+    // no silent software fallback: holding edges would delay the pin's
+    // edges, which a decoder may not cope with
+    if ( _backend->setGlitchFilter( _pin, steady ) != 0 ) {
+        return false;
+    }
+
+    _filtered = ( steady > 0 );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool GPIOPin::setNoiseFilter( unsigned steady, unsigned active ) {
+    if ( !_opened ) {
+        return false;
+    }
+
+    if ( _backend->setNoiseFilter( _pin, steady, active ) != 0 ) {
+        return false;
+    }
+
+    _filtered = ( steady > 0 );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool GPIOPin::setMinimumPulse( unsigned us ) {
+    // the callback thread reads it without the lock
+    if ( _callbackId >= 0 || _notified ) {
+        return false;
+    }
+
+    _minimumPulse = us;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool GPIOPin::flushEdge() {
+    if ( _minimumPulse == 0 || _deliver == nullptr ) {
+        return false;
+    }
+
+    // delivered with the lock held, so a later edge cannot overtake it
+    std::lock_guard<std::mutex> lock( _filterMutex );
+
+    if ( !_held || _backend->getTick() - _heldTick < _minimumPulse ) {
+        return false;
+    }
+
+    _held          = false;
+    _filterStarted = true;
+    _lastLevel     = _heldLevel;
+
+    _accepted.fetch_add( 1, std::memory_order_relaxed );
+    _deliver( this, _heldLevel, static_cast<unsigned>( _heldTick ) );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void GPIOPin::getEdgeCounts( unsigned& accepted, unsigned& rejected ) const {
+    accepted = _accepted.load( std::memory_order_relaxed );
+    rejected = _rejected.load( std::memory_order_relaxed );
+}
+
+//-----------------------------------------------------------------------------
+
 bool GPIOPin::poll( unsigned timeout ) {
     // check that the device is open
     if ( !_opened ) {
@@ -254,13 +438,16 @@ bool GPIOPin::poll( unsigned timeout ) {
 
     // wait for specified edge
     unsigned edge = static_cast<unsigned>(_edge);
-    return ( wait_for_edge( _pin, edge, seconds ) == 1 );
+    return _backend->waitForEdge( _pin, edge, seconds );
 }//poll
 
 //-----------------------------------------------------------------------------
 
 bool GPIOPin::_open() {
     _opened = Singleton<PIGPIOManager>::ready();
+    if ( _opened ) {
+        _backend = Singleton<PIGPIOManager>::pointer()->backend();
+    }
     _edge = Rising;
     return _opened;
 }
@@ -271,6 +458,23 @@ void GPIOPin::_close() {
     // close any callback function
     edgeFuncCancel();
 
+    // later users of the pin wait for their writes again
+    setAsync( false );
+
+    // pigpiod keeps filters after we are gone
+    if ( _filtered ) {
+        _backend->setGlitchFilter( _pin, 0 );
+        _backend->setNoiseFilter( _pin, 0, 0 );
+        _filtered = false;
+    }
+
+    unsigned accepted = 0;
+    unsigned rejected = 0;
+    getEdgeCounts( accepted, rejected );
+    if ( accepted + rejected > 0 ) {
+        LogInfo("GPIO pin " << _pin << ": " << accepted << " edges accepted, " << rejected << " rejected");
+    }
+
     // always set back to an input when closed
     setOutput( false );
 
@@ -279,14 +483,45 @@ void GPIOPin::_close() {
 
 //-----------------------------------------------------------------------------
 
+bool GPIOPin::_edgeRegister( GPIOBackend::EdgeCallback edgeCallback, void* userData ) {
+    // the software filter starts afresh
+    {
+        std::lock_guard<std::mutex> lock( _filterMutex );
+        _filterStarted = false;
+        _held          = false;
+    }
+
+    // take the edges from the notification pipe when it is running
+    unsigned edge = static_cast<unsigned>(_edge);
+    if ( Singleton<EdgeNotifier>::ready() ) {
+        _notified = Singleton<EdgeNotifier>::pointer()->add( _pin, edge, edgeCallback, userData );
+        if ( _notified ) {
+            return true;
+        }
+    }
+
+    // register a callback
+    _callbackId = _backend->callback( _pin, edge, edgeCallback, userData );
+
+    return ( _callbackId >= 0 );
+}
+
+//-----------------------------------------------------------------------------
+
 void GPIOPin::_callback( unsigned pin, bool level, unsigned tick) {
-    if ( _edgeFunc ) {
+    if ( _edgeFunc && _accept( level, tick ) ) {
 		_edgeFunc( pin, level, tick );
 	}
 }
 
 //-----------------------------------------------------------------------------
 
+void GPIOPin::_funcDeliver( GPIOPin* self, bool level, unsigned tick ) {
+    self->_edgeFunc( self->_pin, level, tick );
+}
+
+//-----------------------------------------------------------------------------
+
 bool GPIOPin::ready() const {
     return _opened;
 }
@@ -0,0 +1,222 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include <math.h>
+
+#include "kalman.h"
+
+//-----------------------------------------------------------------------------
+
+/// variance of a TSIC reading (C^2): 0.1C steps plus some noise
+static const double KALMAN_MEASUREMENT_VARIANCE = 0.04 * 0.04;
+
+/// process noise of the temperature (C^2/s) and of the rate ((C/s)^2/s),
+/// covering the errors of the boiler model
+static const double KALMAN_TEMPERATURE_NOISE = 1.0E-4;
+static const double KALMAN_RATE_NOISE        = 2.0E-3;
+
+/// factor on the process noise while water flows in, which cools the
+/// boiler by up to a few C/s in a way the model does not know of
+static const double KALMAN_FLOW_NOISE_FACTOR = 100.0;
+
+/// readings further off the prediction than this many standard deviations
+/// are rejected
+static const double KALMAN_GATE = 5.0;
+
+/// rejected readings in a row after which the filter restarts
+static const unsigned KALMAN_MAX_REJECTED = 3;
+
+/// shortest lag used for the dead time (s)
+static const double KALMAN_MINIMUM_LAG = 0.5;
+
+//-----------------------------------------------------------------------------
+
+Kalman::Kalman()
+    :_heaterGain( 1.4 )
+    ,_lossCoefficient( 0.0012 )
+    ,_ambient( 20.0 )
+    ,_lagTime( 4.0 )
+    ,_rejected( 0 )
+    ,_flowing( false )
+    ,_started( false )
+{
+    reset();
+}
+
+//-----------------------------------------------------------------------------
+
+void Kalman::setModel( double heaterGain, double lossCoefficient, double ambientTemperature, double deadTime ) {
+    if ( heaterGain <= 0.0 || lossCoefficient <= 0.0 ) {
+        return;
+    }
+
+    _heaterGain      = heaterGain;
+    _lossCoefficient = lossCoefficient;
+    _ambient         = ambientTemperature;
+    _lagTime         = deadTime > KALMAN_MINIMUM_LAG ? deadTime : KALMAN_MINIMUM_LAG;
+}
+
+//-----------------------------------------------------------------------------
+
+void Kalman::reset() {
+    _x[0] = 0.0;
+    _x[1] = 0.0;
+
+    _p[0][0] = 0.0;
+    _p[0][1] = 0.0;
+    _p[1][0] = 0.0;
+    _p[1][1] = 0.0;
+
+    _rejected = 0;
+    _started  = false;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Kalman::started() const {
+    return _started;
+}
+
+//-----------------------------------------------------------------------------
+
+void Kalman::predict( double drive, double dt ) {
+    if ( !_started || dt <= 0.0 ) {
+        return;
+    }
+
+    double f[2][2];
+    double input  = 0.0;
+    double offset = 0.0;
+    _transition( dt, f, input, offset );
+
+    // x = F x + B u + c
+    const double temperature = f[0][0] * _x[0] + f[0][1] * _x[1];
+    const double rate        = f[1][0] * _x[0] + f[1][1] * _x[1] + input * drive + offset;
+    _x[0] = temperature;
+    _x[1] = rate;
+
+    // P = F P F' + Q
+    double fp[2][2];
+    for ( unsigned row = 0; row < 2; ++row ) {
+        for ( unsigned column = 0; column < 2; ++column ) {
+            fp[row][column] = f[row][0] * _p[0][column] + f[row][1] * _p[1][column];
+        }
+    }
+
+    for ( unsigned row = 0; row < 2; ++row ) {
+        for ( unsigned column = 0; column < 2; ++column ) {
+            _p[row][column] = fp[row][0] * f[column][0] + fp[row][1] * f[column][1];
+        }
+    }
+
+    const double noise = _flowing ? KALMAN_FLOW_NOISE_FACTOR : 1.0;
+    _p[0][0] += noise * KALMAN_TEMPERATURE_NOISE * dt;
+    _p[1][1] += noise * KALMAN_RATE_NOISE * dt;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Kalman::correct( double temperature ) {
+    if ( !_started ) {
+        // start at the reading, the rate is not known yet
+        _x[0] = temperature;
+        _x[1] = 0.0;
+
+        _p[0][0] = KALMAN_MEASUREMENT_VARIANCE;
+        _p[0][1] = 0.0;
+        _p[1][0] = 0.0;
+        _p[1][1] = 1.0;
+
+        _rejected = 0;
+        _started  = true;
+        return true;
+    }
+
+    const double innovation = temperature - _x[0];
+    const double variance   = _p[0][0] + KALMAN_MEASUREMENT_VARIANCE;
+
+    if ( innovation * innovation > KALMAN_GATE * KALMAN_GATE * variance ) {
+        if ( ++_rejected < KALMAN_MAX_REJECTED ) {
+            return false;
+        }
+
+        // the readings agree with each other, not with the estimate
+        _started = false;
+        return correct( temperature );
+    }
+
+    _rejected = 0;
+
+    // the reading measures the temperature only: H = ( 1, 0 )
+    const double gain0 = _p[0][0] / variance;
+    const double gain1 = _p[1][0] / variance;
+
+    _x[0] += gain0 * innovation;
+    _x[1] += gain1 * innovation;
+
+    // P = ( I - K H ) P
+    const double p00 = _p[0][0];
+    const double p01 = _p[0][1];
+
+    _p[0][0] -= gain0 * p00;
+    _p[0][1] -= gain0 * p01;
+    _p[1][0] -= gain1 * p00;
+    _p[1][1] -= gain1 * p01;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void Kalman::setFlowing( bool flowing ) {
+    _flowing = flowing;
+}
+
+
+//-----------------------------------------------------------------------------
+
+double Kalman::getTemperature() const {
+    return _x[0];
+}
+
+//-----------------------------------------------------------------------------
+
+double Kalman::getRate() const {
+    return _x[1];
+}
+
+//-----------------------------------------------------------------------------
+
+double Kalman::getUncertainty() const {
+    return sqrt( _p[0][0] > 0.0 ? _p[0][0] : 0.0 );
+}
+
+//-----------------------------------------------------------------------------
+
+double Kalman::getPrediction( double dt ) const {
+    return _x[0] + _x[1] * dt;
+}
+
+//-----------------------------------------------------------------------------
+
+void Kalman::_transition( double dt, double f[2][2], double& input, double& offset ) const {
+    // the rate relaxes towards the model rate with the lag; the temperature
+    // integrates the rate (first order in dt, dt is well below the lag)
+    const double relax = 1.0 - exp( -dt / _lagTime );
+
+    f[0][0] = 1.0;
+    f[0][1] = dt;
+    f[1][0] = -relax * _lossCoefficient;
+    f[1][1] = 1.0 - relax;
+
+    input  = relax * _heaterGain;
+    offset = relax * _lossCoefficient * _ambient;
+}
+
+//-----------------------------------------------------------------------------
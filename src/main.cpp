@@ -20,6 +20,7 @@
 
 #include "settings.h"
 #include "gaggia.h"
+#include "edgenotifier.h"
 
 #include "singleton.h"
 #include "logger.h"
@@ -33,6 +34,7 @@
 #include "settings.h"
 #include "regulator.h"
 #include "pigpiomgr.h"
+#include "watchdog.h"
 
 // -----------------------------------------------------------------------------------------
 
@@ -41,6 +43,8 @@ static const char* CMD_HELP_SHORT  = "-h";
 static const char* CMD_HELP_LONG   = "--help";
 static const char* CMD_BOILER_OFF  = "--boiler-off";
 static const char* CMD_LOG_STATS   = "--log-stats";
+static const char* CMD_AUTOTUNE    = "--autotune";
+static const char* CMD_AUTOTUNE_STEAM = "--autotune-steam";
 
 // -----------------------------------------------------------------------------------------
 
@@ -48,6 +52,8 @@ bool shouldQuit = false;
 bool shutdownRaspberry = false;
 bool logStates = false;
 bool boilerActive = true;
+bool autotune = false;
+bool autotuneSteam = false;
 
 // -----------------------------------------------------------------------------------------
 
@@ -58,46 +64,6 @@ bool hookSignals();
 void setPriority();
 void printHelpText( int argc, char** argv );
 
-
-
-std::string findSensorPath() {
-    // open file containing list of W1 slaves
-    std::ifstream slaves(
-            "/sys/bus/w1/devices/w1_bus_master1/w1_master_slaves"
-    );
-    
-    // attempt to read first line of file: the name of the first slave
-    std::string firstSlave;
-    if ( !getline( slaves, firstSlave ) ) return std::string();
-    
-    // construct full path
-    std::string fullPath(
-            std::string("/sys/bus/w1/devices/") + firstSlave + "/w1_slave"
-    );
-    
-    // return to caller
-    return fullPath;
-}
-
-double getDegrees(const std::string& path) {
-    // attempt to open the sensor
-    std::ifstream sensor( path.c_str() );
-    
-    std::string line;
-    getline( sensor, line );        // discard first line
-    getline( sensor, line );        // contains temperature at end, e.g. t=12345
-    
-    // if we don't find "t=" then something is wrong
-    size_t pos = line.find("t=");
-    if ( pos == std::string::npos ) return -1.0;
-    
-    // extract just the number, example: 12345
-    line = line.substr( pos+2 );
-    
-    // convert to degrees
-    return static_cast<double>( atoi(line.c_str()) ) / 1000.0;
-}
-
 // -----------------------------------------------------------------------------------------
 
 void signalHandler( int signal ) {
@@ -156,39 +122,73 @@ bool initialize() {
     LogInfo("Application started");
 
     // -----------------------------------------------------------
-    // Initialize GPIO system
+    // Initialize settings (they select the GPIO backend)
     // -----------------------------------------------------------
 
-    LogInfo("Initializing GPIO");
+    LogInfo("Initializing Settings");
 
-    Singleton<PIGPIOManager>::initialize( new PIGPIOManager() );
+    Singleton<Settings>::initialize( new Settings() );
 
-    if ( !Singleton<PIGPIOManager>::ready() ) {
-        LogCritical("Initializing GPIO: Failed");
+    if ( !Singleton<Settings>::ready() ) {
+        LogCritical("Initializing Settings: Failed");
         deinitialize();
         return false;
     }
 
-    LogInfo("Initializing GPIO: Success");
+    const std::string path = Singleton<Settings>::pointer()->getPath();
+    LogInfo("Path: " << path);
+
+    LogInfo("Initializing Settings: Success");
 
     // -----------------------------------------------------------
-    // Initialize settings
+    // Initialize watchdog (before GPIO, its command worker registers)
     // -----------------------------------------------------------
 
-    LogInfo("Initializing Settings");
+    LogInfo("Initializing Watchdog");
 
-    Singleton<Settings>::initialize( new Settings() );
+    Singleton<Watchdog>::initialize( new Watchdog( Singleton<Settings>::pointer()->getHardwareWatchdog() ) );
 
-    if ( !Singleton<Settings>::ready() ) {
-        LogCritical("Initializing Settings: Failed");
+    if ( !Singleton<Watchdog>::pointer()->ready() ) {
+        LogCritical("Initializing Watchdog: Failed");
         deinitialize();
         return false;
     }
 
-    const std::string path = Singleton<Settings>::pointer()->getPath();
-    LogInfo("Path: " << path);
+    LogInfo("Initializing Watchdog: Success");
 
-    LogInfo("Initializing Settings: Success");
+    // -----------------------------------------------------------
+    // Initialize GPIO system
+    // -----------------------------------------------------------
+
+    LogInfo("Initializing GPIO");
+
+    const bool localGPIO = ( Singleton<Settings>::pointer()->getGPIOBackend() == 1 );
+    Singleton<PIGPIOManager>::initialize( new PIGPIOManager( localGPIO ) );
+
+    if ( !Singleton<PIGPIOManager>::pointer()->ready() ) {
+        LogCritical("Initializing GPIO: Failed");
+        deinitialize();
+        return false;
+    }
+
+    LogInfo("Initializing GPIO: Success");
+
+    // -----------------------------------------------------------
+    // Initialize edge notifier (optional, before any pin registers)
+    // -----------------------------------------------------------
+
+    if ( Singleton<Settings>::pointer()->getEdgeBackend() == 1 ) {
+        LogInfo("Initializing Edge notifier");
+
+        Singleton<EdgeNotifier>::initialize( new EdgeNotifier() );
+
+        if ( !Singleton<EdgeNotifier>::pointer()->ready() ) {
+            LogWarning("Initializing Edge notifier: Failed, using pigpiod callbacks");
+            Singleton<EdgeNotifier>::deinitialize();
+        } else {
+            LogInfo("Initializing Edge notifier: Success");
+        }
+    }
 
     // -----------------------------------------------------------
     // Initialize Gaggia controller
@@ -252,12 +252,8 @@ void deinitialize() {
         LogInfo("Hardware systems offline");
     }
 
-    if ( Singleton<Settings>::ready() ) {
-        Singleton<Settings>::deinitialize();
-    }
-    
-    if ( activeLog ) {
-        LogInfo("Settings offline");
+    if ( Singleton<EdgeNotifier>::ready() ) {
+        Singleton<EdgeNotifier>::deinitialize();
     }
 
     if ( Singleton<PIGPIOManager>::ready() ) {
@@ -268,6 +264,22 @@ void deinitialize() {
         LogInfo("GPIO system offline");
     }
 
+    if ( Singleton<Watchdog>::ready() ) {
+        Singleton<Watchdog>::deinitialize();
+    }
+
+    if ( activeLog ) {
+        LogInfo("Watchdog offline");
+    }
+
+    if ( Singleton<Settings>::ready() ) {
+        Singleton<Settings>::deinitialize();
+    }
+    
+    if ( activeLog ) {
+        LogInfo("Settings offline");
+    }
+
     if ( activeLog ) {
         LogInfo("All systems properly deinitialized, application is closing");
     }
@@ -322,6 +334,8 @@ void printHelpText(int argc, char** argv) {
         << "  " << CMD_START_DELAY << " N\tWait N seconds before starting" << std::endl
         << "  " << CMD_BOILER_OFF << "\t\tNo heating" << std::endl
         << "  " << CMD_LOG_STATS << "\t\tLog all stats into file" << std::endl
+        << "  " << CMD_AUTOTUNE << "\t\tTune the brew PID gains and store them" << std::endl
+        << "  " << CMD_AUTOTUNE_STEAM << "\tTune the steam PID gains and store them" << std::endl
         << "  " << CMD_HELP_LONG << " or " << CMD_HELP_SHORT << "\t\tPrint this message and exit" << std::endl
         << "\n";
 }
@@ -352,6 +366,13 @@ int main(int argc, char** argv) {
             else if ( strcmp( argv[ i ], CMD_LOG_STATS ) == 0 ) {
                 logStates = true;
             }
+            else if ( strcmp( argv[ i ], CMD_AUTOTUNE ) == 0 ) {
+                autotune = true;
+            }
+            else if ( strcmp( argv[ i ], CMD_AUTOTUNE_STEAM ) == 0 ) {
+                autotune = true;
+                autotuneSteam = true;
+            }
             else if ( strcmp( argv[ i ], CMD_HELP_SHORT ) == 0 || strcmp( argv[ i ], CMD_HELP_LONG ) == 0 ) {
                 printHelpText( argc, argv );
                 exit(0);
@@ -389,12 +410,20 @@ int main(int argc, char** argv) {
 
     LogInfo("All systems properly initialized, entering controller loop");
 
+    // -----------------------------------------------------------
+    // Relay autotune, runs alongside normal operation
+    // -----------------------------------------------------------
+
+    if ( autotune ) {
+        LogInfo("Starting " << ( autotuneSteam ? "steam" : "brew" ) << " autotune");
+        Singleton<Gaggia>::pointer()->startAutotune( autotuneSteam );
+    }
+
     // -----------------------------------------------------------
     // Main loop
     // -----------------------------------------------------------
   
     const unsigned int samplingRate = 500;
-    const std::string sensorPath = findSensorPath();
   
     //Gaggia* gaggia = Singleton<Gaggia>::pointer();
     Display* display = Singleton<Display>::pointer();
@@ -407,10 +436,6 @@ int main(int argc, char** argv) {
             shouldQuit = true;
         }
 
-        // Print DS18B20 output for getting boiler->water output offset
-        //double degrees = getDegrees( sensorPath );
-        //LogInfo("Extern Degrees: " << degrees);
-
         delayms( samplingRate );
     }
 
@@ -0,0 +1,395 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include <math.h>
+#include <algorithm>
+
+#include "mpc.h"
+#include "timing.h"
+
+//-----------------------------------------------------------------------------
+
+const double MPC::BLOCK_TIME = 5.0;
+
+/// projected gradient iterations per update
+static const unsigned MPC_ITERATIONS = 60;
+
+/// time constant of the disturbance estimate (s)
+static const double MPC_DISTURBANCE_TIME = 20.0;
+
+/// shortest heater lag used for the dead time (s), keeps the model stiff
+/// enough to discretize without a special case
+static const double MPC_MINIMUM_LAG = 0.5;
+
+/// smallest step response entry used by the constraint pass
+static const double MPC_MINIMUM_STEP = 1.0E-6;
+
+//-----------------------------------------------------------------------------
+
+MPC::MPC()
+    :_heaterGain( 1.4 )
+    ,_lossCoefficient( 0.0012 )
+    ,_ambient( 20.0 )
+    ,_lagTime( 4.0 )
+    ,_moveWeight( 20.0 )
+    ,_outputMin( 0.0 )
+    ,_outputMax( 1.0 )
+    ,_temperatureMax( 1.0E3 )
+    ,_feedforward( 0.0 )
+    ,_stepSize( 0.0 )
+    ,_heater( 0.0 )
+    ,_disturbance( 0.0 )
+    ,_lastPosition( 0.0 )
+    ,_lastDrive( 0.0 )
+    ,_started( false )
+    ,_lastSolveTime( 0.0 )
+    ,_worstSolveTime( 0.0 )
+{
+    for ( size_t i = 0; i < HORIZON; ++i ) {
+        _plan[i]       = 0.0;
+        _prediction[i] = 0.0;
+    }
+
+    _precompute();
+}
+
+//-----------------------------------------------------------------------------
+
+void MPC::setModel( double heaterGain, double lossCoefficient, double ambientTemperature, double deadTime ) {
+    if ( heaterGain <= 0.0 || lossCoefficient <= 0.0 ) {
+        return;
+    }
+
+    _heaterGain      = heaterGain;
+    _lossCoefficient = lossCoefficient;
+    _ambient         = ambientTemperature;
+
+    // the lag must stay faster than the losses, see _discretize
+    _lagTime = _clamp( deadTime, MPC_MINIMUM_LAG, 0.5 / lossCoefficient );
+
+    _precompute();
+}
+
+//-----------------------------------------------------------------------------
+
+void MPC::setMoveWeight( double moveWeight ) {
+    _moveWeight = moveWeight > 0.0 ? moveWeight : 0.0;
+    _precompute();
+}
+
+//-----------------------------------------------------------------------------
+
+void MPC::setOutputLimits( double minimum, double maximum ) {
+    _outputMin = minimum;
+    _outputMax = maximum;
+}
+
+//-----------------------------------------------------------------------------
+
+void MPC::setTemperatureLimit( double maximum ) {
+    _temperatureMax = maximum;
+}
+
+//-----------------------------------------------------------------------------
+
+void MPC::setFeedforward( double feedforward ) {
+    _feedforward = feedforward;
+}
+
+//-----------------------------------------------------------------------------
+
+void MPC::setAppliedOutput( double applied ) {
+    if ( !_started ) {
+        return;
+    }
+
+    _lastDrive = applied - _feedforward;
+}
+
+//-----------------------------------------------------------------------------
+
+void MPC::reset() {
+    for ( size_t i = 0; i < HORIZON; ++i ) {
+        _plan[i] = 0.0;
+    }
+
+    _heater      = 0.0;
+    _disturbance = 0.0;
+    _lastDrive   = 0.0;
+    _started     = false;
+}
+
+//-----------------------------------------------------------------------------
+
+double MPC::update( double setPoint, double position, double dt ) {
+    const double start = getClock();
+
+    if ( dt < 0.0 ) {
+        dt = 0.0;
+    }
+
+    if ( !_started ) {
+        // assume the boiler was settled at its current drive
+        _heater = _lastDrive;
+    }
+    else {
+        // predict this position from the last one and the drive held since,
+        // the error updates the disturbance estimate
+        double phi[2][2];
+        double gamma[2];
+        double gammaD[2];
+        _discretize( dt, phi, gamma, gammaD );
+
+        const double excess    = _lastPosition - _ambient;
+        const double predicted = _ambient + phi[0][0] * excess + phi[0][1] * _heater + gamma[0] * _lastDrive + gammaD[0] * _disturbance;
+
+        _heater       = phi[1][1] * _heater + gamma[1] * _lastDrive;
+        _disturbance += ( position - predicted ) / MPC_DISTURBANCE_TIME;
+    }
+
+    _lastPosition = position;
+    _started      = true;
+
+    // the planned drive leaves room for the feedforward within the limits
+    const double lower = _outputMin - _feedforward;
+    const double upper = _outputMax - _feedforward;
+
+    _solve( setPoint, lower, upper );
+    _limitTemperature( lower );
+
+    _lastDrive = _plan[0];
+
+    _lastSolveTime = getClock() - start;
+    if ( _lastSolveTime > _worstSolveTime ) {
+        _worstSolveTime = _lastSolveTime;
+    }
+
+    return _clamp( _plan[0] + _feedforward, _outputMin, _outputMax );
+}
+
+//-----------------------------------------------------------------------------
+
+double MPC::getLastSolveTime() const {
+    return _lastSolveTime;
+}
+
+//-----------------------------------------------------------------------------
+
+double MPC::getWorstSolveTime() const {
+    return _worstSolveTime;
+}
+
+//-----------------------------------------------------------------------------
+
+void MPC::_precompute() {
+    double phi[2][2];
+    double gamma[2];
+    double gammaD[2];
+    _discretize( BLOCK_TIME, phi, gamma, gammaD );
+
+    // powers of phi give the free response, phi^k * gamma the response to a
+    // drive held over one block k blocks earlier
+    double power[2][2]     = { { 1.0, 0.0 }, { 0.0, 1.0 } };
+    double response[HORIZON][2];
+    double disturbance[2]  = { 0.0, 0.0 };
+
+    for ( size_t j = 0; j < HORIZON; ++j ) {
+        // response of a drive held over block 0, seen at the end of block j
+        response[j][0] = power[0][0] * gamma[0] + power[0][1] * gamma[1];
+        response[j][1] = power[1][0] * gamma[0] + power[1][1] * gamma[1];
+
+        // disturbance accumulates over all blocks up to j
+        const double d0 = phi[0][0] * disturbance[0] + phi[0][1] * disturbance[1] + gammaD[0];
+        const double d1 = phi[1][0] * disturbance[0] + phi[1][1] * disturbance[1] + gammaD[1];
+        disturbance[0] = d0;
+        disturbance[1] = d1;
+        _freeD[j] = disturbance[0];
+
+        // power = phi^( j + 1 )
+        double next[2][2];
+        for ( size_t row = 0; row < 2; ++row ) {
+            for ( size_t column = 0; column < 2; ++column ) {
+                next[row][column] = phi[row][0] * power[0][column] + phi[row][1] * power[1][column];
+            }
+        }
+
+        for ( size_t row = 0; row < 2; ++row ) {
+            for ( size_t column = 0; column < 2; ++column ) {
+                power[row][column] = next[row][column];
+            }
+        }
+
+        _free[j][0] = power[0][0];
+        _free[j][1] = power[0][1];
+    }
+
+    // the model is time invariant, so the step matrix is lower triangular
+    // Toeplitz in the single block response
+    for ( size_t j = 0; j < HORIZON; ++j ) {
+        for ( size_t i = 0; i < HORIZON; ++i ) {
+            _step[j][i] = ( i <= j ) ? response[j - i][0] : 0.0;
+        }
+    }
+
+    // H = step' step + moveWeight * D' D, D the first difference matrix
+    for ( size_t row = 0; row < HORIZON; ++row ) {
+        for ( size_t column = 0; column < HORIZON; ++column ) {
+            double sum = 0.0;
+            for ( size_t j = 0; j < HORIZON; ++j ) {
+                sum += _step[j][row] * _step[j][column];
+            }
+
+            if ( row == column ) {
+                sum += _moveWeight * ( row + 1 < HORIZON ? 2.0 : 1.0 );
+            }
+            else if ( row + 1 == column || column + 1 == row ) {
+                sum -= _moveWeight;
+            }
+
+            _hessian[row][column] = sum;
+        }
+    }
+
+    // the largest absolute row sum bounds the largest eigenvalue
+    double bound = 0.0;
+    for ( size_t row = 0; row < HORIZON; ++row ) {
+        double sum = 0.0;
+        for ( size_t column = 0; column < HORIZON; ++column ) {
+            sum += fabs( _hessian[row][column] );
+        }
+
+        if ( sum > bound ) {
+            bound = sum;
+        }
+    }
+
+    _stepSize = bound > 0.0 ? 1.0 / bound : 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+void MPC::_discretize( double t, double phi[2][2], double gamma[2], double gammaD[2] ) const {
+    // exact solution over t for a constant drive and disturbance, with
+    // x = ( T - ambient, h ); needs lag rate a above the loss rate L
+    const double L  = _lossCoefficient;
+    const double a  = 1.0 / _lagTime;
+    const double eL = exp( -L * t );
+    const double ea = exp( -a * t );
+
+    phi[0][0] = eL;
+    phi[0][1] = _heaterGain * ( eL - ea ) / ( a - L );
+    phi[1][0] = 0.0;
+    phi[1][1] = ea;
+
+    gamma[0] = _heaterGain * a / ( a - L ) * ( ( 1.0 - eL ) / L - ( 1.0 - ea ) / a );
+    gamma[1] = 1.0 - ea;
+
+    gammaD[0] = ( 1.0 - eL ) / L;
+    gammaD[1] = 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+void MPC::_solve( double setPoint, double lower, double upper ) {
+    // free response of the temperature error at the end of each block
+    const double excess = _lastPosition - _ambient;
+    for ( size_t j = 0; j < HORIZON; ++j ) {
+        _prediction[j] = _ambient + _free[j][0] * excess + _free[j][1] * _heater + _freeD[j] * _disturbance;
+    }
+
+    // linear term g = step' ( free - setPoint ) - moveWeight * lastDrive * e0
+    double linear[HORIZON];
+    for ( size_t i = 0; i < HORIZON; ++i ) {
+        double sum = 0.0;
+        for ( size_t j = i; j < HORIZON; ++j ) {
+            sum += _step[j][i] * ( _prediction[j] - setPoint );
+        }
+
+        linear[i] = sum;
+    }
+    linear[0] -= _moveWeight * _lastDrive;
+
+    // warm start from the last plan; updates come far more often than the
+    // blocks pass, so it is not shifted
+    double current[HORIZON];
+    double previous[HORIZON];
+    for ( size_t i = 0; i < HORIZON; ++i ) {
+        current[i]  = _clamp( _plan[i], lower, upper );
+        previous[i] = current[i];
+    }
+
+    // accelerated projected gradient (FISTA) with a fixed iteration count
+    double momentum = 1.0;
+    for ( unsigned iteration = 0; iteration < MPC_ITERATIONS; ++iteration ) {
+        const double nextMomentum = 0.5 * ( 1.0 + sqrt( 1.0 + 4.0 * momentum * momentum ) );
+        const double beta = ( momentum - 1.0 ) / nextMomentum;
+        momentum = nextMomentum;
+
+        double point[HORIZON];
+        for ( size_t i = 0; i < HORIZON; ++i ) {
+            point[i] = current[i] + beta * ( current[i] - previous[i] );
+        }
+
+        for ( size_t i = 0; i < HORIZON; ++i ) {
+            double gradient = linear[i];
+            for ( size_t k = 0; k < HORIZON; ++k ) {
+                gradient += _hessian[i][k] * point[k];
+            }
+
+            previous[i] = current[i];
+            current[i]  = _clamp( point[i] - _stepSize * gradient, lower, upper );
+        }
+    }
+
+    for ( size_t i = 0; i < HORIZON; ++i ) {
+        _plan[i] = current[i];
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void MPC::_limitTemperature( double lower ) {
+    // all step responses are positive, so lowering a drive only lowers the
+    // predictions after it: walk the blocks in order and take any excess
+    // off the latest drives that can still influence the block
+    for ( size_t j = 0; j < HORIZON; ++j ) {
+        double predicted = _prediction[j];
+        for ( size_t i = 0; i <= j; ++i ) {
+            predicted += _step[j][i] * _plan[i];
+        }
+
+        double excess = predicted - _temperatureMax;
+        for ( size_t i = j + 1; i-- > 0 && excess > 0.0; ) {
+            if ( _step[j][i] < MPC_MINIMUM_STEP ) {
+                continue;
+            }
+
+            const double reduction = std::min( _plan[i] - lower, excess / _step[j][i] );
+            if ( reduction > 0.0 ) {
+                _plan[i] -= reduction;
+                excess   -= reduction * _step[j][i];
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+double MPC::_clamp( double value, double minimum, double maximum ) const {
+    if ( value > maximum ) {
+        return maximum;
+    }
+    else if ( value < minimum ) {
+        return minimum;
+    }
+
+    return value;
+}
+
+//-----------------------------------------------------------------------------
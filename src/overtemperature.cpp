@@ -0,0 +1,162 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include "overtemperature.h"
+#include "boiler.h"
+#include "pigpiomgr.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+const double OverTemperature::RESET_MARGIN = 10.0;
+
+//-----------------------------------------------------------------------------
+
+OverTemperature::OverTemperature( Boiler* boiler, TSIC* tsic, double limit, double maxRise )
+    :_boiler( boiler )
+    ,_tsic( tsic )
+    ,_limit( limit )
+    ,_maxRise( maxRise )
+    ,_opened( false )
+    ,_trip()
+    ,_latest( 0.0 )
+{
+    _trip.reason = Reason::None;
+    _open();
+}
+
+//-----------------------------------------------------------------------------
+
+OverTemperature::~OverTemperature() {
+    _close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool OverTemperature::ready() const {
+    return _opened;
+}
+
+//-----------------------------------------------------------------------------
+
+bool OverTemperature::tripped() const {
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _trip.reason != Reason::None;
+}
+
+//-----------------------------------------------------------------------------
+
+bool OverTemperature::getTrip( Trip& trip ) const {
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    trip = _trip;
+    return _trip.reason != Reason::None;
+}
+
+//-----------------------------------------------------------------------------
+
+bool OverTemperature::reset() {
+    if ( !_opened ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    if ( _trip.reason == Reason::None ) {
+        return true;
+    }
+
+    if ( _latest > _limit - RESET_MARGIN ) {
+        LogWarning("Over-temperature trip not reset, boiler still at " << _latest << " C");
+        return false;
+    }
+
+    LogInfo("Over-temperature trip reset at " << _latest << " C");
+
+    _trip = Trip();
+    _trip.reason = Reason::None;
+    _boiler->resetTrip();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void OverTemperature::_open() {
+    if ( _boiler == nullptr || !_boiler->ready() ) {
+        LogError("Boiler controller not ready, aborting over-temperature cutoff");
+        return;
+    }
+
+    if ( _tsic == nullptr || !_tsic->ready() ) {
+        LogError("Temperature sensor not ready, aborting over-temperature cutoff");
+        return;
+    }
+
+    if ( _limit <= 0.0 ) {
+        LogError("Invalid over-temperature limit " << _limit << " C, aborting over-temperature cutoff");
+        return;
+    }
+
+    _tsic->setPacketHook( std::bind( &OverTemperature::_check, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4 ) );
+    _opened = true;
+}
+
+//-----------------------------------------------------------------------------
+
+void OverTemperature::_close() {
+    if ( _opened ) {
+        _tsic->setPacketHook( TSIC::PacketHook() );
+    }
+
+    _opened = false;
+}
+
+//-----------------------------------------------------------------------------
+
+void OverTemperature::_check( size_t sensor, const TSIC::Reading& reading, double slope, bool slopeValid ) {
+    // runs on the TSIC decoding thread; only the boiler sensor counts
+    if ( sensor != 0 ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    _latest = reading.temperature;
+
+    if ( _trip.reason != Reason::None ) {
+        return;
+    }
+
+    Reason::Value reason = Reason::None;
+    if ( reading.temperature >= _limit ) {
+        reason = Reason::Temperature;
+    }
+    else if ( _maxRise > 0.0 && slopeValid && slope >= _maxRise ) {
+        reason = Reason::Rise;
+    }
+    else {
+        return;
+    }
+
+    // switch off first, report afterwards; the latency includes the write
+    _boiler->trip();
+    const uint32_t latency = Singleton<PIGPIOManager>::pointer()->backend()->getTick() - reading.tick;
+
+    _trip.reason      = reason;
+    _trip.temperature = reading.temperature;
+    _trip.slope       = slopeValid ? slope : 0.0;
+    _trip.tick        = reading.tick;
+    _trip.latency     = latency;
+
+    LogCritical("Over-temperature cutoff: boiler at " << reading.temperature << " C rising " << _trip.slope
+        << " C/s (limits " << _limit << " C, " << _maxRise << " C/s), PWM off " << latency << " us after the packet");
+}
+
+//-----------------------------------------------------------------------------
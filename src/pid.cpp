@@ -0,0 +1,172 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include <math.h>
+
+#include "pid.h"
+
+//-----------------------------------------------------------------------------
+
+PID::PID()
+    :_pGain( 1.0 )
+    ,_iGain( 0.0 )
+    ,_dGain( 0.0 )
+    ,_outputMin( 0.0 )
+    ,_outputMax( 1.0 )
+    ,_integralMin( 0.0 )
+    ,_integralMax( 1.0 )
+    ,_filterTime( 0.0 )
+    ,_feedforward( 0.0 )
+    ,_integral( 0.0 )
+    ,_rate( 0.0 )
+    ,_lastPosition( 0.0 )
+    ,_lastError( 0.0 )
+    ,_lastOutput( 0.0 )
+    ,_started( false )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+void PID::setGains( double pGain, double iGain, double dGain ) {
+    if ( _started ) {
+        // bumpless transfer: the integral takes up the change in the
+        // proportional and derivative parts at the last operating point
+        const double before = _output( _lastError, _rate );
+
+        _pGain = pGain;
+        _dGain = dGain;
+
+        _integral = _clamp( _integral + before - _output( _lastError, _rate ), _integralMin, _integralMax );
+    }
+    else {
+        _pGain = pGain;
+        _dGain = dGain;
+    }
+
+    // the integral is kept in output units, so iGain needs no transfer
+    _iGain = iGain;
+}
+
+//-----------------------------------------------------------------------------
+
+void PID::setOutputLimits( double minimum, double maximum ) {
+    _outputMin = minimum;
+    _outputMax = maximum;
+}
+
+//-----------------------------------------------------------------------------
+
+void PID::setIntegralLimits( double minimum, double maximum ) {
+    _integralMin = minimum;
+    _integralMax = maximum;
+    _integral = _clamp( _integral, _integralMin, _integralMax );
+}
+
+//-----------------------------------------------------------------------------
+
+void PID::setDerivativeFilter( double timeConstant ) {
+    _filterTime = timeConstant > 0.0 ? timeConstant : 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+void PID::setFeedforward( double feedforward ) {
+    _feedforward = feedforward;
+}
+
+//-----------------------------------------------------------------------------
+
+void PID::setAppliedOutput( double applied ) {
+    if ( !_started ) {
+        return;
+    }
+
+    _integral   = _clamp( _integral + ( applied - _lastOutput ), _integralMin, _integralMax );
+    _lastOutput = applied;
+}
+
+//-----------------------------------------------------------------------------
+
+void PID::reset() {
+    _integral = _clamp( 0.0, _integralMin, _integralMax );
+    _rate     = 0.0;
+    _started  = false;
+}
+
+//-----------------------------------------------------------------------------
+
+double PID::update( double setPoint, double position, double dt ) {
+    // the first update has no previous position to differentiate
+    const double rate = ( _started && dt > 0.0 ) ? ( position - _lastPosition ) / dt : 0.0;
+    return update( setPoint, position, rate, dt );
+}
+
+//-----------------------------------------------------------------------------
+
+double PID::update( double setPoint, double position, double rate, double dt ) {
+    if ( dt < 0.0 ) {
+        dt = 0.0;
+    }
+
+    // low-pass filter the rate (exact for a rate held constant over dt)
+    if ( !_started || _filterTime <= 0.0 ) {
+        _rate = rate;
+    }
+    else {
+        _rate += ( 1.0 - exp( -dt / _filterTime ) ) * ( rate - _rate );
+    }
+
+    const double error = setPoint - position;
+
+    const double unlimited = _output( error, _rate );
+    const double output    = _clamp( unlimited, _outputMin, _outputMax );
+
+    // integrate, winding back by the amount the output was limited; the
+    // tracking time lies between the integral and derivative times
+    double tracking = 0.0;
+    if ( _pGain > 0.0 && _iGain > 0.0 ) {
+        const double integralTime = _pGain / _iGain;
+        tracking = ( _dGain > 0.0 ) ? sqrt( integralTime * _dGain / _pGain ) : integralTime;
+    }
+
+    _integral += _iGain * error * dt;
+    if ( tracking > 0.0 ) {
+        _integral += ( dt < tracking ? dt / tracking : 1.0 ) * ( output - unlimited );
+    }
+    _integral = _clamp( _integral, _integralMin, _integralMax );
+
+    _lastPosition = position;
+    _lastError    = error;
+    _lastOutput   = output;
+    _started      = true;
+
+    return output;
+}
+
+//-----------------------------------------------------------------------------
+
+double PID::_output( double error, double rate ) const {
+    return _feedforward + _pGain * error + _integral - _dGain * rate;
+}
+
+//-----------------------------------------------------------------------------
+
+double PID::_clamp( double value, double minimum, double maximum ) const {
+    if ( value > maximum ) {
+        return maximum;
+    }
+    else if ( value < minimum ) {
+        return minimum;
+    }
+
+    return value;
+}
+
+//-----------------------------------------------------------------------------
@@ -15,21 +15,112 @@
 
 //-----------------------------------------------------------------------------
 
+/// calls timed for the latency measurement at startup
+static const unsigned LATENCY_CALLS = 100;
+
+//-----------------------------------------------------------------------------
+
 bool PIGPIOManager::ready() const {
     return (_version != PI_INIT_FAILED);
 }
 
 //-----------------------------------------------------------------------------
 
-PIGPIOManager::PIGPIOManager() {
-    // guessing this is the same return value as gpioInitialise (undocumented)
-    _version = pigpio_start( NULL, NULL );
+int PIGPIOManager::version() const {
+    return _version;
+}
+
+//-----------------------------------------------------------------------------
+
+GPIOBackend* PIGPIOManager::backend() const {
+    return _backend;
+}
+
+//-----------------------------------------------------------------------------
+
+CommandQueue* PIGPIOManager::commands() const {
+    return _commands;
+}
+
+//-----------------------------------------------------------------------------
+
+double PIGPIOManager::getCallLatency() const {
+    return _callLatency;
+}
+
+//-----------------------------------------------------------------------------
+
+PIGPIOManager::PIGPIOManager( bool local )
+    :_version( PI_INIT_FAILED )
+    ,_backend( nullptr )
+    ,_commands( nullptr )
+    ,_callLatency( 0.0 )
+{
+    // one of the two pigpio libraries is linked, see GPIO_LOCAL in the
+    // Makefile; only the round trips to pigpiod are worth queueing
+#ifdef GPIO_LOCAL
+    if ( !local ) {
+        LogWarning("GPIO backend pigpiod not built (make GPIO_LOCAL=0), using the local library");
+    }
+    _backend = new LocalBackend();
+#else
+    if ( local ) {
+        LogWarning("GPIO backend local not built (make GPIO_LOCAL=1), using pigpiod");
+    }
+    _commands = new CommandQueue( new DaemonBackend() );
+    _backend  = _commands;
+#endif
+
+    _start();
+}
+
+//-----------------------------------------------------------------------------
+
+PIGPIOManager::PIGPIOManager( GPIOBackend* backend, bool queued )
+    :_version( PI_INIT_FAILED )
+    ,_backend( backend )
+    ,_commands( nullptr )
+    ,_callLatency( 0.0 )
+{
+    if ( queued ) {
+        _commands = new CommandQueue( backend );
+        _backend  = _commands;
+    }
+
+    _start();
 }
 
 //-----------------------------------------------------------------------------
 
 PIGPIOManager::~PIGPIOManager() {
-    pigpio_stop();
+    _backend->stop();
+    delete _backend;
+}
+
+//-----------------------------------------------------------------------------
+
+void PIGPIOManager::_start() {
+    _version = _backend->start();
+
+    if ( ready() ) {
+        _measureLatency();
+        LogInfo("GPIO backend " << _backend->name() << ", version " << _version << ", "
+            << _callLatency * 1.0E6 << " us per call");
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void PIGPIOManager::_measureLatency() {
+    // reading the tick is a round trip to pigpiod or a register read, with
+    // no effect on the pins
+    const double start = getClock();
+
+    for ( unsigned call = 0; call < LATENCY_CALLS; ++call ) {
+        _backend->getTick();
+    }
+
+    _callLatency = ( getClock() - start ) / static_cast<double>( LATENCY_CALLS );
 }
 
 //-----------------------------------------------------------------------------
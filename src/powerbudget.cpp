@@ -0,0 +1,271 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include <math.h>
+#include <algorithm>
+
+#include "powerbudget.h"
+#include "boiler.h"
+#include "pump.h"
+#include "timing.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// time constant of the average power (s)
+static const double POWER_AVERAGE_TIME = 60.0;
+
+//-----------------------------------------------------------------------------
+
+PowerBudget::PowerBudget( Boiler* boiler, Pump* pump, double heaterPower, double pumpPower, double peakLimit, double averageLimit )
+    :_boiler( boiler )
+    ,_pump( pump )
+    ,_heaterPower( heaterPower )
+    ,_pumpPower( pumpPower )
+    ,_peakLimit( peakLimit )
+    ,_averageLimit( averageLimit )
+    ,_opened( false )
+    ,_requested( 0.0 )
+    ,_applied( 0.0 )
+    ,_pumpOn( false )
+    ,_flowing( false )
+    ,_average( 0.0 )
+    ,_lastUpdate( 0.0 )
+    ,_deferred( 0.0 )
+    ,_inShot( false )
+    ,_shotStart( 0.0 )
+    ,_shotEnergy( 0.0 )
+    ,_shot()
+    ,_lastShot()
+    ,_hasLastShot( false )
+{
+    _open();
+}
+
+//-----------------------------------------------------------------------------
+
+PowerBudget::~PowerBudget() {
+    _close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool PowerBudget::ready() const {
+    return _opened;
+}
+
+//-----------------------------------------------------------------------------
+
+double PowerBudget::setBoilerPower( double value ) {
+    if ( !_opened ) {
+        return 0.0;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    const double now = getClock();
+    _account( now );
+
+    _requested = std::max( 0.0, std::min( value, 1.0 ) );
+    _apply( now );
+
+    return _applied;
+}
+
+//-----------------------------------------------------------------------------
+
+void PowerBudget::setPumpPower( bool power ) {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    const double now = getClock();
+    _account( now );
+
+    // cap the boiler before the pump starts, lift the cap after it stopped
+    if ( power ) {
+        _pumpOn = true;
+        _apply( now );
+        _pump->setPower( true );
+    }
+    else {
+        _pump->setPower( false );
+        _pumpOn = false;
+        _apply( now );
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool PowerBudget::getPumpPower() const {
+    if ( !_opened ) {
+        return false;
+    }
+
+    return _pump->getPower();
+}
+
+//-----------------------------------------------------------------------------
+
+void PowerBudget::setFlowing( bool flowing ) {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    if ( flowing == _flowing ) {
+        return;
+    }
+
+    const double now = getClock();
+    _account( now );
+
+    _flowing = flowing;
+    _apply( now );
+}
+
+//-----------------------------------------------------------------------------
+
+bool PowerBudget::getShotReport( Report& report ) const {
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    report = _lastShot;
+    return _hasLastShot;
+}
+
+//-----------------------------------------------------------------------------
+
+double PowerBudget::getDeferredEnergy() const {
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _deferred;
+}
+
+//-----------------------------------------------------------------------------
+
+void PowerBudget::_open() {
+    if ( _boiler == nullptr || !_boiler->ready() ) {
+        LogError("Boiler controller not ready, aborting power budget");
+        return;
+    }
+
+    if ( _pump == nullptr || !_pump->ready() ) {
+        LogError("Pump controller not ready, aborting power budget");
+        return;
+    }
+
+    if ( _heaterPower <= 0.0 ) {
+        LogError("Invalid heater power " << _heaterPower << "W, aborting power budget");
+        return;
+    }
+
+    if ( _peakLimit > 0.0 || _averageLimit > 0.0 ) {
+        LogInfo("Power budget: peak " << _peakLimit << "W, average " << _averageLimit << "W");
+    }
+
+    _lastUpdate = getClock();
+    _opened = true;
+}
+
+//-----------------------------------------------------------------------------
+
+void PowerBudget::_close() {
+    if ( _opened && _deferred > 0.0 ) {
+        LogInfo("Power budget: " << _deferred / 1000.0 << "kJ of heating deferred in total");
+    }
+
+    _opened = false;
+}
+
+//-----------------------------------------------------------------------------
+
+void PowerBudget::_apply( double now ) {
+    // must be called with the mutex held, after _account
+    const bool pumpRunning = _pumpOn || _flowing;
+    const double pumpLoad = pumpRunning ? _pumpPower : 0.0;
+
+    double limit = 1.0;
+    if ( _peakLimit > 0.0 && pumpRunning ) {
+        limit = std::min( limit, ( _peakLimit - pumpLoad ) / _heaterPower );
+    }
+
+    // over the average budget, hold the total at the average limit until
+    // the average has come back down
+    if ( _averageLimit > 0.0 && _average > _averageLimit ) {
+        limit = std::min( limit, ( _averageLimit - pumpLoad ) / _heaterPower );
+    }
+
+    if ( limit < 0.0 ) {
+        limit = 0.0;
+    }
+
+    _applied = std::min( _requested, limit );
+    _boiler->setPower( _applied );
+
+    // a shot starts and ends with the pump
+    if ( pumpRunning && !_inShot ) {
+        _inShot     = true;
+        _shotStart  = now;
+        _shotEnergy = 0.0;
+        _shot       = Report();
+    }
+    else if ( !pumpRunning && _inShot ) {
+        _inShot = false;
+
+        _shot.duration     = now - _shotStart;
+        _shot.averagePower = ( _shot.duration > 0.0 ) ? _shotEnergy / _shot.duration : 0.0;
+        _lastShot    = _shot;
+        _hasLastShot = true;
+
+        LogInfo("Shot power: peak " << _shot.peakPower << "W, average " << _shot.averagePower << "W, "
+            << _shot.deferredEnergy / 1000.0 << "kJ heating deferred over " << _shot.cappedTime << "s");
+    }
+
+    if ( _inShot ) {
+        const double total = _applied * _heaterPower + pumpLoad;
+        if ( total > _shot.peakPower ) {
+            _shot.peakPower = total;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void PowerBudget::_account( double now ) {
+    // must be called with the mutex held; the state since the last call
+    // held for the elapsed time
+    const double dt = now - _lastUpdate;
+    _lastUpdate = now;
+
+    if ( dt <= 0.0 ) {
+        return;
+    }
+
+    const double pumpLoad = ( _pumpOn || _flowing ) ? _pumpPower : 0.0;
+    const double total = _applied * _heaterPower + pumpLoad;
+    const double deferred = ( _requested - _applied ) * _heaterPower * dt;
+
+    _average += ( 1.0 - exp( -dt / POWER_AVERAGE_TIME ) ) * ( total - _average );
+    _deferred += deferred;
+
+    if ( _inShot ) {
+        _shotEnergy += total * dt;
+        _shot.deferredEnergy += deferred;
+
+        if ( _requested > _applied ) {
+            _shot.cappedTime += dt;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
@@ -74,6 +74,8 @@ void Pump::_open() {
         _close();
         return;
     }
+
+    _gpioPin->setAsync( true );
     
     _opened = true;
 }
@@ -18,6 +18,13 @@
 
 #include "logger.h"
 #include "singleton.h"
+#include "watchdog.h"
+
+//-----------------------------------------------------------------------------
+
+// Watchdog deadline in seconds; one measurement (and its retry) takes well
+// under a second even when the echo never arrives
+static const double RANGER_WATCHDOG_DEADLINE = 2.0;
 
 //-----------------------------------------------------------------------------
 
@@ -30,6 +37,7 @@ Ranger::Ranger()
     ,_echoPin( 0 )
     ,_triggerPin( 0 )
     ,_run( false )
+    ,_watchdog( -1 )
 {
     _timeStamp[0] = 0;
     _timeStamp[1] = 0;
@@ -102,7 +110,7 @@ void Ranger::_open() {
         return;
     }
 
-    if ( !_echoPin->edgeFuncRegister( std::bind( &Ranger::_alertFunction, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3 ) ) ) {
+    if ( !_echoPin->edgeMethodRegister<Ranger, &Ranger::_alertFunction>( this ) ) {
         LogError("Could not register callback for echo pin");
         _close();
         return;
@@ -113,6 +121,7 @@ void Ranger::_open() {
 
     _opened = true;
     _run = true;
+    _watchdog = Singleton<Watchdog>::ready() ? Singleton<Watchdog>::pointer()->add( "ranger", RANGER_WATCHDOG_DEADLINE ) : -1;
     _thread = std::thread( &Ranger::_worker, this );
     
     double range = 0.0;
@@ -133,6 +142,11 @@ void Ranger::_close() {
         _thread.join();
     }
 
+    if ( _watchdog >= 0 ) {
+        Singleton<Watchdog>::pointer()->remove( _watchdog );
+        _watchdog = -1;
+    }
+
     if ( _echoPin ) {
         delete _echoPin;
     }
@@ -151,6 +165,10 @@ void Ranger::_worker() {
     const double k = 0.5;
 
     while (_run) {
+        if ( _watchdog >= 0 ) {
+            Singleton<Watchdog>::pointer()->checkIn( _watchdog );
+        }
+
         oldRange = currentRange;
 
         // Take a range measurement (will block)
@@ -253,7 +271,7 @@ double Ranger::_measureRange() {
 
 //-----------------------------------------------------------------------------
 
-void Ranger::_alertFunction( unsigned gpio, unsigned level, uint32_t tick )  {
+void Ranger::_alertFunction( unsigned pin, bool level, unsigned tick )  {
     std::lock_guard<std::mutex> lock( _countMutex );
 
     // For the first two interrupts received, store the time-stamp
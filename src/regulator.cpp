@@ -8,33 +8,110 @@
 //-----------------------------------------------------------------------------
 
 #include <unistd.h>
+#include <math.h>
+#include <algorithm>
 
 #include "tsic.h"
 #include "boiler.h"
+#include "powerbudget.h"
 #include "regulator.h"
 #include "timing.h"
 #include "logger.h"
 #include "singleton.h"
+#include "watchdog.h"
+
+//-----------------------------------------------------------------------------
+
+/// longest single wait for a TSIC packet in per sample mode (ms), so that
+/// timeouts and shutdown are noticed promptly
+static const unsigned REGULATOR_WAIT_MS = 100;
+
+/// longest time without a worker iteration before the watchdog steps in (s);
+/// an iteration takes at most one time step
+static const double REGULATOR_WATCHDOG_DEADLINE = 3.0;
+
+/// time constant of the low-pass filter on the derivative (s)
+static const double REGULATOR_DERIVATIVE_FILTER = 0.5;
+
+/// heat needed to warm one millilitre of water by one degree (J)
+static const double WATER_HEAT_CAPACITY = 4.186;
+
+/// smallest feedforward change applied between PID updates (duty)
+static const double FEEDFORWARD_STEP = 0.005;
+
+/// relay hysteresis around the autotune target (C), above the sensor noise
+static const double AUTOTUNE_HYSTERESIS = 0.3;
+
+/// longest autotune run before it is abandoned (s)
+static const double AUTOTUNE_TIMEOUT = 1800.0;
+
+/// boiler model used until a learned one is set: heating rate (C/s), loss
+/// (1/s), ambient (C) and dead time (s) of the stock 1425W boiler
+static const double MODEL_HEATER_GAIN = 1.4;
+static const double MODEL_LOSS        = 0.0012;
+static const double MODEL_AMBIENT     = 20.0;
+static const double MODEL_DEAD_TIME   = 4.0;
+
+/// share of the heating rate left after losses that a rising profile uses
+static const double TRAJECTORY_HEADROOM = 0.8;
+
+/// falling profiles run this much faster than the boiler cools by itself,
+/// so they never hold the temperature up
+static const double TRAJECTORY_FALL_FACTOR = 1.5;
+
+/// time a profile takes to reach its full rate (s)
+static const double TRAJECTORY_ACCELERATION_TIME = 10.0;
+
+/// smallest target change timed as a transition (C)
+static const double TRANSITION_THRESHOLD = 0.5;
+
+/// the temperature has settled once it stays this close to the target (C)
+/// for TRANSITION_HOLD seconds
+static const double TRANSITION_BAND = 0.5;
+static const double TRANSITION_HOLD = 30.0;
 
 //-----------------------------------------------------------------------------
 
 Regulator::Regulator(Boiler* boiler, TSIC* tsic) 
     :_opened( false )
     ,_run( false )
+    ,_watchdog( -1 )
     ,_power( false )
     ,_timeStep( 1.0 )
+    ,_perSample( false )
+    ,_decimation( 1 )
+    ,_sampleTimeout( 1.0 )
+    ,_pumpOn( false )
+    ,_flowRate( 0.0 )
+    ,_feedforwardGain( 0.0 )
+    ,_heaterPower( 1425.0 )
+    ,_inletTemperature( 20.0 )
+    ,_pumpFlowRate( 0.0 )
     ,_latestTemp( 20.0 )
     ,_latestPower( 0.0 )
     ,_temperature( tsic )
     ,_boiler( boiler )
+    ,_powerBudget( nullptr )
     ,_targetTemperature( 95.0 )
-    ,_dState( 0.0 )
-    ,_iState( 0.0 )
     ,_iMax(  1.0 )
     ,_iMin( -1.0 )
-    ,_iGain( 0.0 )
-    ,_pGain( 1.0 )
-    ,_dGain( 0.0 )
+    ,_engine( Engine::PID )
+    ,_temperatureMargin( 5.0 )
+    ,_modelHeaterGain( MODEL_HEATER_GAIN )
+    ,_modelLoss( MODEL_LOSS )
+    ,_modelAmbient( MODEL_AMBIENT )
+    ,_modelDeadTime( MODEL_DEAD_TIME )
+    ,_transition()
+    ,_lastTransition()
+    ,_estimated( false )
+    ,_stepTime( 1.0 )
+    ,_autotuneState( Autotune::Idle )
+    ,_relay()
+    ,_ultimateGain( 0.0 )
+    ,_ultimatePeriod( 0.0 )
+    ,_tunedIGain( 0.0 )
+    ,_tunedPGain( 0.0 )
+    ,_tunedDGain( 0.0 )
 {
     _open();
 }
@@ -60,9 +137,7 @@ void Regulator::setPIDGains( double pGain, double iGain, double dGain ) {
 
     std::lock_guard<std::mutex> lock( *_mutex );
 
-    _pGain = pGain;
-    _iGain = iGain;
-    _dGain = dGain;
+    _pid.setGains( pGain, iGain, dGain );
 }
 
 //-----------------------------------------------------------------------------
@@ -74,6 +149,11 @@ void Regulator::setTargetTemperature( double targetTemperature ) {
 
     std::lock_guard<std::mutex> lock( *_mutex );
 
+    // only changes made while regulating are timed
+    if ( _trajectory.started() && fabs( targetTemperature - _targetTemperature ) >= TRANSITION_THRESHOLD ) {
+        _startTransition( _targetTemperature, targetTemperature, getClock() );
+    }
+
     _targetTemperature = targetTemperature;
 }
 
@@ -91,6 +171,45 @@ double Regulator::getTargetTemperature() const {
 
 //-----------------------------------------------------------------------------
 
+bool Regulator::getEstimate( double& temperature, double& rate, double& prediction ) const {
+    if ( !_opened ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    if ( !_estimated ) {
+        return false;
+    }
+
+    temperature = _kalman.getTemperature();
+    rate        = _kalman.getRate();
+    prediction  = _kalman.getPrediction( _stepTime );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Regulator::getLastTransition( double& from, double& to, double& settlingTime, double& overshoot ) const {
+    if ( !_opened ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    if ( !_lastTransition.active ) {
+        return false;
+    }
+
+    from         = _lastTransition.from;
+    to           = _lastTransition.to;
+    settlingTime = _lastTransition.settlingTime;
+    overshoot    = _lastTransition.overshoot;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
 void Regulator::setPower( bool power ) {
     if ( !_opened ) {
         return;
@@ -113,6 +232,182 @@ bool Regulator::getPower() const {
 
 //-----------------------------------------------------------------------------
 
+void Regulator::setSampling( bool perSample, unsigned decimation, double timeout ) {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    _perSample     = perSample;
+    _decimation    = decimation > 0 ? decimation : 1;
+    _sampleTimeout = timeout;
+}
+
+//-----------------------------------------------------------------------------
+
+void Regulator::setFeedforwardModel( double gain, double heaterPower, double inletTemperature, double pumpFlowRate ) {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    _feedforwardGain  = gain;
+    _heaterPower      = heaterPower;
+    _inletTemperature = inletTemperature;
+    _pumpFlowRate     = pumpFlowRate;
+}
+
+//-----------------------------------------------------------------------------
+
+void Regulator::setFlow( bool pumpOn, double flowRate ) {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    _pumpOn   = pumpOn;
+    _flowRate = flowRate;
+}
+
+//-----------------------------------------------------------------------------
+
+void Regulator::setEngine( Engine::Value engine, double moveWeight, double temperatureMargin ) {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    // the engine taken over starts afresh
+    if ( engine != _engine ) {
+        _pid.reset();
+        _mpc.reset();
+        _trajectory.reset();
+        LogInfo("Regulator: " << ( engine == Engine::Predictive ? "predictive" : "PID" ) << " engine");
+    }
+
+    _engine            = engine;
+    _temperatureMargin = temperatureMargin;
+    _mpc.setMoveWeight( moveWeight );
+}
+
+//-----------------------------------------------------------------------------
+
+Regulator::Engine::Value Regulator::getEngine() const {
+    if ( !_opened ) {
+        return Engine::PID;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+    return _engine;
+}
+
+//-----------------------------------------------------------------------------
+
+void Regulator::setBoilerModel( double heaterGain, double lossCoefficient, double ambientTemperature, double deadTime ) {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+    _mpc.setModel( heaterGain, lossCoefficient, ambientTemperature, deadTime );
+    _kalman.setModel( heaterGain, lossCoefficient, ambientTemperature, deadTime );
+
+    if ( heaterGain > 0.0 && lossCoefficient > 0.0 ) {
+        _modelHeaterGain = heaterGain;
+        _modelLoss       = lossCoefficient;
+        _modelAmbient    = ambientTemperature;
+        _modelDeadTime   = deadTime;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void Regulator::getSolveTime( double& last, double& worst ) const {
+    last  = 0.0;
+    worst = 0.0;
+
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+    last  = _mpc.getLastSolveTime();
+    worst = _mpc.getWorstSolveTime();
+}
+
+//-----------------------------------------------------------------------------
+
+void Regulator::startAutotune( double target, double amplitude, unsigned cycles, double maxTemperature ) {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    _relay = Relay();
+    _relay.target         = target;
+    _relay.amplitude      = amplitude;
+    _relay.maxTemperature = maxTemperature;
+    _relay.cycles         = cycles > 0 ? cycles : 1;
+    _relay.start          = getClock();
+    _relay.lastOn         = -1.0;
+
+    _autotuneState = Autotune::Running;
+    LogInfo("Autotune: relay 0.." << amplitude << " around " << target << "C, " << _relay.cycles << " cycles");
+}
+
+//-----------------------------------------------------------------------------
+
+void Regulator::stopAutotune() {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    if ( _autotuneState == Autotune::Running ) {
+        _failAutotune( "stopped" );
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+Regulator::Autotune::Value Regulator::getAutotuneState() const {
+    if ( !_opened ) {
+        return Autotune::Idle;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+    return _autotuneState;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Regulator::getAutotuneResult( double& ultimateGain, double& ultimatePeriod, double& iGain, double& pGain, double& dGain ) const {
+    if ( !_opened ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    if ( _autotuneState != Autotune::Done ) {
+        return false;
+    }
+
+    ultimateGain   = _ultimateGain;
+    ultimatePeriod = _ultimatePeriod;
+    iGain          = _tunedIGain;
+    pGain          = _tunedPGain;
+    dGain          = _tunedDGain;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
 void Regulator::_open() {   
     if ( !_boiler->ready() ) {
         LogError("Boiler controller not ready");
@@ -127,19 +422,24 @@ void Regulator::_open() {
     }
 
     // Set regulator properties
-    _pGain = 0.07;
-    _iGain = 0.05;
-    _dGain = 0.90;
-
     _iMin = 0.0;
     _iMax = 1.0;
 
+    _pid.setGains( 0.07, 0.05, 0.90 );
+    _pid.setOutputLimits( 0.0, 1.0 );
+    _pid.setIntegralLimits( _iMin, _iMax );
+    _pid.setDerivativeFilter( REGULATOR_DERIVATIVE_FILTER );
+    _mpc.setOutputLimits( 0.0, 1.0 );
+    _mpc.setModel( _modelHeaterGain, _modelLoss, _modelAmbient, _modelDeadTime );
+    _kalman.setModel( _modelHeaterGain, _modelLoss, _modelAmbient, _modelDeadTime );
+
     _timeStep = 1.0;
     _targetTemperature = 93.0;
 
     _opened = true;
     _run = true;
     _mutex = new std::mutex();
+    _watchdog = Singleton<Watchdog>::ready() ? Singleton<Watchdog>::pointer()->add( "regulator", REGULATOR_WATCHDOG_DEADLINE ) : -1;
     _thread = new std::thread( &Regulator::_worker, this );
 }
 
@@ -153,6 +453,15 @@ void Regulator::_close() {
         delete _thread;
     }
 
+    if ( _watchdog >= 0 ) {
+        Singleton<Watchdog>::pointer()->remove( _watchdog );
+        _watchdog = -1;
+    }
+
+    if ( _mpc.getWorstSolveTime() > 0.0 ) {
+        LogInfo("Regulator: slowest predictive step " << 1.0E6 * _mpc.getWorstSolveTime() << "us");
+    }
+
     if ( _mutex ) {
         delete _mutex;
     }
@@ -160,27 +469,247 @@ void Regulator::_close() {
 
 //-----------------------------------------------------------------------------
 
-double Regulator::_update( double error, double position, double iGain, double pGain, double dGain ) {    
-    // Calculate proportional term
-    double pTerm = pGain * error;
+double Regulator::_feedforward() const {
+    // must be called with the mutex held
+    if ( _feedforwardGain <= 0.0 || _heaterPower <= 0.0 ) {
+        return 0.0;
+    }
+
+    // the flow meter needs a moment to report after the pump starts
+    double flowRate = _flowRate;
+    if ( _pumpOn && flowRate < _pumpFlowRate ) {
+        flowRate = _pumpFlowRate;
+    }
+
+    // power needed to bring the incoming water up to the target
+    const double rise = _targetTemperature - _inletTemperature;
+    if ( flowRate <= 0.0 || rise <= 0.0 ) {
+        return 0.0;
+    }
+
+    return _feedforwardGain * flowRate * WATER_HEAT_CAPACITY * rise / _heaterPower;
+}
+
+//-----------------------------------------------------------------------------
+
+void Regulator::setPowerBudget( PowerBudget* budget ) {
+    _powerBudget = budget;
+}
+
+//-----------------------------------------------------------------------------
+
+double Regulator::_setBoilerPower( double drive ) {
+    PowerBudget* budget = _powerBudget;
+
+    if ( budget != nullptr ) {
+        return budget->setBoilerPower( drive );
+    }
+
+    _boiler->setPower( drive );
+    return drive;
+}
+
+//-----------------------------------------------------------------------------
+
+double Regulator::_applyFeedforward( double drive, double& applied ) {
+    double feedforward = 0.0;
+    {
+        std::lock_guard<std::mutex> lock( *_mutex );
+        feedforward = _power ? _feedforward() : 0.0;
+
+        // the relay of an autotune run must not be disturbed
+        if ( _autotuneState == Autotune::Running || fabs( feedforward - applied ) < FEEDFORWARD_STEP ) {
+            return drive;
+        }
+
+        // shift the drive by the change, the next PID update takes over
+        drive += feedforward - applied;
+        if ( drive > 1.0 ) {
+            drive = 1.0;
+        } 
+        else if ( drive < 0.0 ) {
+            drive = 0.0;
+        }
+
+        applied      = feedforward;
+        _latestPower = drive;
+    }
+
+    _setBoilerPower( drive );
+    return drive;
+}
+
+//-----------------------------------------------------------------------------
+
+double Regulator::_relayStep( double temperature, double now ) {
+    // must be called with the mutex held
+    Relay& relay = _relay;
+
+    if ( temperature > relay.maxTemperature ) {
+        _failAutotune( "over temperature" );
+        return 0.0;
+    }
+
+    if ( now - relay.start > AUTOTUNE_TIMEOUT ) {
+        _failAutotune( "no steady oscillation" );
+        return 0.0;
+    }
+
+    relay.high = std::max( relay.high, temperature );
+    relay.low  = std::min( relay.low, temperature );
+
+    if ( relay.on && temperature > relay.target + AUTOTUNE_HYSTERESIS ) {
+        relay.on      = false;
+        relay.lastOff = now;
+    }
+    else if ( !relay.on && temperature < relay.target - AUTOTUNE_HYSTERESIS ) {
+        relay.on = true;
+
+        // each switch on completes an oscillation; the first one after the
+        // heat up is still settling and is not measured
+        if ( relay.lastOn >= 0.0 ) {
+            if ( relay.measured > 0 ) {
+                relay.periodSum += now - relay.lastOn;
+                relay.onSum     += relay.lastOff - relay.lastOn;
+                relay.heightSum += 0.5 * ( relay.high - relay.low );
+            }
+            ++relay.measured;
+        }
+
+        relay.lastOn = now;
+        relay.high   = temperature;
+        relay.low    = temperature;
+
+        if ( relay.measured > relay.cycles ) {
+            // describing function of a relay with hysteresis; holding the
+            // target takes far less than half the drive, so the relay is on
+            // for a short share of the period and the first harmonic of the
+            // drive is 2 amplitude sin( pi share ) / pi, not 4 ( amplitude
+            // / 2 ) / pi as for a symmetric relay
+            const double height = relay.heightSum / relay.cycles;
+            const double share  = relay.onSum / relay.periodSum;
+            const double swing  = 0.5 * relay.amplitude * sin( M_PI * share );
+
+            if ( height <= AUTOTUNE_HYSTERESIS ) {
+                _failAutotune( "oscillation too small" );
+                return 0.0;
+            }
+
+            _ultimateGain   = 4.0 * swing / ( M_PI * sqrt( height * height - AUTOTUNE_HYSTERESIS * AUTOTUNE_HYSTERESIS ) );
+            _ultimatePeriod = relay.periodSum / relay.cycles;
+
+            // Ziegler-Nichols "no overshoot" rule: Kp = 0.2 Ku, Ti = Pu / 2,
+            // Td = Pu / 3, with the per second gains used by the PID class
+            _tunedPGain = 0.2 * _ultimateGain;
+            _tunedIGain = _tunedPGain / ( 0.5 * _ultimatePeriod );
+            _tunedDGain = _tunedPGain * _ultimatePeriod / 3.0;
+
+            _autotuneState = Autotune::Done;
+            _pid.reset();
+            _mpc.reset();
+            _trajectory.reset();
+
+            LogInfo("Autotune: Ku " << _ultimateGain << ", Pu " << _ultimatePeriod << "s => P " << _tunedPGain << ", I " << _tunedIGain << ", D " << _tunedDGain);
+            return 0.0;
+        }
+    }
+
+    return relay.on ? relay.amplitude : 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+void Regulator::_failAutotune( const char* reason ) {
+    // must be called with the mutex held
+    _autotuneState = Autotune::Failed;
+    _pid.reset();
+    _mpc.reset();
+    _trajectory.reset();
 
-    // Calculate integral state with appropriate limiting
-    _iState += error;
-    if ( _iState > _iMax ) {
-        _iState = _iMax;
+    LogWarning("Autotune aborted: " << reason);
+}
+
+//-----------------------------------------------------------------------------
+
+double Regulator::_followTrajectory( double temperature, double dt, double& rate, double& drive ) {
+    // must be called with the mutex held; a new profile starts at the
+    // measured temperature, so heating up from cold is a profile as well
+    if ( !_trajectory.started() ) {
+        _trajectory.start( temperature );
+
+        if ( fabs( _targetTemperature - temperature ) >= TRANSITION_THRESHOLD ) {
+            _startTransition( temperature, _targetTemperature, getClock() );
+        }
     }
-    else if ( _iState < _iMin ) {
-        _iState = _iMin;
+
+    // rise with part of the heating rate the losses leave over, fall with
+    // (somewhat more than) the rate the boiler cools at
+    const double above = _trajectory.getPosition() - _modelAmbient;
+    const double rise  = TRAJECTORY_HEADROOM * ( _modelHeaterGain - _modelLoss * above );
+    const double fall  = TRAJECTORY_FALL_FACTOR * _modelLoss * above;
+
+    _trajectory.setLimits( rise, fall, rise / TRAJECTORY_ACCELERATION_TIME );
+
+    const double position = _trajectory.update( _targetTemperature, dt );
+    rate = _trajectory.getRate();
+
+    // extra drive to follow the profile, ahead by the dead time
+    drive = ( rate + _modelDeadTime * _trajectory.getAcceleration() ) / _modelHeaterGain;
+    if ( drive < 0.0 ) {
+        drive = 0.0;
     }
 
-    // Calculate integral term
-    double iTerm = iGain * _iState;
+    return position;
+}
 
-    // Calculate derivative term
-    double dTerm = dGain * (_dState - position);
-    _dState = position;
+//-----------------------------------------------------------------------------
 
-    return pTerm + dTerm + iTerm;
+void Regulator::_startTransition( double from, double to, double now ) {
+    // must be called with the mutex held
+    if ( _transition.active ) {
+        LogInfo("Regulator: " << _transition.from << "C -> " << _transition.to << "C replaced before it settled");
+    }
+
+    _transition = Transition();
+    _transition.active  = true;
+    _transition.from    = from;
+    _transition.to      = to;
+    _transition.start   = now;
+    _transition.entered = -1.0;
+}
+
+//-----------------------------------------------------------------------------
+
+void Regulator::_trackTransition( double temperature, double now ) {
+    // must be called with the mutex held
+    Transition& transition = _transition;
+
+    if ( !transition.active ) {
+        return;
+    }
+
+    const double past = ( transition.to >= transition.from ) ? temperature - transition.to : transition.to - temperature;
+    transition.overshoot = std::max( transition.overshoot, past );
+
+    if ( fabs( temperature - transition.to ) > TRANSITION_BAND ) {
+        transition.entered = -1.0;
+        return;
+    }
+
+    if ( transition.entered < 0.0 ) {
+        transition.entered = now;
+    }
+
+    if ( now - transition.entered >= TRANSITION_HOLD ) {
+        transition.active       = false;
+        transition.settlingTime = transition.entered - transition.start;
+
+        _lastTransition = transition;
+        _lastTransition.active = true;
+
+        LogInfo("Regulator: " << transition.from << "C -> " << transition.to << "C settled in " << transition.settlingTime
+            << "s, overshoot " << transition.overshoot << "C");
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -189,32 +718,197 @@ void Regulator::_worker() {
     // Start time and next time step
     double start = getClock();
     double next  = start;
+
+    // Per sample mode state
+    double   lastStep     = start; // time of the last PID update
+    double   lastValid    = start; // time of the last valid packet
+    uint32_t sampleCount  = _temperature->getSampleCount();
+    unsigned skipped      = 0;
+    bool     timedOut     = false;
+    bool     wasPerSample = false;
+
+    // boiler drive (duty cycle) and the feedforward included in it
+    double drive      = 0.0;
+    double applied    = 0.0;
+    bool   regulating = false;
             
     while ( _run ) {
-        // get elapsed time since start
-        //double elapsed = getClock() - start;
+        if ( _watchdog >= 0 ) {
+            Singleton<Watchdog>::pointer()->checkIn( _watchdog );
+        }
 
-        // take temperature measurement
+        bool     perSample  = false;
+        unsigned decimation = 1;
+        double   timeout    = 0.0;
+        {
+            std::lock_guard<std::mutex> lock( *_mutex );
+            perSample  = _perSample;
+            decimation = _decimation;
+            timeout    = _sampleTimeout;
+        }
+
+        // take temperature measurement; if the temperature is near zero, we
+        // assume there's an error reading the sensor
         double latestTemp = 0.0;
-    
-        if ( !_temperature->getDegrees( latestTemp ) ) {
+        bool   valid      = false;
+        bool   arrived    = false;
+
+        // restart the timeout and decimation when entering per sample mode
+        if ( perSample && !wasPerSample ) {
+            lastStep  = getClock();
+            lastValid = lastStep;
+            skipped   = 0;
+        }
+        wasPerSample = perSample;
+
+        if ( perSample ) {
+            // wait for the next packet from the sensor
+            arrived = _temperature->waitForSample( sampleCount, REGULATOR_WAIT_MS );
+            valid = arrived && _temperature->getDegrees( latestTemp ) && latestTemp > 0.5;
+
+            const double now = getClock();
+            if ( valid ) {
+                lastValid = now;
+            }
+
+            // fail safe: no valid packet for too long, switch the boiler off
+            if ( now - lastValid > timeout ) {
+                if ( !timedOut ) {
+                    LogWarning("Regulator: no valid temperature for " << timeout << "s, boiler switched off");
+                    timedOut = true;
+                }
+
+                drive      = 0.0;
+                applied    = 0.0;
+                regulating = false;
+                _setBoilerPower( 0.0 );
+
+                std::lock_guard<std::mutex> lock( *_mutex );
+                _latestTemp  = 0.0;
+                _latestPower = 0.0;
+                _estimated   = false;
+                _kalman.reset();
+
+                if ( _autotuneState == Autotune::Running ) {
+                    _failAutotune( "no temperature readings" );
+                }
+                continue;
+            }
+
+            // keep the current drive until the next packet to be used, but
+            // follow changes of the flow straight away; an invalid packet is
+            // used as well, the estimate bridges it
+            if ( !arrived || ++skipped < decimation ) {
+                if ( regulating ) {
+                    drive = _applyFeedforward( drive, applied );
+                }
+                continue;
+            }
+            skipped = 0;
+
+            if ( timedOut ) {
+                LogInfo("Regulator: temperature readings resumed");
+                timedOut = false;
+            }
+        }
+        else {
+            valid = _temperature->getDegrees( latestTemp ) && latestTemp > 0.5;
+
+            if ( valid ) {
+                lastValid = getClock();
+            }
+        }
+
+        if ( !valid ) {
             latestTemp = 0.0;
         }
 
-        // boiler drive (duty cycle)
-        double drive = 0.0;
+        // time since the last update, limited so that a long pause does not
+        // wind up the integral in one step
+        const double now = getClock();
+        double dt = perSample ? now - lastStep : _timeStep;
+        if ( dt > timeout && timeout > 0.0 ) {
+            dt = timeout;
+        }
+        lastStep = now;
+
+        // advance the estimate with the drive the boiler got in the last
+        // step (after any power cap or trip), less the part making up for
+        // the water flowing in, and correct it with the reading; without
+        // one it bridges the gap up to the timeout. While water flows the
+        // model misses its heat, the estimate follows the readings closer
+        double temperature = 0.0;
+        double slope       = 0.0;
+        {
+            std::lock_guard<std::mutex> lock( *_mutex );
 
-        // if the temperature is near zero, we assume there's an error
-        // reading the sensor and drive (duty cycle) will be zero
-        if ( _power && latestTemp > 0.5 ) {
+            _kalman.setFlowing( _pumpOn || _flowRate > 0.0 );
+            _kalman.predict( _boiler->getPower() - applied, dt );
+            if ( valid ) {
+                _kalman.correct( latestTemp );
+            }
+
+            _estimated = _kalman.started() && ( valid || now - lastValid <= timeout );
+            _stepTime  = dt;
+
+            if ( _estimated ) {
+                temperature = _kalman.getTemperature();
+                slope       = _kalman.getRate();
+            }
+            else {
+                _kalman.reset();
+            }
+        }
+
+        // a tripped boiler ignores the drive, so do not wind up meanwhile
+        drive      = 0.0;
+        applied    = 0.0;
+        regulating = _power && temperature > 0.5 && !_boiler->tripped();
+
+        if ( regulating ) {
             // lock shared data before use
             std::lock_guard<std::mutex> lock( *_mutex );
 
-            // calculate next time step
-            next += _timeStep;
-
-            // calculate PID update
-            drive = _update( _targetTemperature - latestTemp, latestTemp, _iGain, _pGain, _dGain );
+            // heat demand of the water flowing in, known ahead of the
+            // temperature drop it will cause
+            applied = _feedforward();
+
+            // the PID follows the set point profile; the predictive engine
+            // plans its own approach to the target
+            double rate    = 0.0;
+            double profile = 0.0;
+            const double setPoint = _followTrajectory( temperature, dt, rate, profile );
+            _pid.setFeedforward( applied + profile );
+
+            _trackTransition( temperature, now );
+
+            // calculate the update on the estimate rather than the raw
+            // reading; the PID derivative acts on the deviation of the
+            // estimated rate from the profile's rate
+            if ( _autotuneState == Autotune::Running ) {
+                drive   = _relayStep( temperature, now );
+                applied = 0.0;
+            }
+            else if ( _engine == Engine::Predictive ) {
+                _mpc.setFeedforward( applied );
+                _mpc.setTemperatureLimit( _targetTemperature + _temperatureMargin );
+                drive = _mpc.update( _targetTemperature, temperature, dt );
+            }
+            else {
+                drive = _pid.update( setPoint, temperature, slope - rate, dt );
+            }
+        }
+        else {
+            // start afresh when the regulator is switched back on
+            std::lock_guard<std::mutex> lock( *_mutex );
+            _pid.reset();
+            _mpc.reset();
+            _trajectory.reset();
+            _transition.active = false;
+
+            if ( _autotuneState == Autotune::Running && !_power ) {
+                _failAutotune( "regulator switched off" );
+            }
         }
 
         // clamp the output power to sensible range
@@ -226,24 +920,50 @@ void Regulator::_worker() {
         }    
 
         // Set the boiler power (uses pulse width modulation)
-        _boiler->setPower( drive );
+        const double delivered = _setBoilerPower( drive );
 
         // Store the latest temperature reading
         {
             std::lock_guard<std::mutex> lock( *_mutex );
             _latestTemp  = latestTemp;
             _latestPower = drive;
+
+            // the power budget cut the drive: the engines continue from the
+            // duty the boiler got, so they do not wind up during a long cap
+            if ( regulating && delivered != drive && _autotuneState != Autotune::Running ) {
+                if ( _engine == Engine::Predictive ) {
+                    _mpc.setAppliedOutput( delivered );
+                }
+                else {
+                    _pid.setAppliedOutput( delivered );
+                }
+            }
         }
 
-        // sleep for the remainder of the time step
-        double remain = next - getClock();
-        if ( remain > 0.0 ) {      
-            delayms( static_cast<int>(1.0E3 * remain) );
+        // in fixed time step mode, sleep for the remainder of the time step,
+        // following changes of the flow in between
+        if ( !perSample ) {
+            next += _timeStep;
+
+            double remain = next - getClock();
+            if ( remain <= 0.0 ) {
+                next = getClock();
+            }
+
+            while ( _run && remain > 0.0 ) {      
+                delayms( static_cast<int>(1.0E3 * std::min( remain, 1.0E-3 * REGULATOR_WAIT_MS )) + 1 );
+
+                if ( regulating ) {
+                    drive = _applyFeedforward( drive, applied );
+                }
+
+                remain = next - getClock();
+            }
         }
     };
 
     // Ensure the boiler is turned off before exit
-    _boiler->setPower( 0.0 );
+    _setBoilerPower( 0.0 );
 }
 
 //-----------------------------------------------------------------------------
@@ -0,0 +1,116 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include "samplehistory.h"
+
+//-----------------------------------------------------------------------------
+
+SampleHistory::SampleHistory( size_t window )
+    :_head( 0 )
+    ,_size( 0 )
+    ,_window( window )
+    ,_sum( 0 )
+    ,_moment( 0 )
+{
+    if ( _window < 2 ) {
+        _window = 2;
+    }
+    else if ( _window > CAPACITY ) {
+        _window = CAPACITY;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void SampleHistory::push( uint32_t tick, int value ) {
+    if ( _size < _window ) {
+        // window still filling: the new sample gets the next index
+        _moment += static_cast<int64_t>( _size ) * value;
+        _sum    += value;
+    }
+    else {
+        // slide the window: every index drops by one, the oldest sample
+        // leaves and the new one enters at index window - 1
+        const int oldest = _at( _window - 1 ).value;
+        _moment += static_cast<int64_t>( _window - 1 ) * value - ( _sum - oldest );
+        _sum    += value - oldest;
+    }
+
+    _samples[_head].tick  = tick;
+    _samples[_head].value = value;
+    _head = ( _head + 1 ) % CAPACITY;
+
+    if ( _size < CAPACITY ) {
+        ++_size;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void SampleHistory::clear() {
+    _head   = 0;
+    _size   = 0;
+    _sum    = 0;
+    _moment = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t SampleHistory::size() const {
+    return _size;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t SampleHistory::latest( Sample* samples, size_t count ) const {
+    if ( count > _size ) {
+        count = _size;
+    }
+
+    for ( size_t index = 0; index < count; ++index ) {
+        samples[index] = _at( count - 1 - index );
+    }
+
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+
+bool SampleHistory::slope( double& perSecond ) const {
+    if ( _size < _window ) {
+        return false;
+    }
+
+    // elapsed time across the window, in microseconds (tick wraps safely)
+    const uint32_t elapsed = _at( 0 ).tick - _at( _window - 1 ).tick;
+    if ( elapsed == 0 ) {
+        return false;
+    }
+
+    // least squares slope per sample:
+    //   sum( (k - c) * y ) / sum( (k - c)^2 ), c = (n - 1) / 2
+    // = ( 12 * moment - 6 * (n - 1) * sum ) / ( n * (n^2 - 1) )
+    const int64_t n = static_cast<int64_t>( _window );
+    const double numerator   = static_cast<double>( 12 * _moment - 6 * ( n - 1 ) * _sum );
+    const double denominator = static_cast<double>( n * ( n * n - 1 ) );
+
+    // convert to units per second using the mean sample interval
+    const double interval = static_cast<double>( elapsed ) / static_cast<double>( n - 1 );
+    perSecond = numerator / denominator * 1.0E6 / interval;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+const SampleHistory::Sample& SampleHistory::_at( size_t age ) const {
+    // age 0 is the newest sample
+    return _samples[( _head + CAPACITY - 1 - age ) % CAPACITY];
+}
+
+//-----------------------------------------------------------------------------
@@ -103,12 +103,208 @@ void Settings::getPreHeatingSettings( double& time, double& temperature ) const
 
 //-----------------------------------------------------------------------------
 
+void Settings::getRegulatorTimingSettings( bool& perSample, unsigned& decimation, double& sampleTimeout ) const {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    perSample     = ( _regulatorMode != 0 );
+    decimation    = _regulatorDecimation > 0 ? static_cast<unsigned>( _regulatorDecimation ) : 1;
+    sampleTimeout = _regulatorSampleTimeout;
+}
+
+//-----------------------------------------------------------------------------
+
+void Settings::getFeedforwardSettings( double& gain, double& heaterPower, double& inletTemperature, double& pumpFlowRate ) const {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    gain             = _feedforwardGain;
+    heaterPower      = _heaterPower;
+    inletTemperature = _inletTemperature;
+    pumpFlowRate     = _pumpFlowRate;
+}
+
+//-----------------------------------------------------------------------------
+
+void Settings::getRegulatorEngineSettings( bool& predictive, double& moveWeight, double& temperatureMargin ) const {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    predictive        = ( _regulatorEngine != 0 );
+    moveWeight        = _mpcMoveWeight;
+    temperatureMargin = _mpcTemperatureMargin;
+}
+
+//-----------------------------------------------------------------------------
+
+void Settings::getCascadeSettings( int& mode, double& targetTemperature, double& pGain, double& iGain, double& maxOffset ) const {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    mode              = _cascadeMode;
+    targetTemperature = _cascadeTargetTemperature;
+    pGain             = _cascadePGain;
+    iGain             = _cascadeIGain;
+    maxOffset         = _cascadeMaxOffset;
+}
+
+//-----------------------------------------------------------------------------
+
+void Settings::getOverTemperatureSettings( double& limit, double& maxRise ) const {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    limit   = _overTemperatureLimit;
+    maxRise = _overTemperatureRise;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Settings::getHardwareWatchdog() const {
+    if ( !_opened ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    return ( _hardwareWatchdog != 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+void Settings::getBoilerDriveSettings( bool& halfCycle, unsigned& mainsFrequency ) const {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    halfCycle      = ( _boilerDriveMode != 0 );
+    mainsFrequency = static_cast<unsigned>( _mainsFrequency );
+}
+
+//-----------------------------------------------------------------------------
+
+void Settings::getPowerBudgetSettings( double& pumpPower, double& peakLimit, double& averageLimit ) const {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    pumpPower    = _pumpPower;
+    peakLimit    = _peakPowerLimit;
+    averageLimit = _averagePowerLimit;
+}
+
+//-----------------------------------------------------------------------------
+
+int Settings::getEdgeBackend() const {
+    if ( !_opened ) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    return _edgeBackend;
+}
+
+//-----------------------------------------------------------------------------
+
+int Settings::getGPIOBackend() const {
+    if ( !_opened ) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    return _gpioBackend;
+}
+
+//-----------------------------------------------------------------------------
+
+void Settings::getGlitchFilterSettings( unsigned& flow, unsigned& tsic ) const {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    flow = static_cast<unsigned>( _flowGlitchFilter );
+    tsic = static_cast<unsigned>( _tsicGlitchFilter );
+}
+
+//-----------------------------------------------------------------------------
+
+void Settings::getTsicSensorSettings( bool& groupHead, bool& steamWand ) const {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    groupHead = ( _tsicGroupHead != 0 );
+    steamWand = ( _tsicSteamWand != 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+void Settings::setRegulatorGains( bool steam, double iGain, double pGain, double dGain ) {
+    if ( !_opened ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+
+    if ( steam ) {
+        _iSteamGain = iGain;
+        _pSteamGain = pGain;
+        _dSteamGain = dGain;
+    }
+    else {
+        _iDefaultGain = iGain;
+        _pDefaultGain = pGain;
+        _dDefaultGain = dGain;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool Settings::save() const {
+    if ( !_opened ) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( *_mutex );
+    return _store();
+}
+
+//-----------------------------------------------------------------------------
+
 bool Settings::_open() {
     _path = Utils::getApplicationPath();
 
     std::ifstream file;
     file.open( _path + "/settings.cfg" );
 
+    // Settings missing from an older file keep their defaults
+    _loadDefaults();
+
     if ( file.is_open() ) {
         std::string placeholder;
         file >> placeholder >> _iDefaultGain
@@ -122,13 +318,41 @@ bool Settings::_open() {
              >> placeholder >> _preHeatingTargetTemperature
              >> placeholder >> _preHeatingTime
              >> placeholder >> _flowOffset30
-             >> placeholder >> _flowOffset60;
+             >> placeholder >> _flowOffset60
+             >> placeholder >> _regulatorMode
+             >> placeholder >> _regulatorDecimation
+             >> placeholder >> _regulatorSampleTimeout
+             >> placeholder >> _feedforwardGain
+             >> placeholder >> _heaterPower
+             >> placeholder >> _inletTemperature
+             >> placeholder >> _pumpFlowRate
+             >> placeholder >> _regulatorEngine
+             >> placeholder >> _mpcMoveWeight
+             >> placeholder >> _mpcTemperatureMargin
+             >> placeholder >> _cascadeMode
+             >> placeholder >> _cascadeTargetTemperature
+             >> placeholder >> _cascadePGain
+             >> placeholder >> _cascadeIGain
+             >> placeholder >> _cascadeMaxOffset
+             >> placeholder >> _overTemperatureLimit
+             >> placeholder >> _overTemperatureRise
+             >> placeholder >> _hardwareWatchdog
+             >> placeholder >> _boilerDriveMode
+             >> placeholder >> _mainsFrequency
+             >> placeholder >> _pumpPower
+             >> placeholder >> _peakPowerLimit
+             >> placeholder >> _averagePowerLimit
+             >> placeholder >> _edgeBackend
+             >> placeholder >> _gpioBackend
+             >> placeholder >> _flowGlitchFilter
+             >> placeholder >> _tsicGlitchFilter
+             >> placeholder >> _tsicGroupHead
+             >> placeholder >> _tsicSteamWand;
 
         file.close();
     }
     else {
         LogWarning("No configuration file found, loading default settings");
-        _loadDefaults();
     }
 
     _mutex = new std::mutex();
@@ -140,34 +364,72 @@ bool Settings::_open() {
 //-----------------------------------------------------------------------------
 
 void Settings::_close() {
+    _store();
+
+    if ( _mutex ) {
+        delete _mutex;
+    }
+
+    return;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Settings::_store() const {
     std::ofstream file;
     file.open( _path + "/settings.cfg", std::ios::trunc );
 
     if ( !file.is_open() ) {
         LogError("Could not store settings file");
+        return false;
     }
     else {
-        file << "iDefaultGain "                << std::fixed << std::setprecision(2) << _iDefaultGain                << std::endl
-             << "pDefaultGain "                << std::fixed << std::setprecision(2) << _pDefaultGain                << std::endl
-             << "dDefaultGain "                << std::fixed << std::setprecision(2) << _dDefaultGain                << std::endl
-             << "iSteamGain "                  << std::fixed << std::setprecision(2) << _iSteamGain                  << std::endl
-             << "pSteamGain "                  << std::fixed << std::setprecision(2) << _pSteamGain                  << std::endl
-             << "dSteamGain "                  << std::fixed << std::setprecision(2) << _dSteamGain                  << std::endl
+        file << "iDefaultGain "                << std::defaultfloat << std::setprecision(6) << _iDefaultGain         << std::endl
+             << "pDefaultGain "                << std::defaultfloat << std::setprecision(6) << _pDefaultGain         << std::endl
+             << "dDefaultGain "                << std::defaultfloat << std::setprecision(6) << _dDefaultGain         << std::endl
+             << "iSteamGain "                  << std::defaultfloat << std::setprecision(6) << _iSteamGain           << std::endl
+             << "pSteamGain "                  << std::defaultfloat << std::setprecision(6) << _pSteamGain           << std::endl
+             << "dSteamGain "                  << std::defaultfloat << std::setprecision(6) << _dSteamGain           << std::endl
              << "defaultTargetTemperature "    << std::fixed << std::setprecision(1) << _defaultTargetTemperature    << std::endl
              << "steamTargetTemperature "      << std::fixed << std::setprecision(1) << _steamTargetTemperature      << std::endl
              << "preHeatingTargetTemperature " << std::fixed << std::setprecision(1) << _preHeatingTargetTemperature << std::endl
              << "preHeatingTime "              << std::fixed << std::setprecision(0) << _preHeatingTime              << std::endl
              << "flowOffset30 "                << std::fixed << std::setprecision(1) << _flowOffset30                << std::endl
-             << "flowOffset60 "                << std::fixed << std::setprecision(1) << _flowOffset60                << std::endl;
+             << "flowOffset60 "                << std::fixed << std::setprecision(1) << _flowOffset60                << std::endl
+             << "regulatorMode "               << _regulatorMode                                                     << std::endl
+             << "regulatorDecimation "         << _regulatorDecimation                                               << std::endl
+             << "regulatorSampleTimeout "      << std::fixed << std::setprecision(1) << _regulatorSampleTimeout      << std::endl
+             << "feedforwardGain "             << std::fixed << std::setprecision(2) << _feedforwardGain             << std::endl
+             << "heaterPower "                 << std::fixed << std::setprecision(0) << _heaterPower                 << std::endl
+             << "inletTemperature "            << std::fixed << std::setprecision(1) << _inletTemperature            << std::endl
+             << "pumpFlowRate "                << std::fixed << std::setprecision(1) << _pumpFlowRate                << std::endl
+             << "regulatorEngine "             << _regulatorEngine                                                   << std::endl
+             << "mpcMoveWeight "               << std::fixed << std::setprecision(1) << _mpcMoveWeight               << std::endl
+             << "mpcTemperatureMargin "        << std::fixed << std::setprecision(1) << _mpcTemperatureMargin        << std::endl
+             << "cascadeMode "                 << _cascadeMode                                                       << std::endl
+             << "cascadeTargetTemperature "    << std::fixed << std::setprecision(1) << _cascadeTargetTemperature    << std::endl
+             << "cascadePGain "                << std::defaultfloat << std::setprecision(6) << _cascadePGain         << std::endl
+             << "cascadeIGain "                << std::defaultfloat << std::setprecision(6) << _cascadeIGain         << std::endl
+             << "cascadeMaxOffset "            << std::fixed << std::setprecision(1) << _cascadeMaxOffset            << std::endl
+             << "overTemperatureLimit "        << std::fixed << std::setprecision(1) << _overTemperatureLimit        << std::endl
+             << "overTemperatureRise "         << std::fixed << std::setprecision(1) << _overTemperatureRise         << std::endl
+             << "hardwareWatchdog "            << _hardwareWatchdog                                                  << std::endl
+             << "boilerDriveMode "             << _boilerDriveMode                                                   << std::endl
+             << "mainsFrequency "              << _mainsFrequency                                                    << std::endl
+             << "pumpPower "                   << std::fixed << std::setprecision(1) << _pumpPower                   << std::endl
+             << "peakPowerLimit "              << std::fixed << std::setprecision(1) << _peakPowerLimit              << std::endl
+             << "averagePowerLimit "           << std::fixed << std::setprecision(1) << _averagePowerLimit           << std::endl
+             << "edgeBackend "                 << _edgeBackend                                                       << std::endl
+             << "gpioBackend "                 << _gpioBackend                                                       << std::endl
+             << "flowGlitchFilter "            << _flowGlitchFilter                                                  << std::endl
+             << "tsicGlitchFilter "            << _tsicGlitchFilter                                                  << std::endl
+             << "tsicGroupHead "               << _tsicGroupHead                                                     << std::endl
+             << "tsicSteamWand "               << _tsicSteamWand                                                     << std::endl;
 
         file.close();
     }
 
-    if ( _mutex ) {
-        delete _mutex;
-    }
-
-    return;
+    return true;
 }
 
 //-----------------------------------------------------------------------------
@@ -188,6 +450,46 @@ void Settings::_loadDefaults() {
 
     _flowOffset30 = 7.5;
     _flowOffset60 = 15.0;
+
+    _regulatorMode = 0;
+    _regulatorDecimation = 1;
+    _regulatorSampleTimeout = 1.0;
+
+    _feedforwardGain = 0.0;
+    _heaterPower = 1425.0;
+    _inletTemperature = 20.0;
+    _pumpFlowRate = 2.0;
+
+    _regulatorEngine = 0;
+    _mpcMoveWeight = 20.0;
+    _mpcTemperatureMargin = 5.0;
+
+    _cascadeMode = 0;
+    _cascadeTargetTemperature = 90.0;
+    _cascadePGain = 0.5;
+    _cascadeIGain = 0.005;
+    _cascadeMaxOffset = 15.0;
+
+    _overTemperatureLimit = 145.0;
+    _overTemperatureRise = 3.0;
+
+    _hardwareWatchdog = 0;
+
+    _boilerDriveMode = 0;
+    _mainsFrequency = 50;
+
+    _pumpPower = 50.0;
+    _peakPowerLimit = 0.0;
+    _averagePowerLimit = 0.0;
+
+    _edgeBackend = 0;
+    _gpioBackend = 0;
+
+    _flowGlitchFilter = 100;
+    _tsicGlitchFilter = 0;
+
+    _tsicGroupHead = 0;
+    _tsicSteamWand = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -0,0 +1,130 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include <math.h>
+
+#include "trajectory.h"
+
+//-----------------------------------------------------------------------------
+
+Trajectory::Trajectory()
+    :_riseRate( 1.0 )
+    ,_fallRate( 1.0 )
+    ,_acceleration( 1.0 )
+    ,_position( 0.0 )
+    ,_rate( 0.0 )
+    ,_currentAcceleration( 0.0 )
+    ,_started( false )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+void Trajectory::setLimits( double riseRate, double fallRate, double acceleration ) {
+    _riseRate     = riseRate > 0.0 ? riseRate : 0.0;
+    _fallRate     = fallRate > 0.0 ? fallRate : 0.0;
+    _acceleration = acceleration > 0.0 ? acceleration : 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+void Trajectory::start( double position ) {
+    _position = position;
+    _rate     = 0.0;
+    _started  = true;
+
+    _currentAcceleration = 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Trajectory::started() const {
+    return _started;
+}
+
+//-----------------------------------------------------------------------------
+
+void Trajectory::reset() {
+    _rate    = 0.0;
+    _started = false;
+
+    _currentAcceleration = 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+double Trajectory::update( double target, double dt ) {
+    if ( !_started ) {
+        start( target );
+        return _position;
+    }
+
+    if ( dt <= 0.0 ) {
+        return _position;
+    }
+
+    const double lastRate = _rate;
+
+    // fastest rate from which the profile can still brake to rest at the
+    // target, limited to the rising or falling rate
+    const double distance = target - _position;
+    double wanted = sqrt( 2.0 * _acceleration * fabs( distance ) );
+
+    if ( distance >= 0.0 ) {
+        wanted = ( wanted < _riseRate ) ? wanted : _riseRate;
+    }
+    else {
+        wanted = -( ( wanted < _fallRate ) ? wanted : _fallRate );
+    }
+
+    // approach it with the acceleration limit
+    const double change = _acceleration * dt;
+    if ( wanted > _rate + change ) {
+        _rate += change;
+    }
+    else if ( wanted < _rate - change ) {
+        _rate -= change;
+    }
+    else {
+        _rate = wanted;
+    }
+
+    // land on the target rather than stepping over it
+    const double step = _rate * dt;
+    if ( ( distance >= 0.0 && step >= distance ) || ( distance <= 0.0 && step <= distance ) ) {
+        _position = target;
+        _rate     = 0.0;
+    }
+    else {
+        _position += step;
+    }
+
+    _currentAcceleration = ( _rate - lastRate ) / dt;
+    return _position;
+}
+
+//-----------------------------------------------------------------------------
+
+double Trajectory::getPosition() const {
+    return _position;
+}
+
+//-----------------------------------------------------------------------------
+
+double Trajectory::getRate() const {
+    return _rate;
+}
+
+//-----------------------------------------------------------------------------
+
+double Trajectory::getAcceleration() const {
+    return _currentAcceleration;
+}
+
+//-----------------------------------------------------------------------------
@@ -17,6 +17,7 @@
 #include "tsic.h"
 #include <stdio.h>
 #include <unistd.h>
+#include <sstream>
 
 #include "pigpiomgr.h"
 #include "gpiopin.h"
@@ -29,93 +30,60 @@
 
 using namespace std;
 
-/// the total number of bits to read from the TSIC sensor
-static const unsigned TSIC_BITS = 20;
+/// interval at which buffered edges are decoded in milliseconds; a packet
+/// takes about 2.7ms (40 edges), so the edge buffer never gets close to full
+static const unsigned TSIC_DECODE_MS = 10;
 
-/// the length of the bit frame used by the TSIC sensor in microseconds
-static const unsigned TSIC_FRAME_US = 125;
+/// maximum number of edges decoded per batch
+static const size_t TSIC_BATCH = 64;
 
-/// scale factor used to convert sensor values to fixed point integer
-static const int SCALE_FACTOR = 1000;
+/// number of readings (at about 10Hz) used to fit the temperature slope
+static const size_t TSIC_SLOPE_WINDOW = 15;
 
-/// minimum temperature for sensor (must match device data)
-static const int MIN_TEMP = -50;
-
-/// maximum temperature for sensor (must match device data)
-static const int MAX_TEMP = 150;
-
-/// special value used to denote invalid sensor data
-static const int INVALID_TEMP = -100000;
+/// gap between valid readings after which the history is restarted (us)
+static const uint32_t TSIC_HISTORY_GAP_US = 1000000;
 
 //-----------------------------------------------------------------------------
 
-/// calculate parity for an eight bit value
-static int parity8( int value ) {
-    value = (value ^ (value >> 4)) & 0x0F;
-    return (0x6996 >> value) & 1;
+TSIC::Channel::Channel( unsigned gpio, GPIOPin::Pull pull, bool required, unsigned glitchFilter )
+    :gpio( gpio )
+    ,pull( pull )
+    ,required( required )
+    ,glitchFilter( glitchFilter )
+{
 }
 
 //-----------------------------------------------------------------------------
 
-// Decode two 9-bit packets from the sensor, and return the temperature.
-// Returns either a fixed point integer temperature multiplied by SCALE_FACTOR,
-// or INVALID_TEMP in case of error
-static int tsicDecode( int packet0, int packet1 ) {
-    // strip off the parity bits (LSB)
-    int parity0 = packet0 & 1;
-    packet0 >>= 1;
-    int parity1 = packet1 & 1;
-    packet1 >>= 1;
-
-    // check the parity on both bytes
-    bool valid =
-        ( parity0 == parity8(packet0) ) &&
-        ( parity1 == parity8(packet1) );
-
-    // if the parity is wrong, return INVALID_TEMP
-    if ( !valid ) {
-        LogWarning("TSIC: parity error");
-        return INVALID_TEMP;
-    }
-
-    // if any of the top 5 bits of packet 0 are high, that's an error
-    if ( (packet0 & 0xF8) != 0 ) {
-        LogWarning("TSIC: prefix error");
-        return INVALID_TEMP;
-    }
-
-    // this is our raw 11 bit word */
-    int raw = (packet0 << 8) | packet1;
+TSIC::Sensor::Sensor( const Channel& channel )
+    :channel( channel )
+    ,pin( 0 )
+    ,history( TSIC_SLOPE_WINDOW )
+{
+}
 
-    // convert raw integer to temperature in degrees C
-    int temp = (MAX_TEMP - MIN_TEMP) * SCALE_FACTOR * raw / 2047 + MIN_TEMP * SCALE_FACTOR;
+//-----------------------------------------------------------------------------
 
-    // check that the temperature lies in the measurable range
-    if ( (temp >= MIN_TEMP * SCALE_FACTOR) && (temp <= MAX_TEMP * SCALE_FACTOR) ) {
-        // all looks good
-        return temp;
-    } 
-    else {
-        // parity looked good, but the value is out of the valid range
-        return INVALID_TEMP;
-    }
+TSIC::TSIC( unsigned gpio ) 
+    :_opened( false )
+    ,_overflows( 0 )
+    ,_run( false )
+{
+    _sensors.push_back( new Sensor( Channel( gpio ) ) );
+    _open();
 }
 
 //-----------------------------------------------------------------------------
 
-TSIC::TSIC( unsigned gpio ) 
-    :_pin( 0 )
-    ,_gpio( gpio )
-    ,_opened( false )
-    ,_valid( false )
-    ,_temperature( 0.0 )
-    //,_callback( -1 )
-    ,_count( 0 )
-    ,_lastLow( 0 )
-    ,_lastHigh( 0 )
-    ,_word( 0 )
-    ,_running( false )
+TSIC::TSIC( const std::vector<Channel>& channels ) 
+    :_opened( false )
+    ,_overflows( 0 )
+    ,_run( false )
 {
+    for ( size_t sensor = 0; sensor < channels.size(); ++sensor ) {
+        _sensors.push_back( new Sensor( channels[sensor] ) );
+    }
+
     _open();
 }
 
@@ -123,6 +91,11 @@ TSIC::TSIC( unsigned gpio )
 
 TSIC::~TSIC() {
     _close();
+
+    for ( size_t sensor = 0; sensor < _sensors.size(); ++sensor ) {
+        delete _sensors[sensor];
+    }
+    _sensors.clear();
 }
 
 //-----------------------------------------------------------------------------
@@ -133,54 +106,66 @@ void TSIC::_open() {
         return;
     }
 
-    _pin = new GPIOPin( _gpio );
-
-    if ( !_pin->ready() ) {
-        LogError("TSIC GPIO-Pin could not be opened");
-        _close();
-        return;
-    }
-    
-    if ( !_pin->setOutput( false ) ) {
-        LogError("TSIC GPIO-Pin could not be set as input");
-        _close();
+    if ( _sensors.empty() ) {
+        LogError("No TSIC sensors configured, aborting TSIC initialization");
         return;
     }
 
-    if ( set_pull_up_down( 15, 2 ) != 0) {
-        LogError("Could not register pull down resistor for TSIC pin");
-        _close();
-        return;
+    // The lookup table must be complete before the first edge arrives
+    for ( size_t gpio = 0; gpio < MAX_GPIO; ++gpio ) {
+        _sensorOfGpio[gpio] = -1;
     }
 
-    if ( !_pin->setEdgeTrigger( GPIOPin::Both ) ) {
-        LogError("Could not register edge trigger for TSIC pin");
-        _close();
-        return;
+    for ( size_t sensor = 0; sensor < _sensors.size(); ++sensor ) {
+        const unsigned gpio = _sensors[sensor]->channel.gpio;
+
+        if ( gpio >= MAX_GPIO || _sensorOfGpio[gpio] >= 0 ) {
+            LogError("TSIC GPIO-Pin " << gpio << " is invalid or used twice, aborting TSIC initialization");
+            return;
+        }
+
+        _sensorOfGpio[gpio] = static_cast<int>( sensor );
     }
 
-    if ( !_pin->edgeFuncRegister( std::bind( &TSIC::_alertFunction, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3 ) ) ) {
-        LogError("Could not register callback for TSIC pin");
-        _close();
-        return;
+    // Start decoding before edges start to arrive
+    _run = true;
+    _thread = std::thread( &TSIC::_worker, this );
+
+    for ( size_t sensor = 0; sensor < _sensors.size(); ++sensor ) {
+        if ( !_openSensor( sensor ) && _sensors[sensor]->channel.required ) {
+            _close();
+            return;
+        }
     }
 
-    // Wait for a packet to arrive
+    // Wait for a packet to arrive from every sensor
     bool success = false;
     for ( size_t count = 0; !success & ( count < 10 ); ++count ) {
         // Sample rate is 10Hz, so we need to wait at least 1/10th second
         delayms( 100 );
 
-        // Attempt to read the value
-        double value = 0.0;
-        success = getDegrees( value );
+        // Attempt to read the values
+        success = true;
+        for ( size_t sensor = 0; sensor < _sensors.size(); ++sensor ) {
+            double value = 0.0;
+            success &= getDegrees( value, sensor ) || ( _sensors[sensor]->pin == 0 );
+        }
     }
 
-    // Did we receive some data?
-    if ( !success ) {
-        LogError("Could not take a sampling reading for TSIC sensor, aborting TSIC initialization");
-        _close();
-        return;
+    // Did we receive some data? Optional sensors may stay silent
+    for ( size_t sensor = 0; sensor < _sensors.size(); ++sensor ) {
+        double value = 0.0;
+        if ( getDegrees( value, sensor ) ) {
+            continue;
+        }
+
+        if ( _sensors[sensor]->channel.required ) {
+            LogError("Could not take a sampling reading for TSIC sensor on GPIO " << _sensors[sensor]->channel.gpio << ", aborting TSIC initialization");
+            _close();
+            return;
+        }
+
+        LogWarning("No reading from optional TSIC sensor on GPIO " << _sensors[sensor]->channel.gpio);
     }
 
     // set flag to indicate we are open
@@ -189,16 +174,120 @@ void TSIC::_open() {
 
 //-----------------------------------------------------------------------------
 
+bool TSIC::_openSensor( size_t sensor ) {
+    Sensor& entry = *_sensors[sensor];
+
+    entry.pin = new GPIOPin( entry.channel.gpio );
+
+    if ( !entry.pin->ready() ) {
+        LogError("TSIC GPIO-Pin " << entry.channel.gpio << " could not be opened");
+    }
+    else if ( !entry.pin->setOutput( false ) ) {
+        LogError("TSIC GPIO-Pin " << entry.channel.gpio << " could not be set as input");
+    }
+    else if ( !entry.pin->setPullUpDown( entry.channel.pull ) ) {
+        LogError("Could not set pull resistor for TSIC pin " << entry.channel.gpio);
+    }
+    else if ( !entry.pin->setEdgeTrigger( GPIOPin::Both ) ) {
+        LogError("Could not register edge trigger for TSIC pin " << entry.channel.gpio);
+    }
+    else if ( entry.channel.glitchFilter > 0 && !entry.pin->setGlitchFilter( entry.channel.glitchFilter ) ) {
+        LogError("Could not set glitch filter for TSIC pin " << entry.channel.gpio);
+    }
+    else if ( !entry.pin->edgeMethodRegister<TSIC, &TSIC::_alertFunction>( this ) ) {
+        LogError("Could not register callback for TSIC pin " << entry.channel.gpio);
+    }
+    else {
+        return true;
+    }
+
+    delete entry.pin;
+    entry.pin = 0;
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+
 void TSIC::_close() {
-    delete _pin;
+    // Stop the callbacks before the worker that drains their edges
+    for ( size_t sensor = 0; sensor < _sensors.size(); ++sensor ) {
+        delete _sensors[sensor]->pin;
+        _sensors[sensor]->pin = 0;
+    }
+
+    if ( _run ) {
+        _run = false;
+        _thread.join();
+    }
+
+    if ( _edges.overflows() > 0 ) {
+        LogWarning("TSIC: " << _edges.overflows() << " edges dropped (buffer high water " << _edges.highWater() << ")");
+    }
+
+    if ( _opened ) {
+        for ( size_t sensor = 0; sensor < _sensors.size(); ++sensor ) {
+            _logStatistics( sensor );
+        }
+    }
+
+    _opened = false;
 }
 
 //-----------------------------------------------------------------------------
 
-bool TSIC::getDegrees( double & value ) const {
-    std::lock_guard<std::mutex> lock( _mutex );
-    value = _temperature;
-    return _valid;
+/// format the non-empty bins of a histogram, e.g. "30-40:12 40-50:3"
+static std::string formatHistogram( const TSICDecoder::Histogram& histogram, uint32_t divisor ) {
+    std::ostringstream text;
+
+    for ( size_t bin = 0; bin < TSICDecoder::Histogram::BINS; ++bin ) {
+        if ( histogram.counts[bin] == 0 ) {
+            continue;
+        }
+
+        const uint32_t from = bin * histogram.binWidth / divisor;
+        text << " " << from;
+
+        if ( bin + 1 < TSICDecoder::Histogram::BINS ) {
+            text << "-" << ( from + histogram.binWidth / divisor );
+        }
+        else {
+            text << "+";
+        }
+
+        text << ":" << histogram.counts[bin];
+    }
+
+    return text.str();
+}
+
+//-----------------------------------------------------------------------------
+
+void TSIC::_logStatistics( size_t sensor ) const {
+    TSICDecoder::Statistics statistics;
+    getStatistics( statistics, sensor );
+
+    const unsigned gpio = _sensors[sensor]->channel.gpio;
+
+    LogInfo("TSIC GPIO " << gpio << ": " << statistics.packets << " packets, "
+        << statistics.parityErrors << " parity errors, "
+        << statistics.prefixErrors << " prefix errors, "
+        << statistics.rangeErrors << " range errors, "
+        << statistics.frameResets << " frame resets");
+    LogInfo("TSIC GPIO " << gpio << ": low width [us]" << formatHistogram( statistics.lowWidth, 1 ));
+    LogInfo("TSIC GPIO " << gpio << ": high width [us]" << formatHistogram( statistics.highWidth, 1 ));
+    LogInfo("TSIC GPIO " << gpio << ": packet interval [ms]" << formatHistogram( statistics.interval, 1000 ));
+}
+
+//-----------------------------------------------------------------------------
+
+bool TSIC::getDegrees( double & value, size_t sensor ) const {
+    if ( sensor >= _sensors.size() ) {
+        return false;
+    }
+
+    const Sample sample = _sensors[sensor]->sample.load();
+    value = sample.temperature;
+    return sample.valid;
 }
 
 //-----------------------------------------------------------------------------
@@ -209,72 +298,206 @@ bool TSIC::ready() const {
 
 //-----------------------------------------------------------------------------
 
-void TSIC::_alertFunction( int gpio, int level, uint32_t tick ) {
-    if ( level == 1 ) {
-        _lastHigh = tick;
+size_t TSIC::getSensorCount() const {
+    return _sensors.size();
+}
 
-        /*if ( _lastLow == 0 ) {
-            return;
-        }*/
-
-        // Bus went high
-        const uint32_t timeLow = tick - _lastLow;
-
-        if ( timeLow < TSIC_FRAME_US / 2 ) {
-            // High bit
-            _word = (_word << 1) | 1;
-        } 
-        else if ( timeLow < TSIC_FRAME_US ) {
-            // Low bit
-            _word <<= 1;
-        } 
-        else if ( timeLow > TSIC_FRAME_US * 2 ) {
-            // Low for more than one frame, which should never happen and
-            // must therefore be an invalid bit: start again
-            _count = 0;
-            _word  = 0;
-            return;
-        }
+//-----------------------------------------------------------------------------
+
+uint32_t TSIC::getSampleCount( size_t sensor ) const {
+    if ( sensor >= _sensors.size() ) {
+        return 0;
+    }
 
-        if ( ++_count == TSIC_BITS ) {
-            // Decode the packet
-            int result = tsicDecode(
-                (_word >> 10) & 0x1FF, // packet 0
-                _word & 0x1FF          // packet 1
-            );
+    return _sensors[sensor]->sample.sequence();
+}
 
-            // Update the temperature value
-            {
-                // Lock the mutex
-                std::lock_guard<std::mutex> lock( _mutex );
-
-                // Update the temperature value and validity flag
-                if ( result != INVALID_TEMP ) {
-                    _temperature = static_cast<double>( result ) / static_cast<double>( SCALE_FACTOR );
-                    _valid = true;
-                } 
-                else {
-                    _valid = false;
+//-----------------------------------------------------------------------------
+
+bool TSIC::waitForSample( uint32_t& sampleCount, unsigned timeoutMs, size_t sensor ) const {
+    if ( sensor >= _sensors.size() ) {
+        return false;
+    }
+
+    const SeqLock<Sample>& sample = _sensors[sensor]->sample;
+    const uint32_t previous = sampleCount;
+
+    std::unique_lock<std::mutex> lock( _sampleMutex );
+    const bool arrived = _sampleReady.wait_for( lock, std::chrono::milliseconds( timeoutMs ), [&] {
+        return sample.sequence() != previous;
+    } );
+
+    sampleCount = sample.sequence();
+    return arrived;
+}
+
+//-----------------------------------------------------------------------------
+
+double TSIC::getConfidence( size_t sensor ) const {
+    if ( sensor >= _sensors.size() ) {
+        return 0.0;
+    }
+
+    return _sensors[sensor]->sample.load().confidence;
+}
+
+//-----------------------------------------------------------------------------
+
+bool TSIC::getSlope( double& degreesPerSecond, size_t sensor ) const {
+    if ( sensor >= _sensors.size() ) {
+        return false;
+    }
+
+    const Sample sample = _sensors[sensor]->sample.load();
+    degreesPerSecond = sample.slope;
+    return sample.valid && sample.slopeValid;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t TSIC::getHistory( Reading* readings, size_t count, size_t sensor ) const {
+    SampleHistory::Sample samples[SampleHistory::CAPACITY];
+
+    if ( sensor >= _sensors.size() ) {
+        return 0;
+    }
+
+    if ( count > SampleHistory::CAPACITY ) {
+        count = SampleHistory::CAPACITY;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        count = _sensors[sensor]->history.latest( samples, count );
+    }
+
+    for ( size_t index = 0; index < count; ++index ) {
+        readings[index].tick = samples[index].tick;
+        readings[index].temperature = static_cast<double>( samples[index].value ) / static_cast<double>( TSICDecoder::SCALE_FACTOR );
+    }
+
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+
+void TSIC::getStatistics( TSICDecoder::Statistics& statistics, size_t sensor ) const {
+    if ( sensor >= _sensors.size() ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    statistics = _sensors[sensor]->decoder.statistics();
+}
+
+//-----------------------------------------------------------------------------
+
+void TSIC::setPacketHook( const PacketHook& hook ) {
+    std::lock_guard<std::mutex> lock( _mutex );
+    _packetHook = hook;
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned TSIC::getEdgeOverflows() const {
+    return _edges.overflows();
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned TSIC::getEdgeHighWater() const {
+    return _edges.highWater();
+}
+
+//-----------------------------------------------------------------------------
+
+void TSIC::_alertFunction( unsigned pin, bool level, unsigned tick ) {
+    // Runs on the pigpiod callback thread shared with flow and ranger, so
+    // only record the edge here and leave the decoding to the worker
+    Edge edge;
+    edge.tick  = tick;
+    edge.gpio  = static_cast<uint8_t>( pin );
+    edge.level = level;
+    _edges.push( edge );
+}
+
+//-----------------------------------------------------------------------------
+
+void TSIC::_worker() {
+    Edge batch[TSIC_BATCH];
+
+    while ( _run ) {
+        delayms( TSIC_DECODE_MS );
+
+        bool published = false;
+        size_t count = 0;
+        while ( ( count = _edges.pop( batch, TSIC_BATCH ) ) > 0 ) {
+            std::lock_guard<std::mutex> lock( _mutex );
+
+            // Edges were lost, so the packets in progress are corrupt
+            const uint32_t overflows = _edges.overflows();
+            if ( overflows != _overflows ) {
+                _overflows = overflows;
+                for ( size_t sensor = 0; sensor < _sensors.size(); ++sensor ) {
+                    _sensors[sensor]->decoder.reset();
                 }
             }
 
-            // prepare to receive a new packet
-            _count = 0;
-            _word = 0;
+            for ( size_t index = 0; index < count; ++index ) {
+                const int sensor = _sensorOfGpio[batch[index].gpio % MAX_GPIO];
+                if ( sensor < 0 ) {
+                    continue;
+                }
+
+                Sensor& entry = *_sensors[sensor];
+
+                TSICDecoder::Packet packet;
+                if ( !entry.decoder.edge( batch[index].level, batch[index].tick, packet ) ) {
+                    continue;
+                }
+
+                // Publish the temperature value and validity flag; on error
+                // the last good temperature is kept but flagged as invalid
+                Sample sample = entry.sample.load();
+
+                if ( packet.valid ) {
+                    sample.temperature = static_cast<double>( packet.temperature ) / static_cast<double>( TSICDecoder::SCALE_FACTOR );
+
+                    // Readings too far apart do not belong to the same fit
+                    SampleHistory::Sample last;
+                    if ( entry.history.latest( &last, 1 ) == 1 && packet.tick - last.tick > TSIC_HISTORY_GAP_US ) {
+                        entry.history.clear();
+                    }
+
+                    entry.history.push( packet.tick, packet.temperature );
+
+                    double slope = 0.0;
+                    sample.slopeValid = entry.history.slope( slope );
+                    sample.slope = slope / static_cast<double>( TSICDecoder::SCALE_FACTOR );
+
+                    // Safety checks see the packet before anyone else does
+                    if ( _packetHook ) {
+                        Reading reading;
+                        reading.tick        = packet.tick;
+                        reading.temperature = sample.temperature;
+                        _packetHook( static_cast<size_t>( sensor ), reading, sample.slope, sample.slopeValid );
+                    }
+                }
+
+                sample.valid      = packet.valid;
+                sample.confidence = packet.confidence;
+                entry.sample.store( sample );
+                published = true;
+            }
         }
-    } 
-    else {
-         // bus went low
-        _lastLow = tick;
-
-        // calculate time spent high
-        const uint32_t timeHigh = tick - _lastHigh;
-            
-        // If the bus has been high for more than one frame, reset the
-        // counters to start a new packet
-        if ( timeHigh > TSIC_FRAME_US * 2 ) {
-            _count = 0;
-            _word  = 0;
+
+        // Wake up anyone waiting for a sample; taking the mutex orders the
+        // notification after a waiter has checked the sequence numbers
+        if ( published ) {
+            {
+                std::lock_guard<std::mutex> lock( _sampleMutex );
+            }
+            _sampleReady.notify_all();
         }
     }
 }
@@ -0,0 +1,360 @@
+//-----------------------------------------------------------------------------
+//
+// Copyright (C) 2014-2015 James Ward
+// Copyright (C) 2015 Alexander Giesler
+//
+// This software is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+//-----------------------------------------------------------------------------
+
+#include "tsicdecoder.h"
+
+//-----------------------------------------------------------------------------
+
+/// the total number of bits to read from the TSIC sensor (two bytes, each
+/// made of a strobe bit, eight data bits and a parity bit)
+static const unsigned TSIC_BITS = 20;
+
+/// the number of bits per byte, including the strobe bit
+static const unsigned TSIC_BYTE_BITS = 10;
+
+/// the nominal length of the bit frame used by the TSIC sensor in microseconds
+static const unsigned TSIC_FRAME_US = 125;
+
+/// shortest accepted strobe low time (nominally half a frame); the window is
+/// wide enough for 20% clock skew of the sensor plus edge jitter
+static const unsigned STROBE_MIN_US = TSIC_FRAME_US / 5;
+
+/// longest accepted strobe low time
+static const unsigned STROBE_MAX_US = TSIC_FRAME_US;
+
+/// weight of a new strobe measurement in the bit period estimate
+static const double STROBE_FILTER = 0.25;
+
+/// scale factor used to convert sensor values to fixed point integer
+static const int SCALE_FACTOR = TSICDecoder::SCALE_FACTOR;
+
+/// minimum temperature for sensor (must match device data)
+static const int MIN_TEMP = -50;
+
+/// maximum temperature for sensor (must match device data)
+static const int MAX_TEMP = 150;
+
+/// special value used to denote invalid sensor data
+static const int INVALID_TEMP = TSICDecoder::INVALID_TEMPERATURE;
+
+//-----------------------------------------------------------------------------
+
+/// calculate parity for an eight bit value
+static constexpr int parity8( int value ) {
+    return (0x6996 >> ((value ^ (value >> 4)) & 0x0F)) & 1;
+}
+
+//-----------------------------------------------------------------------------
+
+/// packet flag: the parity bit (LSB) of a 9-bit packet matches its data
+static const uint8_t PARITY_OK = 1;
+
+/// packet flag: the top 5 data bits are clear, as required for packet 0
+static const uint8_t PREFIX_OK = 2;
+
+/// validity flags for a 9-bit packet
+static constexpr uint8_t packetFlags( int packet ) {
+    return ( ( (packet & 1) == parity8(packet >> 1) ) ? PARITY_OK : 0 ) |
+           ( ( ((packet >> 1) & 0xF8) == 0 ) ? PREFIX_OK : 0 );
+}
+
+/// convert raw 11 bit value to temperature in degrees C * SCALE_FACTOR
+static constexpr int rawTemperature( int raw ) {
+    return (MAX_TEMP - MIN_TEMP) * SCALE_FACTOR * raw / 2047 + MIN_TEMP * SCALE_FACTOR;
+}
+
+//-----------------------------------------------------------------------------
+
+/// list of table indices, expanded at compile time
+template <int... I> struct Indices {};
+
+template <typename A, typename B> struct JoinIndices;
+
+template <int... A, int... B>
+struct JoinIndices< Indices<A...>, Indices<B...> > {
+    typedef Indices<A..., ( static_cast<int>( sizeof...(A) ) + B )...> type;
+};
+
+/// Indices<0, 1, ... N-1>, built by halving to keep template depth low
+template <int N>
+struct MakeIndices {
+    typedef typename JoinIndices<
+        typename MakeIndices<N / 2>::type,
+        typename MakeIndices<N - N / 2>::type
+    >::type type;
+};
+
+template <> struct MakeIndices<0> { typedef Indices<> type; };
+template <> struct MakeIndices<1> { typedef Indices<0> type; };
+
+//-----------------------------------------------------------------------------
+
+template <typename I> struct PacketTable;
+
+/// Validity flags for every possible 9-bit packet
+template <int... I>
+struct PacketTable< Indices<I...> > {
+    static constexpr uint8_t flags[sizeof...(I)] = { packetFlags( I )... };
+};
+
+template <int... I> constexpr uint8_t PacketTable< Indices<I...> >::flags[sizeof...(I)];
+
+template <typename I> struct TemperatureTable;
+
+/// Temperature for every possible raw 11 bit value
+template <int... I>
+struct TemperatureTable< Indices<I...> > {
+    static constexpr int value[sizeof...(I)] = { rawTemperature( I )... };
+};
+
+template <int... I> constexpr int TemperatureTable< Indices<I...> >::value[sizeof...(I)];
+
+typedef PacketTable< MakeIndices<512>::type > Packets;
+typedef TemperatureTable< MakeIndices<2048>::type > Temperatures;
+
+static_assert( Temperatures::value[0] == MIN_TEMP * SCALE_FACTOR, "TSIC table: minimum temperature" );
+static_assert( Temperatures::value[2047] == MAX_TEMP * SCALE_FACTOR, "TSIC table: maximum temperature" );
+static_assert( Temperatures::value[1023] == rawTemperature( 1023 ), "TSIC table: conversion" );
+static_assert( Packets::flags[0x00F] == ( PARITY_OK | PREFIX_OK ), "TSIC table: parity/prefix" );
+static_assert( Packets::flags[0x00E] == PREFIX_OK, "TSIC table: parity/prefix" );
+static_assert( Packets::flags[0x0FF] == PARITY_OK, "TSIC table: parity/prefix" );
+
+//-----------------------------------------------------------------------------
+
+// Decode two 9-bit packets from the sensor, and return the temperature.
+// Returns either a fixed point integer temperature multiplied by SCALE_FACTOR,
+// or INVALID_TEMP in case of error (counted in statistics)
+static int tsicDecode( int packet0, int packet1, TSICDecoder::Statistics& statistics ) {
+    const uint8_t flags0 = Packets::flags[packet0 & 0x1FF];
+    const uint8_t flags1 = Packets::flags[packet1 & 0x1FF];
+
+    // if the parity is wrong on either byte, return INVALID_TEMP
+    if ( ( flags0 & flags1 & PARITY_OK ) == 0 ) {
+        ++statistics.parityErrors;
+        return INVALID_TEMP;
+    }
+
+    // if any of the top 5 bits of packet 0 are high, that's an error
+    if ( ( flags0 & PREFIX_OK ) == 0 ) {
+        ++statistics.prefixErrors;
+        return INVALID_TEMP;
+    }
+
+    // this is our raw 11 bit word (parity bits stripped off)
+    const int raw = ( (packet0 >> 1) << 8 ) | ( (packet1 >> 1) & 0xFF );
+
+    // convert raw integer to temperature in degrees C
+    const int temp = Temperatures::value[raw];
+
+    // check that the temperature lies in the measurable range
+    if ( (temp >= MIN_TEMP * SCALE_FACTOR) && (temp <= MAX_TEMP * SCALE_FACTOR) ) {
+        // all looks good
+        return temp;
+    } 
+    else {
+        // parity looked good, but the value is out of the valid range
+        ++statistics.rangeErrors;
+        return INVALID_TEMP;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+TSICDecoder::Histogram::Histogram( uint32_t width )
+    :binWidth( width )
+{
+    for ( size_t index = 0; index < BINS; ++index ) {
+        counts[index] = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void TSICDecoder::Histogram::add( uint32_t value ) {
+    size_t bin = value / binWidth;
+    if ( bin >= BINS ) {
+        bin = BINS - 1;
+    }
+
+    ++counts[bin];
+}
+
+//-----------------------------------------------------------------------------
+
+TSICDecoder::Statistics::Statistics()
+    :packets( 0 )
+    ,parityErrors( 0 )
+    ,prefixErrors( 0 )
+    ,rangeErrors( 0 )
+    ,frameResets( 0 )
+    ,lowWidth( 10 )
+    ,highWidth( 10 )
+    ,interval( 10000 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+TSICDecoder::TSICDecoder()
+    :_count( 0 )
+    ,_lastLow( 0 )
+    ,_lastHigh( 0 )
+    ,_strobe( TSIC_FRAME_US / 2 )
+    ,_calibrated( false )
+    ,_synchronised( false )
+    ,_word( 0 )
+    ,_confidence( 1.0 )
+    ,_lastPacket( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+void TSICDecoder::reset() {
+    _count = 0;
+    _word  = 0;
+    _confidence = 1.0;
+
+    // wait for the gap between packets before decoding again, rather than
+    // mistaking a data bit for the next strobe
+    _synchronised = false;
+}
+
+//-----------------------------------------------------------------------------
+
+const TSICDecoder::Statistics& TSICDecoder::statistics() const {
+    return _statistics;
+}
+
+//-----------------------------------------------------------------------------
+
+int TSICDecoder::decode( int packet0, int packet1, Statistics& statistics ) {
+    return tsicDecode( packet0, packet1, statistics );
+}
+
+//-----------------------------------------------------------------------------
+
+bool TSICDecoder::edge( bool level, uint32_t tick, Packet& packet ) {
+    if ( !level ) {
+        // bus went low: calculate time spent high
+        const uint32_t timeHigh = tick - _lastHigh;
+        _lastLow = tick;
+
+        // Inside a packet the bus is high for at most the stop bit plus the
+        // high part of the parity bit (1.75 frames). If it has been high for
+        // longer than 2.5 measured frames, this edge starts a new packet
+        if ( timeHigh > _strobe * 5 ) {
+            if ( _count > 0 ) {
+                ++_statistics.frameResets;
+            }
+
+            reset();
+            _synchronised = true;
+        }
+        else if ( _count > 0 ) {
+            _statistics.highWidth.add( timeHigh );
+        }
+
+        return false;
+    }
+
+    // bus went high: calculate time spent low
+    _lastHigh = tick;
+    const uint32_t timeLow = tick - _lastLow;
+
+    if ( !_synchronised ) {
+        return false;
+    }
+
+    _statistics.lowWidth.add( timeLow );
+
+    if ( _count % TSIC_BYTE_BITS == 0 ) {
+        // Strobe bit, low for half a frame: measure it, or give up on the
+        // packet if this cannot have been a strobe
+        if ( timeLow < STROBE_MIN_US || timeLow > STROBE_MAX_US ) {
+            ++_statistics.frameResets;
+            reset();
+            return false;
+        }
+
+        // The bit period drifts slowly with sensor temperature, so average
+        // the strobes to keep a single noisy edge from moving the threshold
+        if ( _calibrated ) {
+            _strobe += ( static_cast<double>( timeLow ) - _strobe ) * STROBE_FILTER;
+        }
+        else {
+            _strobe = timeLow;
+            _calibrated = true;
+        }
+
+        ++_count;
+        return false;
+    }
+
+    if ( timeLow >= _strobe * 3 ) {
+        // Low for one and a half frames, which should never happen and
+        // must therefore be an invalid bit: start again
+        ++_statistics.frameResets;
+        reset();
+        return false;
+    }
+
+    // A one is low for a quarter frame and a zero for three quarters, half a
+    // frame (one strobe) away from each other
+    const bool one = ( timeLow < _strobe );
+    _word = (_word << 1) | ( one ? 1 : 0 );
+
+    // Margin from the threshold relative to the ideal margin
+    const double distance = one ? ( _strobe - timeLow ) : ( timeLow - _strobe );
+    double margin = 2.0 * distance / _strobe;
+    if ( margin > 1.0 ) {
+        margin = 1.0;
+    }
+
+    if ( margin < _confidence ) {
+        _confidence = margin;
+    }
+
+    if ( ++_count < TSIC_BITS ) {
+        return false;
+    }
+
+    // Decode the packet (strobe bits are not stored in the word)
+    const int result = tsicDecode(
+        (_word >> 9) & 0x1FF, // packet 0
+        _word & 0x1FF,        // packet 1
+        _statistics
+    );
+
+    if ( _statistics.packets > 0 ) {
+        _statistics.interval.add( tick - _lastPacket );
+    }
+
+    ++_statistics.packets;
+    _lastPacket = tick;
+
+    packet.valid       = ( result != INVALID_TEMP );
+    packet.temperature = packet.valid ? result : 0;
+    packet.confidence  = _confidence;
+    packet.tick        = tick;
+
+    // prepare to receive a new packet
+    reset();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
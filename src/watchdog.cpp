@@ -0,0 +1,263 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "watchdog.h"
+#include "timing.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// interval at which the deadlines are checked and the device is fed (ms)
+static const unsigned WATCHDOG_POLL_MS = 100;
+
+/// Linux hardware watchdog device
+static const char* WATCHDOG_DEVICE = "/dev/watchdog";
+
+//-----------------------------------------------------------------------------
+
+Watchdog::Loop::Loop()
+    :deadline( 0.0 )
+    ,lastCheckIn( 0.0 )
+    ,stalledSince( 0.0 )
+    ,critical( true )
+    ,used( false )
+    ,stalled( false )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+Watchdog::Watchdog( bool hardware )
+    :_opened( false )
+    ,_device( -1 )
+    ,_nextFailsafe( 0 )
+    ,_stalls( 0 )
+    ,_run( false )
+{
+    _open( hardware );
+}
+
+//-----------------------------------------------------------------------------
+
+Watchdog::~Watchdog() {
+    _close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool Watchdog::ready() const {
+    return _opened;
+}
+
+//-----------------------------------------------------------------------------
+
+int Watchdog::add( const std::string& name, double deadline, bool critical ) {
+    if ( !_opened ) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    for ( size_t index = 0; index < MAX_LOOPS; ++index ) {
+        Loop& loop = _loops[index];
+        if ( loop.used ) {
+            continue;
+        }
+
+        loop.name     = name;
+        loop.deadline = deadline;
+        loop.critical = critical;
+        loop.lastCheckIn.store( getClock() );
+        loop.stalled  = false;
+        loop.used     = true;
+        return static_cast<int>( index );
+    }
+
+    LogError("Watchdog: no room to monitor the " << name << " thread");
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+
+void Watchdog::remove( int loop ) {
+    if ( loop < 0 || loop >= static_cast<int>( MAX_LOOPS ) ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    _loops[loop].used = false;
+}
+
+//-----------------------------------------------------------------------------
+
+void Watchdog::checkIn( int loop ) {
+    if ( loop < 0 || loop >= static_cast<int>( MAX_LOOPS ) ) {
+        return;
+    }
+
+    _loops[loop].lastCheckIn.store( getClock(), std::memory_order_relaxed );
+}
+
+//-----------------------------------------------------------------------------
+
+int Watchdog::addFailsafe( const Failsafe& failsafe ) {
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    const int handle = _nextFailsafe++;
+    _failsafes.push_back( std::make_pair( handle, failsafe ) );
+    return handle;
+}
+
+//-----------------------------------------------------------------------------
+
+void Watchdog::removeFailsafe( int failsafe ) {
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    for ( size_t index = 0; index < _failsafes.size(); ++index ) {
+        if ( _failsafes[index].first == failsafe ) {
+            _failsafes.erase( _failsafes.begin() + index );
+            return;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned Watchdog::getStallCount() const {
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _stalls;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Watchdog::getTrip( std::string& name ) const {
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    name = _trip;
+    return !_trip.empty();
+}
+
+//-----------------------------------------------------------------------------
+
+void Watchdog::_open( bool hardware ) {
+    if ( hardware ) {
+        _device = open( WATCHDOG_DEVICE, O_WRONLY );
+
+        if ( _device < 0 ) {
+            LogError("Could not open " << WATCHDOG_DEVICE << ", aborting watchdog initialization");
+            return;
+        }
+
+        LogInfo("Watchdog: feeding " << WATCHDOG_DEVICE);
+    }
+
+    _run = true;
+    _thread = std::thread( &Watchdog::_worker, this );
+    _opened = true;
+}
+
+//-----------------------------------------------------------------------------
+
+void Watchdog::_close() {
+    if ( _run ) {
+        _run = false;
+        _thread.join();
+    }
+
+    // the magic character disarms the hardware watchdog on a clean exit
+    if ( _device >= 0 ) {
+        if ( write( _device, "V", 1 ) != 1 ) {
+            LogWarning("Watchdog: could not disarm " << WATCHDOG_DEVICE);
+        }
+
+        close( _device );
+        _device = -1;
+    }
+
+    _opened = false;
+}
+
+//-----------------------------------------------------------------------------
+
+void Watchdog::_worker() {
+    while ( _run ) {
+        delayms( WATCHDOG_POLL_MS );
+
+        const double now = getClock();
+        bool stalled  = false;
+        bool failsafe = false;
+        std::vector<Failsafe> failsafes;
+
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+
+            for ( size_t index = 0; index < MAX_LOOPS; ++index ) {
+                Loop& loop = _loops[index];
+                if ( !loop.used ) {
+                    continue;
+                }
+
+                const double lastCheckIn = loop.lastCheckIn.load( std::memory_order_relaxed );
+                const double age = now - lastCheckIn;
+
+                if ( age > loop.deadline ) {
+                    if ( !loop.stalled ) {
+                        loop.stalled      = true;
+                        loop.stalledSince = lastCheckIn;
+                        ++_stalls;
+
+                        if ( loop.critical ) {
+                            LogCritical("Watchdog: " << loop.name << " thread stalled for " << age << "s (deadline " << loop.deadline << "s), switching outputs to safe states");
+                            failsafe = true;
+
+                            if ( _trip.empty() ) {
+                                _trip = loop.name;
+                            }
+                        }
+                        else {
+                            LogWarning("Watchdog: " << loop.name << " thread stalled for " << age << "s (deadline " << loop.deadline << "s)");
+                        }
+                    }
+
+                    // only a critical loop starves the hardware watchdog
+                    stalled |= loop.critical;
+                }
+                else if ( loop.stalled ) {
+                    LogWarning("Watchdog: " << loop.name << " thread resumed after " << lastCheckIn - loop.stalledSince << "s");
+                    loop.stalled = false;
+                }
+            }
+
+            if ( failsafe ) {
+                for ( size_t index = 0; index < _failsafes.size(); ++index ) {
+                    failsafes.push_back( _failsafes[index].second );
+                }
+            }
+        }
+
+        // called without the lock, a failsafe may take a while
+        for ( size_t index = 0; index < failsafes.size(); ++index ) {
+            failsafes[index]();
+        }
+
+        // a stalled critical loop starves the hardware watchdog
+        if ( _device >= 0 && !stalled ) {
+            if ( write( _device, "\0", 1 ) != 1 ) {
+                LogWarning("Watchdog: could not feed " << WATCHDOG_DEVICE);
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
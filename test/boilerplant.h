@@ -0,0 +1,81 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __BOILERPLANT_H__
+#define __BOILERPLANT_H__
+
+//-----------------------------------------------------------------------------
+
+/// Simulated boiler for the tests: a first order plant with a first order
+/// heater lag standing in for the dead time, like the model of the MPC and
+/// Kalman classes, plus the heat taken by water flowing in at the inlet
+/// temperature. The defaults are the stock 1425W boiler of the regulator.
+class BoilerPlant {
+public:
+    /// integration step (s)
+    static constexpr double STEP = 0.01;
+
+    /// heat needed to warm one millilitre of water by one degree (J)
+    static constexpr double WATER_HEAT_CAPACITY = 4.186;
+
+    BoilerPlant( double temperature = 20.0 )
+        :heaterGain( 1.4 )
+        ,lossCoefficient( 0.0012 )
+        ,ambient( 20.0 )
+        ,lag( 4.0 )
+        ,heaterPower( 1425.0 )
+        ,inletTemperature( 20.0 )
+        ,_temperature( temperature )
+        ,_heater( 0.0 )
+    {
+    }
+
+    /// Hold drive (duty) and flow (ml/s) for dt seconds
+    void run( double drive, double dt, double flowRate = 0.0 ) {
+        // heat capacity of the boiler (J/C), from the heating rate at full
+        // power
+        const double capacity = heaterPower / heaterGain;
+
+        for ( double time = 0.0; time < dt; time += STEP ) {
+            const double step = ( dt - time < STEP ) ? dt - time : STEP;
+            const double flowLoss = flowRate * WATER_HEAT_CAPACITY * ( _temperature - inletTemperature ) / capacity;
+
+            _temperature += step * ( heaterGain * _heater - lossCoefficient * ( _temperature - ambient ) - flowLoss );
+            _heater      += step * ( drive - _heater ) / lag;
+        }
+    }
+
+    /// Steady state at temperature: heater settled at the drive holding it
+    void settle( double temperature ) {
+        _temperature = temperature;
+        _heater      = holdingDrive( temperature );
+    }
+
+    /// Drive holding temperature without flow
+    double holdingDrive( double temperature ) const {
+        return lossCoefficient * ( temperature - ambient ) / heaterGain;
+    }
+
+    double temperature() const { return _temperature; }
+
+    double heaterGain;       ///< heating rate at full drive (C/s)
+    double lossCoefficient;  ///< loss per degree above ambient (1/s)
+    double ambient;          ///< ambient temperature (C)
+    double lag;              ///< heater lag (s)
+    double heaterPower;      ///< heater power (W)
+    double inletTemperature; ///< temperature of the water flowing in (C)
+
+private:
+    double _temperature;
+    double _heater;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __BOILERPLANT_H__
@@ -0,0 +1,52 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+//-----------------------------------------------------------------------------
+
+#include <iostream>
+
+//-----------------------------------------------------------------------------
+
+/// Report a failed expectation and count it; the test goes on
+#define CHECK( condition ) Check::expect( ( condition ), #condition, __FILE__, __LINE__ )
+
+namespace Check {
+
+inline unsigned& failures() {
+    static unsigned count = 0;
+    return count;
+}
+
+inline bool expect( bool passed, const char* condition, const char* file, int line ) {
+    if ( !passed ) {
+        std::cerr << file << ":" << line << ": check failed: " << condition << std::endl;
+        ++failures();
+    }
+    return passed;
+}
+
+/// Exit code of the test, with a summary line
+inline int result( const char* name ) {
+    if ( failures() > 0 ) {
+        std::cerr << name << ": " << failures() << " check(s) failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << name << ": passed" << std::endl;
+    return 0;
+}
+
+} // namespace Check
+
+//-----------------------------------------------------------------------------
+
+#endif // __CHECK_H__
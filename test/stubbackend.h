@@ -0,0 +1,335 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __STUBBACKEND_H__
+#define __STUBBACKEND_H__
+
+//-----------------------------------------------------------------------------
+
+#include <inttypes.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <string>
+
+extern "C" {
+    #include <pigpio.h>
+}
+
+#include "gpiobackend.h"
+
+//-----------------------------------------------------------------------------
+
+/// GPIOBackend without hardware for the tests and benchmarks: pins keep
+/// the levels and duties written to them, edges are injected by the test
+/// and delivered to the registered callbacks on the injecting thread, and
+/// to a notification handle as level reports written to a FIFO, and the
+/// tick is the steady clock in microseconds
+class StubBackend : public GPIOBackend {
+public:
+    /// number of pins kept
+    static const unsigned MAX_PINS = 32;
+
+    /// Write to a PWM pin as seen by the stub
+    struct DutyWrite {
+        unsigned pin;
+        unsigned duty;
+        uint32_t tick; ///< when the write arrived (us)
+    };
+
+    StubBackend()
+        :_epoch( std::chrono::steady_clock::now() )
+        ,_filterResult( 0 )
+        ,_notifyPipe( -1 )
+        ,_notifyBits( 0 )
+        ,_notifyLevel( 0 )
+        ,_notifySequence( 0 )
+    {
+        for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+            _writeDelay[pin] = 0;
+            _level[pin]     = 0;
+            _duty[pin]      = 0;
+            _range[pin]     = 255;
+            _frequency[pin] = 800;
+        }
+    }
+
+    /// Delay level and duty writes to pin by us, as a hung pigpiod would
+    void setWriteDelay( unsigned pin, unsigned us ) {
+        _writeDelay[pin] = us;
+    }
+
+    /// Result of setGlitchFilter and setNoiseFilter (0 or a PI_ error)
+    void setFilterResult( int result ) {
+        _filterResult = result;
+    }
+
+    ~StubBackend() {
+        notifyClose( 0 );
+    }
+
+    /// Deliver an edge to the callbacks registered for pin, and report it
+    /// to the notification handle if it monitors pin
+    void edge( unsigned pin, bool level, uint32_t tick ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+
+        for ( const Callback& callback : _callbacks ) {
+            if ( callback.used && callback.pin == pin ) {
+                callback.edgeCallback( pin, level ? 1 : 0, tick, callback.userData );
+            }
+        }
+
+        if ( _notifyPipe >= 0 && ( _notifyBits & ( 1u << pin ) ) ) {
+            _notifyLevel = level ? ( _notifyLevel | ( 1u << pin ) ) : ( _notifyLevel & ~( 1u << pin ) );
+
+            // a full pipe loses the report, as with pigpio
+            const gpioReport_t report = { _notifySequence++, 0, tick, _notifyLevel };
+            if ( ::write( _notifyPipe, &report, sizeof( report ) ) != sizeof( report ) ) {
+                return;
+            }
+        }
+    }
+
+    unsigned level( unsigned pin ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        return _level[pin];
+    }
+
+    unsigned duty( unsigned pin ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        return _duty[pin];
+    }
+
+    /// PWM duty writes seen so far
+    std::vector<DutyWrite> dutyWrites() {
+        std::lock_guard<std::mutex> lock( _mutex );
+        return _dutyWrites;
+    }
+
+    int start() { return 70; }
+    void stop() {}
+    const char* name() const { return "stub"; }
+
+    int setMode( unsigned pin, unsigned mode ) { return 0; }
+    int setPullUpDown( unsigned pin, unsigned pull ) { return 0; }
+
+    int read( unsigned pin ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        return _level[pin];
+    }
+
+    int write( unsigned pin, unsigned level ) {
+        _delay( pin );
+        std::lock_guard<std::mutex> lock( _mutex );
+        _level[pin] = ( level != 0 ) ? 1 : 0;
+        _duty[pin]  = 0;
+        return 0;
+    }
+
+    uint32_t readBank1() {
+        std::lock_guard<std::mutex> lock( _mutex );
+
+        uint32_t levels = 0;
+        for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+            levels |= _level[pin] << pin;
+        }
+        return levels;
+    }
+
+    int clearBank1( uint32_t bits ) {
+        return _writeBank( bits, 0 );
+    }
+
+    int setBank1( uint32_t bits ) {
+        return _writeBank( bits, 1 );
+    }
+
+    int setPWMDuty( unsigned pin, unsigned duty ) {
+        _delay( pin );
+        std::lock_guard<std::mutex> lock( _mutex );
+        _duty[pin] = duty;
+
+        const DutyWrite write = { pin, duty, _tick() };
+        _dutyWrites.push_back( write );
+        return 0;
+    }
+
+    int setPWMRange( unsigned pin, unsigned range ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _range[pin] = range;
+        return 0;
+    }
+
+    int getPWMRealRange( unsigned pin ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        return _range[pin];
+    }
+
+    int setPWMFrequency( unsigned pin, unsigned frequency ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _frequency[pin] = frequency;
+        return 0;
+    }
+
+    int getPWMFrequency( unsigned pin ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        return _frequency[pin];
+    }
+
+    int callback( unsigned pin, unsigned edge, EdgeCallback edgeCallback, void* userData ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+
+        const Callback callback = { pin, edgeCallback, userData, true };
+        _callbacks.push_back( callback );
+        return static_cast<int>( _callbacks.size() - 1 );
+    }
+
+    void cancelCallback( int id ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        if ( id >= 0 && static_cast<size_t>( id ) < _callbacks.size() ) {
+            _callbacks[id].used = false;
+        }
+    }
+
+    bool waitForEdge( unsigned pin, unsigned edge, double seconds ) {
+        std::this_thread::sleep_for( std::chrono::microseconds( static_cast<long>( seconds * 1.0E6 ) ) );
+        return false;
+    }
+
+    int setGlitchFilter( unsigned pin, unsigned steady ) { return _filterResult; }
+    int setNoiseFilter( unsigned pin, unsigned steady, unsigned active ) { return _filterResult; }
+
+    /// Callback registered for pin, to call it as pigpio's thread would,
+    /// without the stub's lock; false if there is none
+    bool registered( unsigned pin, EdgeCallback& edgeCallback, void*& userData ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+
+        for ( const Callback& callback : _callbacks ) {
+            if ( callback.used && callback.pin == pin ) {
+                edgeCallback = callback.edgeCallback;
+                userData     = callback.userData;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t getTick() { return _tick(); }
+
+    /// One handle (0), its pipe a FIFO in /tmp
+    int notifyOpen() {
+        std::lock_guard<std::mutex> lock( _mutex );
+        if ( _notifyPipe >= 0 ) {
+            return -1;
+        }
+
+        _notifyPath = "/tmp/stubbackend" + std::to_string( getpid() );
+        unlink( _notifyPath.c_str() );
+        if ( mkfifo( _notifyPath.c_str(), 0600 ) != 0 ) {
+            return -1;
+        }
+
+        // read and write, so that opening does not wait for the reader
+        _notifyPipe = open( _notifyPath.c_str(), O_RDWR | O_NONBLOCK );
+        return ( _notifyPipe >= 0 ) ? 0 : -1;
+    }
+
+    int notifyBegin( unsigned handle, uint32_t bits ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _notifyBits = bits;
+        return ( _notifyPipe >= 0 ) ? 0 : -1;
+    }
+
+    int notifyPause( unsigned handle ) {
+        return notifyBegin( handle, 0 );
+    }
+
+    int notifyClose( unsigned handle ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        if ( _notifyPipe < 0 ) {
+            return -1;
+        }
+
+        close( _notifyPipe );
+        unlink( _notifyPath.c_str() );
+        _notifyPipe = -1;
+        _notifyBits = 0;
+        return 0;
+    }
+
+    std::string notifyPath( unsigned handle ) const {
+        return _notifyPath;
+    }
+
+private:
+    /// Registered edge callback
+    struct Callback {
+        unsigned     pin;
+        EdgeCallback edgeCallback;
+        void*        userData;
+        bool         used;
+    };
+
+    uint32_t _tick() const {
+        return static_cast<uint32_t>( std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - _epoch ).count() );
+    }
+
+    void _delay( unsigned pin ) const {
+        const unsigned us = _writeDelay[pin];
+        if ( us > 0 ) {
+            std::this_thread::sleep_for( std::chrono::microseconds( us ) );
+        }
+    }
+
+    int _writeBank( uint32_t bits, unsigned level ) {
+        for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+            if ( bits & ( 1u << pin ) ) {
+                _delay( pin );
+            }
+        }
+
+        std::lock_guard<std::mutex> lock( _mutex );
+
+        for ( unsigned pin = 0; pin < MAX_PINS; ++pin ) {
+            if ( bits & ( 1u << pin ) ) {
+                _level[pin] = level;
+            }
+        }
+        return 0;
+    }
+
+    const std::chrono::steady_clock::time_point _epoch;
+    std::atomic<unsigned> _writeDelay[MAX_PINS]; ///< delay of writes (us)
+    std::atomic<int>      _filterResult;
+
+    unsigned _level[MAX_PINS];
+    unsigned _duty[MAX_PINS];
+    unsigned _range[MAX_PINS];
+    unsigned _frequency[MAX_PINS];
+
+    std::vector<Callback>  _callbacks;
+    std::vector<DutyWrite> _dutyWrites;
+
+    std::string _notifyPath;
+    int      _notifyPipe;     ///< write end of the FIFO, or -1
+    uint32_t _notifyBits;     ///< pins reported
+    uint32_t _notifyLevel;    ///< levels of the last report
+    uint16_t _notifySequence; ///< sequence number of the next report
+
+    std::mutex _mutex;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // __STUBBACKEND_H__
@@ -0,0 +1,155 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// PID and MPC under a power cap they do not know of: the simulated boiler
+// holds the brew temperature, then the drive is capped below the holding
+// drive for a few minutes, as the average power limit of the power budget
+// does, and lifted again. Without the capped duty handed back the integral
+// of the PID runs to its limit while the cap holds, and the MPC plans from
+// a drive the boiler never got. With it the PID must ask for little more
+// than the cap when it ends, far from saturated, and the MPC must not overshoot after it. The
+// overshoot of the PID is not checked: after a long cap it is set by the
+// proportional kick on the error built up meanwhile, wound up or not.
+//
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <iostream>
+
+#include "check.h"
+#include "boilerplant.h"
+
+#include "pid.h"
+#include "mpc.h"
+
+//-----------------------------------------------------------------------------
+
+/// brew target (C)
+static const double TARGET = 93.0;
+
+/// regulator step (s)
+static const double STEP = 1.0;
+
+/// time to settle, length of the cap and time watched after it (s)
+static const double SETTLE_TIME = 600.0;
+static const double CAP_TIME    = 300.0;
+static const double AFTER_TIME  = 900.0;
+
+/// cap as a share of the holding drive
+static const double CAP_SHARE = 0.8;
+
+/// highest overshoot after the cap with the applied duty handed back (C)
+static const double MAX_OVERSHOOT = 1.0;
+
+/// highest drive above the cap asked for when it ends, applied duty handed
+/// back: the proportional part on the error built up under the cap is
+/// left, the integral is not
+static const double MAX_EXCESS = 0.5;
+
+//-----------------------------------------------------------------------------
+
+/// Engine under test, PID or MPC with the regulator's settings
+class Engine {
+public:
+    Engine( bool predictive )
+        :_predictive( predictive )
+    {
+        _pid.setGains( 0.07, 0.05, 0.90 );
+        _pid.setOutputLimits( 0.0, 1.0 );
+        _pid.setIntegralLimits( 0.0, 1.0 );
+        _pid.setDerivativeFilter( 0.5 );
+
+        _mpc.setOutputLimits( 0.0, 1.0 );
+        _mpc.setModel( 1.4, 0.0012, 20.0, 4.0 );
+        _mpc.setMoveWeight( 20.0 );
+        _mpc.setTemperatureLimit( TARGET + 5.0 );
+    }
+
+    double update( double position ) {
+        return _predictive ? _mpc.update( TARGET, position, STEP ) : _pid.update( TARGET, position, STEP );
+    }
+
+    void setAppliedOutput( double applied ) {
+        if ( _predictive ) {
+            _mpc.setAppliedOutput( applied );
+        }
+        else {
+            _pid.setAppliedOutput( applied );
+        }
+    }
+
+private:
+    bool _predictive;
+    PID  _pid;
+    MPC  _mpc;
+};
+
+//-----------------------------------------------------------------------------
+
+/// Outcome of a cap
+struct Outcome {
+    double excess;    ///< drive asked for above the cap when it ends
+    double overshoot; ///< overshoot past the target after the cap (C)
+};
+
+/// Run the cap, handing the applied duty back to the engine or not
+static Outcome runCap( bool predictive, bool handBack ) {
+    Engine engine( predictive );
+    BoilerPlant plant;
+    plant.settle( TARGET );
+
+    const double cap = CAP_SHARE * plant.holdingDrive( TARGET );
+    Outcome outcome = { 0.0, 0.0 };
+
+    for ( double time = 0.0; time < SETTLE_TIME + CAP_TIME + AFTER_TIME; time += STEP ) {
+        const double drive = engine.update( plant.temperature() );
+
+        const bool capped = ( time >= SETTLE_TIME && time < SETTLE_TIME + CAP_TIME );
+        const double applied = capped ? std::min( drive, cap ) : drive;
+
+        if ( handBack && applied != drive ) {
+            engine.setAppliedOutput( applied );
+        }
+
+        plant.run( applied, STEP );
+
+        if ( capped ) {
+            outcome.excess = drive - cap;
+        }
+        else if ( time >= SETTLE_TIME + CAP_TIME ) {
+            outcome.overshoot = std::max( outcome.overshoot, plant.temperature() - TARGET );
+        }
+    }
+
+    return outcome;
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    for ( bool predictive : { false, true } ) {
+        const Outcome without = runCap( predictive, false );
+        const Outcome with    = runCap( predictive, true );
+
+        std::cout << ( predictive ? "MPC" : "PID" ) << ": after a " << CAP_TIME << " s cap, unaware of it "
+            << without.excess << " drive above the cap, " << without.overshoot << " C overshoot; with the applied duty "
+            << with.excess << " above the cap, " << with.overshoot << " C overshoot" << std::endl;
+
+        if ( predictive ) {
+            CHECK( with.overshoot <= MAX_OVERSHOOT );
+            CHECK( with.overshoot < without.overshoot );
+        }
+        else {
+            CHECK( with.excess <= MAX_EXCESS );
+            CHECK( with.excess < without.excess );
+        }
+    }
+
+    return Check::result( "antiwindup" );
+}
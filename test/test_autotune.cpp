@@ -0,0 +1,250 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// Relay autotune against the simulated boiler, a first order plant with a
+// heater lag: the relay of the regulator switches the drive around the brew
+// target, starting a few degrees below it, with readings quantized to
+// 0.1 C. The run must finish in time without reaching the abort
+// temperature, and the ultimate gain and period it measures must match the
+// plant's frequency response: at the period found, the ultimate gain times
+// the plant's gain is one. The PID gains derived must then hold the target,
+// and come back from the settings file as they were stored.
+//
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <iostream>
+
+#include "check.h"
+#include "boilerplant.h"
+
+#include "pid.h"
+#include "settings.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// brew target (C) and the temperature the run starts at (C)
+static const double TARGET = 93.0;
+static const double START  = 88.0;
+
+/// regulator time step (s)
+static const double STEP = 1.0;
+
+/// sensor resolution (C)
+static const double SENSOR_RESOLUTION = 0.1;
+
+/// relay: amplitude, oscillations measured and the margin to the abort
+/// temperature, as Gaggia::startAutotune; hysteresis and time limit (s) as
+/// the regulator
+static const double   AMPLITUDE  = 0.5;
+static const unsigned CYCLES     = 4;
+static const double   MARGIN     = 10.0;
+static const double   HYSTERESIS = 0.3;
+static const double   TIMEOUT    = 1800.0;
+
+/// largest deviation of the ultimate gain times the plant's gain from one
+static const double MAX_GAIN_ERROR = 0.2;
+
+/// time the tuned PID is given to settle and then watched (s), and the
+/// largest deviation from the target after it (C)
+static const double SETTLE_TIME = 600.0;
+static const double HOLD_WATCH  = 300.0;
+static const double MAX_HOLD    = 0.2;
+
+/// largest relative error of the gains read back from the settings
+static const double MAX_STORE_ERROR = 1.0E-5;
+
+//-----------------------------------------------------------------------------
+
+/// Result of a relay run
+struct Relay {
+    bool   done;           ///< oscillations measured before the time limit
+    double time;           ///< length of the run (s)
+    double maxTemperature; ///< highest boiler temperature (C)
+    double ultimateGain;   ///< duty per C
+    double ultimatePeriod; ///< s
+};
+
+//-----------------------------------------------------------------------------
+
+static double reading( const BoilerPlant& plant ) {
+    return SENSOR_RESOLUTION * std::floor( plant.temperature() / SENSOR_RESOLUTION + 0.5 );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Relay run on the plant, as Regulator::_relayStep
+static Relay runRelay( BoilerPlant& plant ) {
+    Relay result = { false, 0.0, plant.temperature(), 0.0, 0.0 };
+
+    bool on = false;
+    double lastOn = -1.0;
+    double lastOff = 0.0;
+    double high = 0.0;
+    double low = 0.0;
+    unsigned measured = 0;
+    double periodSum = 0.0;
+    double onSum = 0.0;
+    double heightSum = 0.0;
+
+    for ( double now = 0.0; now < TIMEOUT && !result.done; now += STEP ) {
+        const double temperature = reading( plant );
+        if ( temperature > TARGET + MARGIN ) {
+            break;
+        }
+
+        high = std::max( high, temperature );
+        low  = std::min( low, temperature );
+
+        if ( on && temperature > TARGET + HYSTERESIS ) {
+            on      = false;
+            lastOff = now;
+        }
+        else if ( !on && temperature < TARGET - HYSTERESIS ) {
+            on = true;
+
+            if ( lastOn >= 0.0 ) {
+                if ( measured > 0 ) {
+                    periodSum += now - lastOn;
+                    onSum     += lastOff - lastOn;
+                    heightSum += 0.5 * ( high - low );
+                }
+                ++measured;
+            }
+
+            lastOn = now;
+            high   = temperature;
+            low    = temperature;
+
+            if ( measured > CYCLES ) {
+                const double height = heightSum / CYCLES;
+                const double swing  = 0.5 * AMPLITUDE * std::sin( M_PI * onSum / periodSum );
+
+                result.done           = height > HYSTERESIS;
+                result.ultimateGain   = 4.0 * swing / ( M_PI * std::sqrt( height * height - HYSTERESIS * HYSTERESIS ) );
+                result.ultimatePeriod = periodSum / CYCLES;
+            }
+        }
+
+        plant.run( on ? AMPLITUDE : 0.0, STEP );
+
+        result.time = now;
+        result.maxTemperature = std::max( result.maxTemperature, plant.temperature() );
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Gain of the plant at the period (C per duty)
+static double plantGain( const BoilerPlant& plant, double period ) {
+    const std::complex<double> frequency( 0.0, 2.0 * M_PI / period );
+    const std::complex<double> response = ( plant.heaterGain / plant.lossCoefficient )
+        / ( ( 1.0 + frequency / plant.lossCoefficient ) * ( 1.0 + frequency * plant.lag ) );
+
+    return std::abs( response );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Largest deviation from the target once the PID with the gains settled (C)
+static double holdTarget( double pGain, double iGain, double dGain ) {
+    PID pid;
+    pid.setGains( pGain, iGain, dGain );
+    pid.setOutputLimits( 0.0, 1.0 );
+    pid.setIntegralLimits( 0.0, 1.0 );
+    pid.setDerivativeFilter( 0.5 );
+
+    BoilerPlant plant;
+    plant.settle( START );
+
+    double deviation = 0.0;
+    for ( double time = 0.0; time < SETTLE_TIME + HOLD_WATCH; time += STEP ) {
+        const double drive = pid.update( TARGET, reading( plant ), STEP );
+        plant.run( drive, STEP );
+
+        if ( time >= SETTLE_TIME ) {
+            deviation = std::max( deviation, std::fabs( plant.temperature() - TARGET ) );
+        }
+    }
+
+    return deviation;
+}
+
+//-----------------------------------------------------------------------------
+
+static bool near( double value, double expected ) {
+    return std::fabs( value - expected ) <= MAX_STORE_ERROR * std::fabs( expected );
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    Singleton<Logger>::initialize( new Logger() );
+    Singleton<Logger>::reference().enableConsoleLog( Log::LS_Warning );
+
+    BoilerPlant plant;
+    plant.settle( START );
+
+    const Relay relay = runRelay( plant );
+    const double loopGain = relay.ultimateGain * plantGain( plant, relay.ultimatePeriod );
+
+    // Ziegler-Nichols "no overshoot" rule, as the regulator
+    const double pGain = 0.2 * relay.ultimateGain;
+    const double iGain = relay.ultimatePeriod > 0.0 ? pGain / ( 0.5 * relay.ultimatePeriod ) : 0.0;
+    const double dGain = pGain * relay.ultimatePeriod / 3.0;
+
+    std::cout << "autotune: " << relay.time << " s, up to " << relay.maxTemperature << " C, Ku " << relay.ultimateGain
+        << ", Pu " << relay.ultimatePeriod << " s, Ku times the plant gain " << loopGain << std::endl;
+
+    CHECK( relay.done );
+    CHECK( relay.maxTemperature < TARGET + MARGIN );
+    CHECK( std::fabs( loopGain - 1.0 ) <= MAX_GAIN_ERROR );
+
+    if ( relay.done ) {
+        const double deviation = holdTarget( pGain, iGain, dGain );
+        std::cout << "autotune: P " << pGain << ", I " << iGain << ", D " << dGain << " hold the target within " << deviation << " C" << std::endl;
+
+        CHECK( deviation <= MAX_HOLD );
+
+        // stored and read back as Gaggia does when a run finishes
+        Singleton<Settings>::initialize( new Settings() );
+        Singleton<Settings>::pointer()->setRegulatorGains( false, iGain, pGain, dGain );
+        Singleton<Settings>::pointer()->save();
+        const std::string path = Singleton<Settings>::pointer()->getPath() + "/settings.cfg";
+        Singleton<Settings>::deinitialize();
+
+        Singleton<Settings>::initialize( new Settings() );
+        double storedI = 0.0;
+        double storedP = 0.0;
+        double storedD = 0.0;
+        double target = 0.0;
+        Singleton<Settings>::pointer()->getRegulatorSettings( false, storedI, storedP, storedD, target );
+        Singleton<Settings>::deinitialize();
+
+        std::remove( path.c_str() );
+
+        std::cout << "autotune: stored P " << storedP << ", I " << storedI << ", D " << storedD << std::endl;
+
+        CHECK( near( storedP, pGain ) );
+        CHECK( near( storedI, iGain ) );
+        CHECK( near( storedD, dGain ) );
+    }
+
+    const int result = Check::result( "autotune" );
+    Singleton<Logger>::deinitialize();
+    return result;
+}
@@ -0,0 +1,168 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// Cascade control of the group head on a toy model: the simulated boiler is
+// held at its target by the PID of the regulator, and the group follows the
+// boiler 300 s behind while losing heat to the room, so it settles well
+// below the boiler. Water flowing through during a shot brings the group
+// to the boiler temperature much faster. Starting from the group settled
+// under the boiler target of the settings, the outer loop of the cascade
+// moves the boiler target: the group must reach its own target within
+// 15 minutes and stay close to it over three back-to-back shots, while
+// without the cascade it stays where it was.
+//
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "check.h"
+#include "boilerplant.h"
+
+#include "pid.h"
+
+//-----------------------------------------------------------------------------
+
+/// boiler target of the settings and group target of the cascade (C)
+static const double BOILER_TARGET = 93.0;
+static const double GROUP_TARGET  = 90.0;
+
+/// cascade gains and highest boiler target above the group target, the
+/// settings' defaults; largest change of the boiler target per update (C)
+static const double CASCADE_P_GAIN     = 0.5;
+static const double CASCADE_I_GAIN     = 0.005;
+static const double CASCADE_MAX_OFFSET = 15.0;
+static const double CASCADE_MAX_STEP   = 0.3;
+
+/// regulator and cascade time step (s)
+static const double STEP = 1.0;
+
+/// group: lag behind the boiler, and while water flows (s); loss to the
+/// room (1/s), settling it at about 80.8 C under a 93 C boiler
+static const double GROUP_LAG      = 300.0;
+static const double GROUP_FLOW_LAG = 60.0;
+static const double GROUP_LOSS     = 0.00067;
+
+/// shots: volume (ml), flow rate (ml/s) and time between their starts (s)
+static const double   SHOT_VOLUME   = 25.0;
+static const double   SHOT_FLOW     = 2.0;
+static const double   SHOT_INTERVAL = 60.0;
+static const unsigned SHOTS         = 3;
+
+/// time the group is given to reach its target and then watched before the
+/// shots (s)
+static const double SETTLE_TIME = 900.0;
+static const double HOLD_WATCH  = 900.0;
+
+/// largest deviation of the group from its target once settled, and
+/// during and after the shots (C)
+static const double MAX_HOLD = 1.0;
+static const double MAX_SHOT = 3.5;
+
+/// smallest gap to the target left without the cascade (C)
+static const double MIN_UNCASCADED_GAP = 5.0;
+
+//-----------------------------------------------------------------------------
+
+/// Group head temperatures of a run (C)
+struct Group {
+    double settled;   ///< at the end of the settling time
+    double hold;      ///< largest deviation from the target after it
+    double shotLow;   ///< lowest during and after the shots
+    double shotHigh;  ///< highest during and after the shots
+};
+
+//-----------------------------------------------------------------------------
+
+/// Group temperature in steady state under a boiler at temperature
+static double groupSteadyState( double boiler, double ambient ) {
+    return ( boiler / GROUP_LAG + GROUP_LOSS * ambient ) / ( 1.0 / GROUP_LAG + GROUP_LOSS );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Run from steady state with the cascade on or off, then pull the shots
+static Group run( bool cascaded ) {
+    PID pid;
+    pid.setGains( 0.07, 0.05, 0.90 );
+    pid.setOutputLimits( 0.0, 1.0 );
+    pid.setIntegralLimits( 0.0, 1.0 );
+    pid.setDerivativeFilter( 0.5 );
+
+    // outer loop, as Gaggia::_setRegulatorSettings and _updateCascade
+    PID cascade;
+    cascade.setGains( CASCADE_P_GAIN, CASCADE_I_GAIN, 0.0 );
+    cascade.setFeedforward( BOILER_TARGET );
+    cascade.setIntegralLimits( -CASCADE_MAX_OFFSET, CASCADE_MAX_OFFSET );
+
+    BoilerPlant plant;
+    plant.settle( BOILER_TARGET );
+
+    double group = groupSteadyState( BOILER_TARGET, plant.ambient );
+    double boilerTarget = BOILER_TARGET;
+
+    const double shotsStart = SETTLE_TIME + HOLD_WATCH;
+    const double end = shotsStart + SHOTS * SHOT_INTERVAL + HOLD_WATCH;
+
+    Group result = { 0.0, 0.0, GROUP_TARGET, GROUP_TARGET };
+
+    for ( double time = 0.0; time < end; time += STEP ) {
+        if ( cascaded ) {
+            const double minimum = std::max( GROUP_TARGET, boilerTarget - CASCADE_MAX_STEP );
+            const double maximum = std::min( GROUP_TARGET + CASCADE_MAX_OFFSET, boilerTarget + CASCADE_MAX_STEP );
+            cascade.setOutputLimits( minimum, maximum );
+
+            boilerTarget = cascade.update( GROUP_TARGET, group, STEP );
+        }
+
+        const double drive = pid.update( boilerTarget, plant.temperature(), STEP );
+
+        const double shotTime = time - shotsStart;
+        const bool flowing = shotTime >= 0.0 && shotTime < SHOTS * SHOT_INTERVAL
+            && std::fmod( shotTime, SHOT_INTERVAL ) < SHOT_VOLUME / SHOT_FLOW;
+
+        plant.run( drive, STEP, flowing ? SHOT_FLOW : 0.0 );
+
+        const double lag = flowing ? GROUP_FLOW_LAG : GROUP_LAG;
+        group += STEP * ( ( plant.temperature() - group ) / lag - GROUP_LOSS * ( group - plant.ambient ) );
+
+        if ( time < SETTLE_TIME ) {
+            result.settled = group;
+        }
+        else if ( time < shotsStart ) {
+            result.hold = std::max( result.hold, std::fabs( group - GROUP_TARGET ) );
+        }
+        else {
+            result.shotLow  = std::min( result.shotLow, group );
+            result.shotHigh = std::max( result.shotHigh, group );
+        }
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    const Group without = run( false );
+    const Group with    = run( true );
+
+    std::cout << "cascade: group head without cascade " << without.settled << " C, with cascade " << with.settled
+        << " C after " << SETTLE_TIME << " s, then within " << with.hold << " C of " << GROUP_TARGET << " C, "
+        << with.shotLow << " to " << with.shotHigh << " C over " << SHOTS << " shots" << std::endl;
+
+    CHECK( GROUP_TARGET - without.settled >= MIN_UNCASCADED_GAP );
+    CHECK( std::fabs( with.settled - GROUP_TARGET ) <= MAX_HOLD );
+    CHECK( with.hold <= MAX_HOLD );
+    CHECK( GROUP_TARGET - with.shotLow <= MAX_SHOT );
+    CHECK( with.shotHigh - GROUP_TARGET <= MAX_SHOT );
+
+    return Check::result( "cascade" );
+}
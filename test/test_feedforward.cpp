@@ -0,0 +1,139 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// Flow feedforward during a shot: the simulated boiler holds the brew
+// temperature under the PID of the regulator, then a 25 ml shot at 2 ml/s
+// draws water in at the inlet temperature. The regulator's heat demand
+// model is added to the PID output, and shifts the drive between updates
+// as the regulator does. With the feedforward the water and the lagging,
+// quantized sensor reading must drop less than without it.
+//
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "check.h"
+#include "boilerplant.h"
+
+#include "pid.h"
+
+//-----------------------------------------------------------------------------
+
+/// brew target (C)
+static const double TARGET = 93.0;
+
+/// regulator time step and the Gaggia worker's step (s)
+static const double STEP        = 1.0;
+static const double WORKER_STEP = 0.025;
+
+/// shot: volume (ml) and flow rate (ml/s)
+static const double SHOT_VOLUME = 25.0;
+static const double SHOT_FLOW   = 2.0;
+
+/// time to settle before the shot and watched after it starts (s)
+static const double SETTLE_TIME = 300.0;
+static const double SHOT_WATCH  = 60.0;
+
+/// sensor lag (s) and resolution (C)
+static const double SENSOR_LAG        = 1.5;
+static const double SENSOR_RESOLUTION = 0.1;
+
+/// smallest feedforward change applied between PID updates (duty), as in
+/// the regulator
+static const double FEEDFORWARD_STEP = 0.005;
+
+//-----------------------------------------------------------------------------
+
+/// Temperature drops of a shot (C)
+struct Drop {
+    double water;  ///< lowest boiler temperature below the target
+    double sensor; ///< lowest reading below the target
+};
+
+//-----------------------------------------------------------------------------
+
+/// Heat demand of the water flowing in, as Regulator::_feedforward
+static double feedforward( double gain, const BoilerPlant& plant, double flowRate ) {
+    const double rise = TARGET - plant.inletTemperature;
+    if ( gain <= 0.0 || flowRate <= 0.0 || rise <= 0.0 ) {
+        return 0.0;
+    }
+
+    return gain * flowRate * BoilerPlant::WATER_HEAT_CAPACITY * rise / plant.heaterPower;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Pull a shot from steady state with the feedforward scaled by gain
+static Drop pullShot( double gain ) {
+    PID pid;
+    pid.setGains( 0.07, 0.05, 0.90 );
+    pid.setOutputLimits( 0.0, 1.0 );
+    pid.setIntegralLimits( 0.0, 1.0 );
+    pid.setDerivativeFilter( 0.5 );
+
+    BoilerPlant plant;
+    plant.settle( TARGET );
+
+    double sensor  = TARGET;
+    double drive   = plant.holdingDrive( TARGET );
+    double applied = 0.0;
+
+    const double shotStart = SETTLE_TIME;
+    const double shotEnd   = shotStart + SHOT_VOLUME / SHOT_FLOW;
+
+    Drop drop = { 0.0, 0.0 };
+    const unsigned updateSteps = static_cast<unsigned>( std::lround( STEP / WORKER_STEP ) );
+    const unsigned steps = static_cast<unsigned>( std::lround( ( SETTLE_TIME + SHOT_WATCH ) / WORKER_STEP ) );
+
+    for ( unsigned step = 0; step < steps; ++step ) {
+        const double time = step * WORKER_STEP;
+        const double flowRate = ( time >= shotStart && time < shotEnd ) ? SHOT_FLOW : 0.0;
+        const double demand = feedforward( gain, plant, flowRate );
+        const double reading = SENSOR_RESOLUTION * std::floor( sensor / SENSOR_RESOLUTION + 0.5 );
+
+        if ( step % updateSteps == 0 ) {
+            applied = demand;
+            pid.setFeedforward( applied );
+            drive = pid.update( TARGET, reading, STEP );
+        }
+        else if ( std::fabs( demand - applied ) >= FEEDFORWARD_STEP ) {
+            // shift the drive by the change, the next PID update takes over
+            drive = std::max( 0.0, std::min( drive + demand - applied, 1.0 ) );
+            applied = demand;
+        }
+
+        plant.run( drive, WORKER_STEP, flowRate );
+        sensor += WORKER_STEP * ( plant.temperature() - sensor ) / SENSOR_LAG;
+
+        if ( time >= shotStart ) {
+            drop.water  = std::max( drop.water, TARGET - plant.temperature() );
+            drop.sensor = std::max( drop.sensor, TARGET - reading );
+        }
+    }
+
+    return drop;
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    const Drop without = pullShot( 0.0 );
+    const Drop with    = pullShot( 1.0 );
+
+    std::cout << "feedforward: " << SHOT_VOLUME << " ml shot, water drops " << without.water << " C without, "
+        << with.water << " C with; sensor drops " << without.sensor << " C without, " << with.sensor << " C with" << std::endl;
+
+    CHECK( with.water < without.water );
+    CHECK( with.sensor < without.sensor );
+
+    return Check::result( "feedforward" );
+}
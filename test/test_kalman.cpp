@@ -0,0 +1,131 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// Kalman estimate during a shot: the simulated boiler holds the brew
+// temperature under the PID of the regulator, acting on the estimate, then
+// a 25 ml shot at 2 ml/s without the flow feedforward cools it in a way the
+// filter's model does not know of. The readings are quantized to 0.1 C with
+// some noise on top. Told that water flows, the filter must follow the
+// readings instead of rejecting them, and the RMS error of the estimate
+// against the boiler temperature must be lower than without.
+//
+//-----------------------------------------------------------------------------
+
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#include "check.h"
+#include "boilerplant.h"
+
+#include "kalman.h"
+#include "pid.h"
+
+//-----------------------------------------------------------------------------
+
+/// brew target (C)
+static const double TARGET = 93.0;
+
+/// regulator time step (s)
+static const double STEP = 1.0;
+
+/// shot: volume (ml) and flow rate (ml/s)
+static const double SHOT_VOLUME = 25.0;
+static const double SHOT_FLOW   = 2.0;
+
+/// time to settle before the shot and watched after it starts (s)
+static const double SETTLE_TIME = 300.0;
+static const double SHOT_WATCH  = 60.0;
+
+/// sensor resolution and noise (C)
+static const double SENSOR_RESOLUTION = 0.1;
+static const double SENSOR_NOISE      = 0.03;
+
+/// highest RMS error of the estimate over the shot when told of the flow (C)
+static const double MAX_RMS = 0.2;
+
+//-----------------------------------------------------------------------------
+
+/// Estimate during a shot
+struct Estimate {
+    double   rms;      ///< RMS error against the boiler temperature (C)
+    unsigned rejected; ///< readings rejected
+};
+
+//-----------------------------------------------------------------------------
+
+/// Pull a shot, telling the filter of the flow or not
+static Estimate pullShot( bool flowAware ) {
+    PID pid;
+    pid.setGains( 0.07, 0.05, 0.90 );
+    pid.setOutputLimits( 0.0, 1.0 );
+    pid.setIntegralLimits( 0.0, 1.0 );
+    pid.setDerivativeFilter( 0.5 );
+
+    Kalman kalman;
+
+    BoilerPlant plant;
+    plant.settle( TARGET );
+
+    std::mt19937 random( 1 );
+    std::normal_distribution<double> noise( 0.0, SENSOR_NOISE );
+
+    const double shotStart = SETTLE_TIME;
+    const double shotEnd   = shotStart + SHOT_VOLUME / SHOT_FLOW;
+
+    double drive = plant.holdingDrive( TARGET );
+    double squares = 0.0;
+    unsigned samples = 0;
+
+    Estimate estimate = { 0.0, 0 };
+
+    for ( double time = 0.0; time < SETTLE_TIME + SHOT_WATCH; time += STEP ) {
+        const double flowRate = ( time >= shotStart && time < shotEnd ) ? SHOT_FLOW : 0.0;
+        const double reading = SENSOR_RESOLUTION * std::floor( ( plant.temperature() + noise( random ) ) / SENSOR_RESOLUTION + 0.5 );
+
+        if ( flowAware ) {
+            kalman.setFlowing( flowRate > 0.0 );
+        }
+
+        kalman.predict( drive, STEP );
+        const bool accepted = kalman.correct( reading );
+
+        drive = pid.update( TARGET, kalman.getTemperature(), kalman.getRate(), STEP );
+
+        if ( time >= shotStart ) {
+            const double error = kalman.getTemperature() - plant.temperature();
+            squares += error * error;
+            ++samples;
+
+            estimate.rejected += accepted ? 0 : 1;
+        }
+
+        plant.run( drive, STEP, flowRate );
+    }
+
+    estimate.rms = std::sqrt( squares / samples );
+    return estimate;
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    const Estimate without = pullShot( false );
+    const Estimate with    = pullShot( true );
+
+    std::cout << "kalman: " << SHOT_VOLUME << " ml shot, RMS error " << without.rms << " C with "
+        << without.rejected << " reading(s) rejected unaware of the flow, " << with.rms << " C with "
+        << with.rejected << " rejected told of it" << std::endl;
+
+    CHECK( with.rms <= MAX_RMS );
+    CHECK( with.rms < without.rms );
+    CHECK( with.rejected == 0 );
+
+    return Check::result( "kalman" );
+}
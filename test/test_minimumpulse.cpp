@@ -0,0 +1,133 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// Software filter of GPIOPin on the stub backend: a pulse shorter than the
+// minimum is dropped with both its edges, a longer one is passed on when
+// the next edge shows its length, and the last edge of a burst is passed
+// on by flushEdge once the minimum pulse has passed without a further
+// edge, not before. The filter cannot be changed while an edge function
+// is registered.
+//
+//-----------------------------------------------------------------------------
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "stubbackend.h"
+
+#include "pigpiomgr.h"
+#include "gpiopin.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// pin filtered
+static const unsigned FILTER_GPIO = 17;
+
+/// minimum pulse (us) and pulses shorter and longer than it (us)
+static const unsigned MINIMUM_PULSE = 1000;
+static const unsigned SHORT_PULSE   = 100;
+static const unsigned LONG_PULSE    = 2000;
+
+//-----------------------------------------------------------------------------
+
+/// Edge handler recording the edges passed on
+class Recorder {
+public:
+    struct Edge {
+        bool     level;
+        unsigned tick;
+    };
+
+    void edge( unsigned pin, bool level, unsigned tick ) {
+        const Edge edge = { level, tick };
+        edges.push_back( edge );
+    }
+
+    bool last( bool level, unsigned tick ) const {
+        return !edges.empty() && edges.back().level == level && edges.back().tick == tick;
+    }
+
+    std::vector<Edge> edges;
+};
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    Singleton<Logger>::initialize( new Logger() );
+    Singleton<Logger>::reference().enableConsoleLog( Log::LS_Warning );
+
+    StubBackend* stub = new StubBackend();
+    Singleton<PIGPIOManager>::initialize( new PIGPIOManager( stub ) );
+
+    {
+        Recorder recorder;
+        GPIOPin pin( FILTER_GPIO );
+
+        CHECK( pin.setEdgeTrigger( GPIOPin::Both ) );
+        CHECK( pin.setMinimumPulse( MINIMUM_PULSE ) );
+
+        const bool registered = pin.edgeMethodRegister<Recorder, &Recorder::edge>( &recorder );
+        CHECK( registered );
+        CHECK( !pin.setMinimumPulse( 0 ) );
+
+        // a glitch: both edges dropped
+        const uint32_t start = stub->getTick();
+        stub->edge( FILTER_GPIO, true, start );
+        stub->edge( FILTER_GPIO, false, start + SHORT_PULSE );
+        CHECK( recorder.edges.empty() );
+
+        // a pulse: its first edge passed on by the second, which is held
+        const uint32_t rise = stub->getTick();
+        stub->edge( FILTER_GPIO, true, rise );
+        CHECK( !pin.flushEdge() );
+
+        std::this_thread::sleep_for( std::chrono::microseconds( LONG_PULSE ) );
+        const uint32_t fall = stub->getTick();
+        stub->edge( FILTER_GPIO, false, fall );
+        CHECK( recorder.edges.size() == 1 && recorder.last( true, rise ) );
+
+        // the held edge is not flushed before the minimum pulse has passed
+        std::this_thread::sleep_for( std::chrono::microseconds( LONG_PULSE ) );
+        const uint32_t last = stub->getTick();
+        stub->edge( FILTER_GPIO, true, last );
+        CHECK( recorder.edges.size() == 2 && recorder.last( false, fall ) );
+        CHECK( !pin.flushEdge() );
+
+        std::this_thread::sleep_for( std::chrono::microseconds( LONG_PULSE ) );
+        CHECK( pin.flushEdge() );
+        CHECK( recorder.edges.size() == 3 && recorder.last( true, last ) );
+        CHECK( !pin.flushEdge() );
+
+        // with Both edges, the level flushed is not passed on again
+        stub->edge( FILTER_GPIO, true, stub->getTick() );
+        std::this_thread::sleep_for( std::chrono::microseconds( LONG_PULSE ) );
+        CHECK( !pin.flushEdge() );
+        CHECK( recorder.edges.size() == 3 );
+
+        unsigned accepted = 0;
+        unsigned rejected = 0;
+        pin.getEdgeCounts( accepted, rejected );
+        CHECK( accepted == 3 );
+        CHECK( rejected == 3 );
+
+        pin.edgeFuncCancel();
+        CHECK( pin.setMinimumPulse( 0 ) );
+    }
+
+    Singleton<PIGPIOManager>::deinitialize();
+
+    const int result = Check::result( "minimumpulse" );
+    Singleton<Logger>::deinitialize();
+    return result;
+}
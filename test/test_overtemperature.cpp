@@ -0,0 +1,229 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// Over-temperature cutoff end to end, without hardware: a synthetic boiler
+// runaway is sent as ZACwire edges through the stub backend into TSIC, the
+// over-temperature check trips the boiler and the PWM-off write is seen by
+// the stub. Both trip reasons are checked, and that the boiler is off within
+// one sensor period of the packet that tripped it, also while the command
+// queue worker hangs on a write to another pin.
+//
+//-----------------------------------------------------------------------------
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+
+#include "check.h"
+#include "stubbackend.h"
+#include "zacwire.h"
+
+#include "pigpiomgr.h"
+#include "tsic.h"
+#include "boiler.h"
+#include "overtemperature.h"
+#include "settings.h"
+#include "timing.h"
+
+#include "singleton.h"
+#include "logger.h"
+
+//-----------------------------------------------------------------------------
+
+/// data line of the synthetic sensor
+static const unsigned TSIC_GPIO = 4;
+
+/// packet period of the TSIC 306 (us)
+static const uint32_t SENSOR_PERIOD_US = 100000;
+
+/// longest wait for a trip (ms)
+static const unsigned TRIP_TIMEOUT_MS = 5000;
+
+/// time the queue worker hangs on a pump write (us)
+static const unsigned HUNG_WRITE_US = 3000000;
+
+//-----------------------------------------------------------------------------
+
+/// Boiler sensor sending a temperature ramp, one packet per sensor period;
+/// each packet is delivered as it ends, so its last edge is "now"
+class RampSensor {
+public:
+    RampSensor( StubBackend* stub )
+        :_stub( stub )
+        ,_temperature( 20.0 )
+        ,_rate( 0.0 )
+        ,_start( getClock() )
+        ,_run( true )
+    {
+        _thread = std::thread( &RampSensor::_worker, this );
+    }
+
+    ~RampSensor() {
+        _run = false;
+        _thread.join();
+    }
+
+    /// Start at temperature (C), rising by rate (C/s)
+    void ramp( double temperature, double rate ) {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _temperature = temperature;
+        _rate        = rate;
+        _start       = getClock();
+    }
+
+private:
+    void _worker() {
+        while ( _run ) {
+            double temperature = 0.0;
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+                temperature = _temperature + _rate * ( getClock() - _start );
+            }
+
+            std::vector<ZACwire::Edge> edges;
+            const uint32_t last = ZACwire::packet( edges, ZACwire::raw( temperature ), 0 );
+
+            const uint32_t offset = _stub->getTick() - last;
+            for ( const ZACwire::Edge& edge : edges ) {
+                _stub->edge( TSIC_GPIO, edge.level, edge.tick + offset );
+            }
+
+            delayms( SENSOR_PERIOD_US / 1000 );
+        }
+    }
+
+    StubBackend* _stub;
+    double _temperature;
+    double _rate;
+    double _start;
+    std::mutex _mutex;
+    std::atomic<bool> _run;
+    std::thread _thread;
+};
+
+//-----------------------------------------------------------------------------
+
+/// Wait for a trip of overTemperature, false on timeout
+static bool waitForTrip( const OverTemperature& overTemperature, OverTemperature::Trip& trip ) {
+    for ( unsigned waited = 0; waited < TRIP_TIMEOUT_MS; waited += 10 ) {
+        if ( overTemperature.getTrip( trip ) ) {
+            return true;
+        }
+        delayms( 10 );
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Check the trip against the writes the stub saw on the boiler pin
+static void checkCutoff( StubBackend* stub, Boiler* boiler, const OverTemperature::Trip& trip ) {
+    CHECK( boiler->tripped() );
+    CHECK( trip.latency < SENSOR_PERIOD_US );
+
+    // the write is sent by the time the trip is reported
+    CHECK( stub->duty( BOILER_PIN ) == 0 );
+
+    bool found = false;
+    for ( const StubBackend::DutyWrite& write : stub->dutyWrites() ) {
+        if ( write.pin == BOILER_PIN && write.duty == 0 && static_cast<int32_t>( write.tick - trip.tick ) >= 0 ) {
+            CHECK( write.tick - trip.tick < SENSOR_PERIOD_US );
+            found = true;
+            break;
+        }
+    }
+    CHECK( found );
+
+    // latched: the regulator cannot switch it back on
+    boiler->setPower( 1.0 );
+    Singleton<PIGPIOManager>::pointer()->commands()->flush();
+    CHECK( stub->duty( BOILER_PIN ) == 0 );
+
+    std::cout << "trip at " << trip.temperature << " C, " << trip.slope << " C/s, boiler off "
+        << trip.latency << " us after the packet" << std::endl;
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    Singleton<Logger>::initialize( new Logger() );
+    Singleton<Logger>::reference().enableConsoleLog( Log::LS_Warning );
+
+    StubBackend* stub = new StubBackend();
+    Singleton<PIGPIOManager>::initialize( new PIGPIOManager( stub ) );
+
+    {
+        // the sensor must be sending before TSIC opens
+        RampSensor sensor( stub );
+        sensor.ramp( 90.0, 0.0 );
+
+        TSIC tsic( std::vector<TSIC::Channel>( 1, TSIC::Channel( TSIC_GPIO ) ) );
+        Boiler boiler;
+
+        CHECK( tsic.ready() );
+        CHECK( boiler.ready() );
+
+        if ( tsic.ready() && boiler.ready() ) {
+            OverTemperature::Trip trip;
+
+            // limit: 10 C/s past 120 C, rise check off
+            {
+                boiler.setPower( 1.0 );
+                Singleton<PIGPIOManager>::pointer()->commands()->flush();
+                CHECK( stub->duty( BOILER_PIN ) > 0 );
+
+                OverTemperature overTemperature( &boiler, &tsic, 120.0, 0.0 );
+                CHECK( overTemperature.ready() );
+
+                sensor.ramp( 110.0, 10.0 );
+                if ( CHECK( waitForTrip( overTemperature, trip ) ) ) {
+                    CHECK( trip.reason == OverTemperature::Reason::Temperature );
+                    CHECK( trip.temperature >= 120.0 );
+                    checkCutoff( stub, &boiler, trip );
+                }
+            }
+
+            // rate of rise: 20 C/s from 90 C, far below the limit
+            {
+                sensor.ramp( 90.0, 0.0 );
+                delayms( 500 );
+
+                boiler.resetTrip();
+                boiler.setPower( 1.0 );
+                Singleton<PIGPIOManager>::pointer()->commands()->flush();
+                CHECK( stub->duty( BOILER_PIN ) > 0 );
+
+                OverTemperature overTemperature( &boiler, &tsic, 140.0, 5.0 );
+                CHECK( overTemperature.ready() );
+
+                // the queue worker hangs on the pump for longer than the
+                // runaway takes
+                GPIOPin pump( PUMP_PIN );
+                pump.setOutput( true );
+                pump.setAsync( true );
+                stub->setWriteDelay( PUMP_PIN, HUNG_WRITE_US );
+                pump.setState( true );
+
+                sensor.ramp( 90.0, 20.0 );
+                if ( CHECK( waitForTrip( overTemperature, trip ) ) ) {
+                    CHECK( trip.reason == OverTemperature::Reason::Rise );
+                    CHECK( trip.temperature < 140.0 );
+                    CHECK( trip.slope >= 5.0 );
+                    checkCutoff( stub, &boiler, trip );
+                }
+            }
+        }
+    }
+
+    Singleton<PIGPIOManager>::deinitialize();
+
+    const int result = Check::result( "overtemperature" );
+    Singleton<Logger>::deinitialize();
+    return result;
+}
@@ -0,0 +1,184 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+//
+// TSICDecoder on synthetic pulse trains: the whole temperature range at
+// sensor clocks 20% slow to 20% fast, with and without edge jitter, checking
+// the decoded values and the confidence; corrupt packets must be rejected
+// without losing the packets after them.
+//
+//-----------------------------------------------------------------------------
+
+#include <random>
+#include <vector>
+
+#include "check.h"
+#include "zacwire.h"
+
+#include "tsicdecoder.h"
+
+//-----------------------------------------------------------------------------
+
+/// packet period of the TSIC 306 (us)
+static const uint32_t SENSOR_PERIOD_US = 100000;
+
+/// temperature step of the sweeps (C)
+static const double SWEEP_STEP = 0.7;
+
+/// clock skews of the sensor tested
+static const double SKEWS[] = { 0.8, 0.9, 1.0, 1.1, 1.2 };
+
+//-----------------------------------------------------------------------------
+
+/// Result of a sweep over the temperature range
+struct Sweep {
+    unsigned packets;  ///< packets sent
+    unsigned decoded;  ///< packets decoded with the right value
+    double   minimum;  ///< lowest confidence
+    double   mean;     ///< mean confidence
+};
+
+//-----------------------------------------------------------------------------
+
+/// Send the whole range at skew with jitter, starting at tick
+static Sweep sweep( double skew, unsigned jitter, uint32_t tick, std::mt19937& random ) {
+    TSICDecoder decoder;
+    Sweep result = { 0, 0, 1.0, 0.0 };
+
+    for ( double temperature = ZACwire::MIN_TEMP; temperature <= ZACwire::MAX_TEMP; temperature += SWEEP_STEP ) {
+        const int raw = ZACwire::raw( temperature );
+
+        std::vector<ZACwire::Edge> edges;
+        ZACwire::packet( edges, raw, tick, ZACwire::FRAME_US * skew, jitter, &random );
+        tick += SENSOR_PERIOD_US;
+        ++result.packets;
+
+        unsigned completed = 0;
+        for ( const ZACwire::Edge& edge : edges ) {
+            TSICDecoder::Packet packet;
+            if ( !decoder.edge( edge.level, edge.tick, packet ) ) {
+                continue;
+            }
+
+            ++completed;
+            if ( packet.valid && packet.temperature == ZACwire::decoded( raw ) ) {
+                ++result.decoded;
+            }
+
+            if ( packet.confidence < result.minimum ) {
+                result.minimum = packet.confidence;
+            }
+            result.mean += packet.confidence;
+
+            CHECK( packet.confidence >= 0.0 && packet.confidence <= 1.0 );
+            CHECK( packet.tick == edges.back().tick );
+        }
+
+        CHECK( completed == 1 );
+    }
+
+    result.mean /= result.packets;
+
+    const TSICDecoder::Statistics& statistics = decoder.statistics();
+    CHECK( statistics.packets == result.packets );
+    CHECK( statistics.parityErrors == 0 );
+    CHECK( statistics.frameResets == 0 );
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Every skew and temperature decodes exactly, with the confidence falling
+/// as the jitter grows but staying clear of the threshold
+static void checkSkewAndJitter() {
+    std::mt19937 random( 306 );
+
+    for ( double skew : SKEWS ) {
+        double lastMean = 2.0;
+
+        for ( unsigned jitter : { 0u, 3u, 6u } ) {
+            // the second sweep runs across the wrap of the tick
+            const uint32_t start = ( jitter == 3 ) ? 0xFFFFFFFFu - 5 * SENSOR_PERIOD_US : 1000000;
+            const Sweep result = sweep( skew, jitter, start, random );
+
+            std::cout << "skew " << skew << ", jitter " << jitter << " us: " << result.decoded << " of "
+                << result.packets << " decoded, confidence " << result.minimum << " worst, "
+                << result.mean << " mean" << std::endl;
+
+            CHECK( result.decoded == result.packets );
+            CHECK( result.mean < lastMean );
+
+            if ( jitter == 0 ) {
+                CHECK( result.minimum >= 0.9 );
+            }
+            else {
+                // a bit is a quarter frame from the threshold; its low time
+                // and the strobe setting the threshold are both off by up
+                // to twice the jitter, plus a microsecond of rounding
+                const double quarter = ZACwire::FRAME_US * skew / 4.0;
+                CHECK( result.minimum >= ( quarter - 4.0 * jitter - 2.0 ) / quarter );
+                CHECK( result.minimum > 0.0 && result.minimum < 1.0 );
+            }
+
+            lastMean = result.mean;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/// A single flipped bit fails the parity check, and the decoder picks up
+/// the next packet
+static void checkCorruption() {
+    TSICDecoder decoder;
+    uint32_t tick = 1000000;
+
+    const int raw = ZACwire::raw( 93.5 );
+    unsigned rejected = 0;
+
+    for ( int bit = 0; bit < 18; ++bit ) {
+        for ( int flip : { bit, -1 } ) {
+            std::vector<ZACwire::Edge> edges;
+            ZACwire::packet( edges, raw, tick, ZACwire::FRAME_US, 0, nullptr, flip );
+            tick += SENSOR_PERIOD_US;
+
+            TSICDecoder::Packet packet;
+            bool completed = false;
+            for ( const ZACwire::Edge& edge : edges ) {
+                completed |= decoder.edge( edge.level, edge.tick, packet );
+            }
+
+            if ( !CHECK( completed ) ) {
+                continue;
+            }
+
+            if ( flip >= 0 ) {
+                CHECK( !packet.valid );
+                rejected += packet.valid ? 0 : 1;
+            }
+            else {
+                CHECK( packet.valid && packet.temperature == ZACwire::decoded( raw ) );
+            }
+        }
+    }
+
+    const TSICDecoder::Statistics& statistics = decoder.statistics();
+    CHECK( rejected == 18 );
+    CHECK( statistics.parityErrors == 18 );
+    CHECK( statistics.packets == 36 );
+}
+
+//-----------------------------------------------------------------------------
+
+int main() {
+    checkSkewAndJitter();
+    checkCorruption();
+
+    return Check::result( "tsicdecoder" );
+}
@@ -0,0 +1,126 @@
+//-----------------------------------------------------------------------------
+//
+// Gaggia-PI: Raspberry PI Controller for the Gaggia Classic Coffee
+//
+//  Copyright 2014, 2015 by it's authors. 
+//  Some rights reserved. See COPYING, AUTHORS.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __ZACWIRE_H__
+#define __ZACWIRE_H__
+
+//-----------------------------------------------------------------------------
+
+#include <inttypes.h>
+#include <math.h>
+#include <random>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+
+/// Synthetic ZACwire packets as sent by a TSIC 306, for feeding the decoder
+/// without a sensor
+namespace ZACwire {
+
+/// nominal bit frame of the sensor (us)
+static const double FRAME_US = 125.0;
+
+/// sensor range (C), 0 and 2047 raw
+static const double MIN_TEMP = -50.0;
+static const double MAX_TEMP = 150.0;
+
+/// Edge on the data line
+struct Edge {
+    uint32_t tick;  ///< time stamp (us)
+    bool     level; ///< level after the edge
+};
+
+/// Raw 11 bit value nearest to temperature (C)
+inline int raw( double temperature ) {
+    const int value = static_cast<int>( floor( ( temperature - MIN_TEMP ) / ( MAX_TEMP - MIN_TEMP ) * 2047.0 + 0.5 ) );
+    return ( value < 0 ) ? 0 : ( ( value > 2047 ) ? 2047 : value );
+}
+
+/// Temperature the decoder reports for a raw value (C * 1000), as in the
+/// data sheet with integer arithmetic
+inline int decoded( int raw ) {
+    return static_cast<int>( ( MAX_TEMP - MIN_TEMP ) * 1000 ) * raw / 2047 + static_cast<int>( MIN_TEMP * 1000 );
+}
+
+/// Even parity bit of an eight bit value
+inline unsigned parity( unsigned value ) {
+    unsigned bits = 0;
+    for ( ; value != 0; value >>= 1 ) {
+        bits += value & 1;
+    }
+    return bits & 1;
+}
+
+/// The 18 bits after the strobes for raw, as the decoder assembles them:
+/// each byte followed by its parity bit
+inline int word( int raw ) {
+    const unsigned high = static_cast<unsigned>( raw ) >> 8;
+    const unsigned low  = static_cast<unsigned>( raw ) & 0xFF;
+    return static_cast<int>( ( ( ( high << 1 ) | parity( high ) ) << 9 ) | ( low << 1 ) | parity( low ) );
+}
+
+/// Append the edges of one packet carrying raw: a byte of the top three
+/// bits and a byte of the low eight, each a strobe, eight data bits and
+/// a parity bit, with a stop frame in between. The first edge is at
+/// start, the line is high before and after. frame is the bit period of
+/// the sensor (its clock is specified to +-20%), every edge is moved by up
+/// to +-jitter us at random. flipBit inverts that one of the 18 bits
+/// after the strobes, once the parity is computed (-1 = none). Returns the
+/// tick of the last edge.
+inline uint32_t packet( std::vector<Edge>& edges, int raw, uint32_t start, double frame = FRAME_US,
+    unsigned jitter = 0, std::mt19937* random = nullptr, int flipBit = -1 )
+{
+    std::uniform_int_distribution<int> shift( -static_cast<int>( jitter ), static_cast<int>( jitter ) );
+
+    // bits of the packet, strobes marked by -1
+    std::vector<int> bits;
+    const unsigned bytes[2] = { static_cast<unsigned>( raw ) >> 8, static_cast<unsigned>( raw ) & 0xFF };
+    for ( unsigned byte = 0; byte < 2; ++byte ) {
+        bits.push_back( -1 );
+        for ( int bit = 7; bit >= 0; --bit ) {
+            bits.push_back( ( bytes[byte] >> bit ) & 1 );
+        }
+        bits.push_back( static_cast<int>( parity( bytes[byte] ) ) );
+    }
+
+    if ( flipBit >= 0 ) {
+        // skipping the strobes
+        const size_t index = static_cast<size_t>( flipBit ) + 1 + ( flipBit >= 9 ? 1 : 0 );
+        bits[index] ^= 1;
+    }
+
+    double time = start;
+    uint32_t last = start;
+    for ( size_t index = 0; index < bits.size(); ++index ) {
+        // stop bit, high for one frame, between the bytes
+        if ( index == 10 ) {
+            time += frame;
+        }
+
+        const double low = ( bits[index] < 0 ) ? 0.5 : ( bits[index] ? 0.25 : 0.75 );
+        const int fall = ( random != nullptr && jitter > 0 ) ? shift( *random ) : 0;
+        const int rise = ( random != nullptr && jitter > 0 ) ? shift( *random ) : 0;
+
+        const Edge down = { static_cast<uint32_t>( time + fall ), false };
+        const Edge up   = { static_cast<uint32_t>( time + low * frame + rise ), true };
+        edges.push_back( down );
+        edges.push_back( up );
+
+        last = up.tick;
+        time += frame;
+    }
+
+    return last;
+}
+
+} // namespace ZACwire
+
+//-----------------------------------------------------------------------------
+
+#endif // __ZACWIRE_H__